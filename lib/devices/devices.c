@@ -26,12 +26,12 @@
 
 /* Device variables */
 
-static uint8_t * init_verifier; // Keeps track of what parts of the device setups have been completed
+static THREAD_LOCAL uint8_t * init_verifier; // Keeps track of what parts of the device setups have been completed
 
 // Device tracker attributes
 
-static uint8_t tracker_count;        // Tracker count in system
-static device_tracker_t * trackers;  // Tracker array to access trackers
+static THREAD_LOCAL uint8_t tracker_count;        // Tracker count in system
+static THREAD_LOCAL device_tracker_t * trackers;  // Tracker array to access trackers
 
 
 /* Device private function prototypes */
@@ -39,7 +39,7 @@ static device_tracker_t * trackers;  // Tracker array to access trackers
 static void comp_setup_complete(uint8_t * _);
 static void update_device_attr_mcu(uint8_t * pkt);
 static size_t pass_name_to_pkt(uint8_t * buf, size_t buf_size, const char * name);
-static bool setup_device_tracker(uint8_t , uint8_t , deinit_dev_cb , set_dev_attr_cb );
+static bool setup_device_tracker(uint8_t , const uint16_t * , uint8_t , deinit_dev_cb , set_dev_attr_cb );
 
 
 /* Device macro helper functions */
@@ -63,9 +63,15 @@ void init_device_trackers(uint8_t count)
         register_task(COMP_SETUP_COMPLETE, -1, comp_setup_complete);
         register_task(UPDATE_DEVICE_ATTR_MCU, -1, update_device_attr_mcu);
 
-        // Set init platform bits so other parts of the setup can be done
+        // Only the latest value of each attribute is sent to the computer
+        set_task_coalescing(UPDATE_DEVICE_ATTR_COMP, ATTR_UPDATE_KEY_SIZE);
+
+        // Start with empty trackers and set the init platform bits so
+        // other parts of the setup can be done
         for (uint8_t i = 0; i < tracker_count; i++)
         {
+            trackers[i] = (device_tracker_t) {.deinit_cb = deinit_null_cb, .set_attr_cb = set_null_attr_cb};
+            init_verifier[i] = 0;
             set_init_verifier_bit(i, INIT_PLATFORM_OFFSET);
         }
     }
@@ -73,6 +79,7 @@ void init_device_trackers(uint8_t count)
     {   
         free(trackers);
         free(init_verifier);
+        tracker_count = 0;
     }
 }
 
@@ -103,14 +110,26 @@ void register_platform(const char * platform_name)
 }
 
 // Setup a device tracker in the MCU and create it on the main computer
-void register_device_tracker(const char * name, uint8_t tracker_id, uint8_t device_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb)
+void register_device_tracker(const char * name, uint8_t tracker_id, uint16_t device_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb)
+{
+    register_grouped_device_tracker(name, tracker_id, &device_count, 1, deinit_cb, set_attr_cb);
+}
+
+/**Setup a device tracker whose devices are split into groups
+ * 
+ * The devices of a group (like the elevators of a building) take
+ * consecutive device ids, starting after the devices of the previous
+ * group. The computer creates the devices of each group separately,
+ * so it can tell them apart.
+ */
+void register_grouped_device_tracker(const char * name, uint8_t tracker_id, const uint16_t * group_sizes, uint8_t group_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb)
 {
     if (get_init_verifier_bit(tracker_id, PASS_PLATFORM_OFFSET))
     {
         uint8_t pkt[STR_NAME_LIMIT];
         size_t name_len = pass_name_to_pkt(pkt, STR_NAME_LIMIT, name);
 
-        if (name_len && setup_device_tracker(tracker_id, device_count, deinit_cb, set_attr_cb))
+        if (name_len && setup_device_tracker(tracker_id, group_sizes, group_count, deinit_cb, set_attr_cb))
         {
             schedule_fast_task(REGISTER_TRACKER, EXTERNAL_TASK, pkt, name_len);
             set_init_verifier_bit(tracker_id, CREATE_TRACKER_OFFSET);
@@ -173,17 +192,28 @@ void create_device_instances(uint8_t tracker_id)
 
         if (tracker->devices != NULL)
         {
-            // Partially setup device object
-            for (uint8_t i = 0; i < tracker->count; i++)
+            uint8_t pkt[2 + DEVICE_ID_SIZE * 2];  // Tracker id, group id, first device id and device count
+
+            pkt[0] = tracker_id;
+            for (uint8_t group_id = 0; group_id < tracker->group_count; group_id++)
             {
-                device_t * device = &tracker->devices[i];
-                device->device_id = i;
-                device->tracker_id = tracker_id;
+                // Partially setup device object
+                for (uint16_t i = get_group_start(tracker, group_id); i < get_group_start(tracker, group_id + 1); i++)
+                {
+                    device_t * device = &tracker->devices[i];
+                    device->device_id = i;
+                    device->group_id = group_id;
+                    device->tracker_id = tracker_id;
+                }
+
+                // Create the devices of the group on the computer
+                pkt[1] = group_id;
+                pack_device_id(pkt + 2, get_group_start(tracker, group_id));
+                pack_device_id(pkt + 2 + DEVICE_ID_SIZE, get_group_size(tracker, group_id));
+                schedule_fast_task(REGISTER_DEVICE, EXTERNAL_TASK, pkt, sizeof(pkt));
             }
 
-            // Set corresponding bit and create the devices on the computer
             set_init_verifier_bit(tracker_id, CREATE_DEVICES_OFFSET);
-            schedule_fast_task(REGISTER_DEVICE, EXTERNAL_TASK, ((uint8_t []){tracker_id, tracker->count}), sizeof(uint8_t) * 2);
         }
     }
 }
@@ -220,11 +250,12 @@ bool is_comp_device_setup_complete(uint8_t tracker_id)
 void deinit_devices(void)
 {
     // Uninitialize each device instance
-    for (uint8_t i = 0; i <= tracker_count; i++)
+    for (uint8_t i = 0; i < tracker_count; i++)
     {
         device_tracker_t * tracker = &trackers[i];
         tracker->deinit_cb(tracker->devices, tracker->count);
         free(tracker->devices);
+        free(tracker->group_offsets);
     }
 
     // Unintialize device tracker variables
@@ -271,7 +302,7 @@ bool device_initialized(uint8_t tracker_id)
  * A null desctructor for when you don't need to uninitialize 
  * a specific device object.
  */ 
-void deinit_null_cb(device_t * _, uint8_t __){}
+void deinit_null_cb(device_t * _, uint16_t __){}
 
 /**Null attribute setter callback
  * 
@@ -281,6 +312,23 @@ void deinit_null_cb(device_t * _, uint8_t __){}
 void set_null_attr_cb(uint8_t * _){}
 
 
+// Read a device id from a packet
+uint16_t unpack_device_id(const uint8_t * buf)
+{
+    uint16_t device_id;
+
+    memcpy(&device_id, buf, DEVICE_ID_SIZE);
+    return device_id;
+}
+
+
+// Write a device id in a packet
+void pack_device_id(uint8_t * buf, uint16_t device_id)
+{
+    memcpy(buf, &device_id, DEVICE_ID_SIZE);
+}
+
+
 /* Private device functions */
 
 // Device task to trigger the update attribute callback
@@ -308,21 +356,40 @@ static size_t pass_name_to_pkt(uint8_t * buf, size_t buf_size, const char * name
 }
 
 // Setup for a specific device tracker
-static bool setup_device_tracker(uint8_t tracker_id, uint8_t device_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb)
+static bool setup_device_tracker(uint8_t tracker_id, const uint16_t * group_sizes, uint8_t group_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb)
 {   
     device_tracker_t * tracker = get_tracker(tracker_id);
-    if (tracker != NULL)
+    if (tracker != NULL && group_count)
     {
-        tracker->devices = malloc(sizeof(device_t) * device_count);
+        tracker->group_offsets = malloc(sizeof(uint16_t) * (group_count + 1));
+        if (tracker->group_offsets == NULL)
+        {
+            return false;
+        }
+
+        // Find where each group starts (the device ids must fit in 16 bits)
+        uint32_t device_count = 0;
+        for (uint8_t i = 0; i < group_count; i++)
+        {
+            tracker->group_offsets[i] = device_count;
+            device_count += group_sizes[i];
+        }
+        tracker->group_offsets[group_count] = device_count;
+
+        tracker->devices = (device_count <= UINT16_MAX)? malloc(sizeof(device_t) * device_count): NULL;
         if (tracker->devices != NULL)
         {
             // Setup tracker attributes
             tracker->count = device_count;
+            tracker->group_count = group_count;
             tracker->deinit_cb = deinit_cb;
             tracker->set_attr_cb = set_attr_cb;
 
             return true;
         }
+
+        free(tracker->group_offsets);
+        tracker->group_offsets = NULL;
     }
 
     return false;
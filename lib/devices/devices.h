@@ -49,6 +49,13 @@ extern "C" {
 #define ATTR_BOOL        PRINT_BOOL      // Sends the correspoding boolean value and expects 1 byte
 #define ATTR_CHAR        PRINT_CHAR      // Sends the corresponding ASCII/Unicode character and expects 1 byte
 
+// Device id constants
+
+#define DEVICE_ID_SIZE sizeof(uint16_t)  // Bytes a device id takes in a packet
+
+// Payload bytes that identify an attribute update (tracker id, device id and attribute id)
+#define ATTR_UPDATE_KEY_SIZE (1 + DEVICE_ID_SIZE + 1)
+
 /* Device objects and helper types */
 
 /**Device container object
@@ -62,15 +69,16 @@ extern "C" {
 typedef struct
 {
     void * device;
-    uint8_t device_id;
+    uint16_t device_id;
     uint8_t tracker_id;
+    uint8_t group_id;    // Group (e.g., building) the device belongs to
     
 } device_t;
 
 
 typedef void (*set_dev_attr_cb) (uint8_t *);
 
-typedef void (*deinit_dev_cb) (device_t *, uint8_t);
+typedef void (*deinit_dev_cb) (device_t *, uint16_t);
 
 
 /**Device tracker object
@@ -83,7 +91,9 @@ typedef void (*deinit_dev_cb) (device_t *, uint8_t);
  */
 typedef struct
 {
-    uint8_t count;                 // Amount of a device in device tracker
+    uint16_t count;                // Amount of a device in device tracker
+    uint8_t group_count;           // Amount of groups the devices are split into
+    uint16_t * group_offsets;      // Id of the first device of each group (the last offset is the device count)
     device_t * devices;            // Array with the devices
     deinit_dev_cb deinit_cb;       // Destructor for an individual device
     set_dev_attr_cb set_attr_cb;   // Task to update simple device attributes
@@ -99,11 +109,16 @@ typedef struct
 // Shorthand to extract and cast a specific device object from a device tracker
 #define get_device(device_tracker, device_id) (device_tracker)->devices[device_id].device
 
+// Shorthands to get the id of the first device and the amount of devices in a tracker's group
+#define get_group_start(device_tracker, group_id) (device_tracker)->group_offsets[group_id]
+#define get_group_size(device_tracker, group_id) ((device_tracker)->group_offsets[(group_id) + 1] - (device_tracker)->group_offsets[group_id])
+
 // Setup device methods
 
 void init_device_trackers(uint8_t count);
 void register_platform(const char * platform_name);
-void register_device_tracker(const char * name, uint8_t tracker_id, uint8_t device_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb);
+void register_device_tracker(const char * name, uint8_t tracker_id, uint16_t device_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb);
+void register_grouped_device_tracker(const char * name, uint8_t tracker_id, const uint16_t * group_sizes, uint8_t group_count, deinit_dev_cb deinit_cb, set_dev_attr_cb set_attr_cb);
 void add_device_attrs(uint8_t tracker_id, const char * attrs[], uint8_t array_size);
 void create_device_instances(uint8_t tracker_id);
 bool is_comp_setup_complete(void);
@@ -118,9 +133,14 @@ void _register_device_task(const char * name, uint8_t id, uint8_t payload_size,
 void deinit_devices(void);
 bool device_initialized(uint8_t tracker_id);
 device_tracker_t * get_tracker(uint8_t tracker_id);
-void deinit_null_cb(device_t * , uint8_t );
+void deinit_null_cb(device_t * , uint16_t );
 void set_null_attr_cb(uint8_t * );
 
+// Device id packing methods
+
+uint16_t unpack_device_id(const uint8_t * buf);
+void pack_device_id(uint8_t * buf, uint16_t device_id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,507 @@
+#ifndef FSM_HPP
+#define FSM_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/* Table-driven state machine constants */
+
+#define FSM_NO_EVENT      0xFF  // Given out by a tick hook that didn't raise an event
+#define FSM_NO_TRANSITION 0xFF  // Transition table entry of an event that a state ignores
+#define FSM_ENTRY_PENDING 0x80  // Marks a member whose entry hook hasn't ran yet
+
+#define FSM_NO_DEADLINE ((fsm_time_t) -1)  // Given out when no member has a timer armed or is awake
+
+// Check if a deadline was reached (the clock is allowed to wrap around)
+#define fsm_time_reached(now, deadline) ((long) ((now) - (deadline)) >= 0)
+
+
+/* Table-driven state machine types */
+
+typedef unsigned long fsm_time_t;  // Same clock as the scheduler's timer callback (ms)
+
+/**Hooks of a state
+ *
+ * The entry hook runs once when a member enters the state and the
+ * exit hook runs once when it leaves. The tick hook runs every time
+ * the member is stepped and gives out the event the state raised
+ * (FSM_NO_EVENT if it didn't raise one). Any of the hooks can be
+ * NULL.
+ */
+template <typename member_t>
+struct fsm_hooks_t
+{
+    void (*entry)(member_t);
+    void (*exit)(member_t);
+    uint8_t (*tick)(member_t);
+};
+
+
+/**State dispatch of a state machine description
+ *
+ * The hooks of the description are constant, so each state id is
+ * compared in a chain of direct calls instead of going through a
+ * function pointer, and the compiler can inline the hooks.
+ */
+template <typename desc, uint8_t id = 0, bool is_end = (id >= desc::STATE_CNT)>
+struct fsm_dispatch_t
+{
+    typedef typename desc::member_t member_t;
+    typedef fsm_dispatch_t<desc, id + 1> next_t;
+
+    static void entry(uint8_t state, member_t member)
+    {
+        if (state != id)
+        {
+            next_t::entry(state, member);
+        }
+        else if (desc::states[id].entry != NULL)
+        {
+            desc::states[id].entry(member);
+        }
+    }
+
+    static void exit(uint8_t state, member_t member)
+    {
+        if (state != id)
+        {
+            next_t::exit(state, member);
+        }
+        else if (desc::states[id].exit != NULL)
+        {
+            desc::states[id].exit(member);
+        }
+    }
+
+    static uint8_t tick(uint8_t state, member_t member)
+    {
+        if (state != id)
+        {
+            return next_t::tick(state, member);
+        }
+        return (desc::states[id].tick != NULL)? desc::states[id].tick(member): FSM_NO_EVENT;
+    }
+};
+
+// End of the dispatch chain (reached by invalid states)
+template <typename desc, uint8_t id>
+struct fsm_dispatch_t<desc, id, true>
+{
+    static void entry(uint8_t, typename desc::member_t) {}
+    static void exit(uint8_t, typename desc::member_t) {}
+    static uint8_t tick(uint8_t, typename desc::member_t) { return FSM_NO_EVENT; }
+};
+
+
+/**Group of state machines described at compile time
+ *
+ * The description is a type that gives out:
+ *
+ * - member_t: the type of the member ids.
+ *
+ * - STATE_CNT and EVENT_CNT: the amount of states and events.
+ *
+ * - states: a constexpr array with the hooks of each state.
+ *
+ * - transitions: a constexpr STATE_CNT x EVENT_CNT array with the
+ *   state each event leads to (FSM_NO_TRANSITION if the state
+ *   ignores the event).
+ *
+ * Transitions only happen through events, either the ones raised by
+ * the tick hooks or the ones given with dispatch. When a transition
+ * happens, the member is placed in its new state, and then the exit
+ * hook of the old state and the entry hook of the new state are ran.
+ * Since the member is already in its new state, the hooks report the
+ * state the member is going to.
+ */
+template <typename desc>
+class fsm_table_group_t
+{
+    public:
+
+        typedef typename desc::member_t member_t;
+
+        // Allocate the members of the group (they don't run until their state is set)
+        bool init(member_t member_cnt)
+        {
+            curr_states = (uint8_t *) malloc(sizeof(uint8_t) * member_cnt);
+
+            if (curr_states == NULL)
+            {
+                this->member_cnt = 0;
+                return false;
+            }
+
+            this->member_cnt = member_cnt;
+            for (member_t i = 0; i < member_cnt; i++)
+            {
+                curr_states[i] = desc::STATE_CNT;
+            }
+
+            return true;
+        }
+
+        void deinit(void)
+        {
+            free(curr_states);
+            curr_states = NULL;
+            member_cnt = 0;
+        }
+
+        member_t get_member_cnt(void) const
+        {
+            return member_cnt;
+        }
+
+        // Get the current state of a member (STATE_CNT if it's not in a state)
+        uint8_t get_state(member_t member) const
+        {
+            return (member < member_cnt)? curr_states[member] & ~FSM_ENTRY_PENDING: desc::STATE_CNT;
+        }
+
+        // Check if a member still has to run the entry hook of its state
+        bool entry_pending(member_t member) const
+        {
+            return member < member_cnt && (curr_states[member] & FSM_ENTRY_PENDING);
+        }
+
+        /**Force a member into a state
+         *
+         * No hooks are ran here. The entry hook of the state runs the
+         * next time the member is stepped, so a member can be placed
+         * before the system it reports to is ready.
+         */
+        void set_state(member_t member, uint8_t id)
+        {
+            if (member < member_cnt)
+            {
+                curr_states[member] = (id < desc::STATE_CNT)? id | FSM_ENTRY_PENDING: desc::STATE_CNT;
+            }
+        }
+
+        // Pass an event to a member (returns true if the member changed states)
+        bool dispatch(member_t member, uint8_t event)
+        {
+            uint8_t id = get_state(member);
+
+            if (id >= desc::STATE_CNT || event >= desc::EVENT_CNT)
+            {
+                return false;
+            }
+
+            uint8_t next_id = desc::transitions[id][event];
+            if (next_id >= desc::STATE_CNT)
+            {
+                return false;
+            }
+
+            bool was_entered = !(curr_states[member] & FSM_ENTRY_PENDING);
+
+            curr_states[member] = next_id;
+            if (was_entered)
+            {
+                fsm_dispatch_t<desc>::exit(id, member);
+            }
+            fsm_dispatch_t<desc>::entry(next_id, member);
+
+            return true;
+        }
+
+        // Run the current state of a member once
+        void step(member_t member)
+        {
+            uint8_t id = get_state(member);
+
+            if (id >= desc::STATE_CNT)
+            {
+                return;
+            }
+
+            if (curr_states[member] & FSM_ENTRY_PENDING)
+            {
+                curr_states[member] = id;
+                fsm_dispatch_t<desc>::entry(id, member);
+                id = get_state(member);  // The entry hook might have passed an event
+            }
+
+            uint8_t event = fsm_dispatch_t<desc>::tick(id, member);
+            if (event != FSM_NO_EVENT)
+            {
+                dispatch(member, event);
+            }
+        }
+
+        // Run every member once
+        void step_all(void)
+        {
+            for (member_t i = 0; i < member_cnt; i++)
+            {
+                step(i);
+            }
+        }
+
+    private:
+
+        uint8_t * curr_states = NULL;  // Current state id of each member (with the entry pending flag)
+        member_t member_cnt = 0;
+};
+
+
+/**Group of state machines that are only ran when they have to
+ *
+ * Instead of stepping every member on each loop, a member is only
+ * stepped when the timer it armed expires or when it's woken up (by
+ * an event or by a change in the data its states look at). The hooks
+ * arm the timers of their members, and a timer is disarmed once it
+ * expires, so a state that keeps waiting must arm it again.
+ *
+ * The armed timers are kept in a min-heap, so finding the expired
+ * ones and the nearest deadline doesn't depend on the amount of
+ * members. This lets the main loop sleep until the nearest deadline.
+ */
+template <typename desc>
+class fsm_timed_group_t: public fsm_table_group_t<desc>
+{
+    public:
+
+        typedef typename desc::member_t member_t;
+        typedef fsm_table_group_t<desc> base_t;
+
+        bool init(member_t member_cnt)
+        {
+            if (!base_t::init(member_cnt))
+            {
+                return false;
+            }
+
+            deadlines = (fsm_time_t *) malloc(sizeof(fsm_time_t) * member_cnt);
+            heap = (member_t *) malloc(sizeof(member_t) * member_cnt);
+            heap_slots = (member_t *) malloc(sizeof(member_t) * member_cnt);
+            ready = (member_t *) malloc(sizeof(member_t) * member_cnt);
+            is_ready = (bool *) malloc(sizeof(bool) * member_cnt);
+
+            if (deadlines == NULL || heap == NULL || heap_slots == NULL || ready == NULL || is_ready == NULL)
+            {
+                deinit();
+                return false;
+            }
+
+            for (member_t i = 0; i < member_cnt; i++)
+            {
+                heap_slots[i] = NO_SLOT;
+                is_ready[i] = false;
+            }
+
+            return true;
+        }
+
+        void deinit(void)
+        {
+            base_t::deinit();
+
+            free(deadlines);
+            free(heap);
+            free(heap_slots);
+            free(ready);
+            free(is_ready);
+
+            deadlines = NULL;
+            heap = heap_slots = ready = NULL;
+            is_ready = NULL;
+            heap_cnt = ready_head = ready_cnt = 0;
+        }
+
+        // Force a member into a state (the member is stepped on the next run)
+        void set_state(member_t member, uint8_t id)
+        {
+            base_t::set_state(member, id);
+            wake(member);
+        }
+
+        // Pass an event to a member (the member is stepped on the next run)
+        bool dispatch(member_t member, uint8_t event)
+        {
+            bool changed = base_t::dispatch(member, event);
+            wake(member);
+            return changed;
+        }
+
+        // Step a member on the next run, without touching its timer
+        void wake(member_t member)
+        {
+            if (member >= this->get_member_cnt() || is_ready[member])
+            {
+                return;
+            }
+
+            member_t tail = (ready_head + ready_cnt) % this->get_member_cnt();
+
+            is_ready[member] = true;
+            ready[tail] = member;
+            ready_cnt++;
+        }
+
+        // Step a member once the clock reaches a deadline (replaces its armed timer)
+        void arm_timer(member_t member, fsm_time_t deadline)
+        {
+            if (member >= this->get_member_cnt())
+            {
+                return;
+            }
+
+            deadlines[member] = deadline;
+
+            if (heap_slots[member] == NO_SLOT)
+            {
+                heap_slots[member] = heap_cnt;
+                heap[heap_cnt++] = member;
+                sift_up(heap_slots[member]);
+            }
+            else
+            {
+                sift_up(heap_slots[member]);
+                sift_down(heap_slots[member]);
+            }
+        }
+
+        void disarm_timer(member_t member)
+        {
+            if (member < this->get_member_cnt() && heap_slots[member] != NO_SLOT)
+            {
+                remove_slot(heap_slots[member]);
+            }
+        }
+
+        /**Get the earliest time in which a member has to be stepped
+         *
+         * If a member is awake, then the current time is given out.
+         * If no member is awake and no timer is armed, then
+         * FSM_NO_DEADLINE is given out.
+         */
+        fsm_time_t get_next_deadline(fsm_time_t now) const
+        {
+            if (ready_cnt)
+            {
+                return now;
+            }
+
+            if (heap_cnt)
+            {
+                return fsm_time_reached(now, deadlines[heap[0]])? now: deadlines[heap[0]];
+            }
+
+            return FSM_NO_DEADLINE;
+        }
+
+        /**Step the members that are awake or whose timers expired
+         *
+         * The members woken up while they're stepped are left for the
+         * next run, so a member that keeps waking itself up can't
+         * starve the caller.
+         */
+        void run(fsm_time_t now)
+        {
+            while (heap_cnt && fsm_time_reached(now, deadlines[heap[0]]))
+            {
+                member_t member = heap[0];
+
+                remove_slot(0);
+                wake(member);
+            }
+
+            for (member_t i = ready_cnt; i > 0; i--)
+            {
+                member_t member = ready[ready_head];
+
+                ready_head = (ready_head + 1) % this->get_member_cnt();
+                ready_cnt--;
+                is_ready[member] = false;
+
+                this->step(member);
+            }
+        }
+
+    private:
+
+        static constexpr member_t NO_SLOT = (member_t) -1;
+
+        // Check if a heap slot's deadline comes before another's
+        bool slot_precedes(member_t a, member_t b) const
+        {
+            return (long) (deadlines[heap[a]] - deadlines[heap[b]]) < 0;
+        }
+
+        void swap_slots(member_t a, member_t b)
+        {
+            member_t member = heap[a];
+
+            heap[a] = heap[b];
+            heap[b] = member;
+            heap_slots[heap[a]] = a;
+            heap_slots[heap[b]] = b;
+        }
+
+        void sift_up(member_t slot)
+        {
+            while (slot && slot_precedes(slot, (slot - 1) / 2))
+            {
+                swap_slots(slot, (slot - 1) / 2);
+                slot = (slot - 1) / 2;
+            }
+        }
+
+        void sift_down(member_t slot)
+        {
+            while (true)
+            {
+                member_t first = slot;
+                member_t left = 2 * slot + 1;
+                member_t right = left + 1;
+
+                if (left < heap_cnt && slot_precedes(left, first))
+                {
+                    first = left;
+                }
+                if (right < heap_cnt && slot_precedes(right, first))
+                {
+                    first = right;
+                }
+                if (first == slot)
+                {
+                    break;
+                }
+
+                swap_slots(slot, first);
+                slot = first;
+            }
+        }
+
+        void remove_slot(member_t slot)
+        {
+            heap_slots[heap[slot]] = NO_SLOT;
+            heap_cnt--;
+
+            if (slot != heap_cnt)
+            {
+                member_t member = heap[heap_cnt];
+
+                heap[slot] = member;
+                heap_slots[member] = slot;
+                sift_up(slot);
+                sift_down(heap_slots[member]);
+            }
+        }
+
+        fsm_time_t * deadlines = NULL;  // Armed deadline of each member
+        member_t * heap = NULL;         // Min-heap of the members with an armed timer
+        member_t * heap_slots = NULL;   // Heap slot of each member (NO_SLOT if its timer isn't armed)
+        member_t heap_cnt = 0;
+
+        member_t * ready = NULL;  // Queue of the members that are awake
+        bool * is_ready = NULL;
+        member_t ready_head = 0;
+        member_t ready_cnt = 0;
+};
+
+#endif
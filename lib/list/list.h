@@ -13,9 +13,14 @@ extern "C" {
 #endif
 
 
-typedef struct list_node 
+/**Intrusive list link
+ *
+ * The link is embedded in the objects that are placed in a list, so
+ * a node and its object share the same block of memory. The object
+ * that holds a node is fetched back with list_entry.
+*/
+typedef struct list_node
 {
-    void * item;
     struct list_node * next;
 
 } list_node_t;
@@ -26,15 +31,18 @@ void move_to_back(list_node_t ** tail, list_node_t ** new_tail);
 void move_to_front(list_node_t ** head, list_node_t ** new_head);
 
 
-// Get item from list's head (this expects a list_node_t ** as an argument)
-#define peek(head) (*head)->item
+// Get the object of the given type that embeds a node in the given member
+#define list_entry(node, type, member) ((type *) ((char *) (node) - offsetof(type, member)))
+
+// Get the object in the list's head (this expects a list_node_t ** to a non-empty list)
+#define peek(head, type, member) list_entry(*(head), type, member)
 
 // Shorthand method to iterate over a list
-#define list_iterator(head, node) list_node_t * node = head; node->item != NULL; node = node->next
+#define list_iterator(head, node) list_node_t * (node) = (head); (node) != NULL; (node) = (node)->next
 
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+
+#include "pool.h"
+
+
+/* Private pool prototypes */
+
+static void set_up_pool(pool_t * pool, void * blocks, size_t item_size, uint16_t block_count, bool owns_blocks);
+
+
+/* Public pool functions */
+
+// Initialize a pool with blocks allocated in a single chunk
+bool init_pool(pool_t * pool, size_t item_size, uint16_t block_count)
+{
+    void * blocks = malloc(pool_block_size(item_size) * block_count);
+
+    set_up_pool(pool, blocks, item_size, block_count, true);
+    return pool_initialized(pool);
+}
+
+
+/**Initialize a pool with memory that was given to it
+ * 
+ * The memory must be aligned to POOL_ALIGNMENT and it must hold
+ * block_count blocks (see POOL_BACKING). It is not freed by the pool.
+ */
+bool init_static_pool(pool_t * pool, void * backing, size_t item_size, uint16_t block_count)
+{
+    set_up_pool(pool, backing, item_size, block_count, false);
+    return pool_initialized(pool);
+}
+
+
+// Uninitialize a pool (the blocks that are handed out become invalid)
+void deinit_pool(pool_t * pool)
+{
+    if (pool->owns_blocks)
+    {
+        free(pool->blocks);
+    }
+
+    pool->blocks = NULL;
+    pool->free_head = NULL;
+    pool->block_count = 0;
+    pool->used = 0;
+}
+
+
+// Take a block from a pool (NULL if there are no free blocks)
+void * alloc_pool_block(pool_t * pool)
+{
+    pool_block_t * block = pool->free_head;
+
+    if (block == NULL)
+    {
+        pool->failed_allocs++;
+        return NULL;
+    }
+
+    pool->free_head = block->next;
+    pool->used++;
+    pool->alloc_count++;
+
+    if (pool->used > pool->high_water)
+    {
+        pool->high_water = pool->used;
+    }
+
+    return block;
+}
+
+
+// Give a block back to its pool
+void free_pool_block(pool_t * pool, void * block)
+{
+    if (block != NULL)
+    {
+        ((pool_block_t *) block)->next = pool->free_head;
+        pool->free_head = block;
+        pool->used--;
+    }
+}
+
+
+// Give every block back to a pool (the statistics are kept)
+void reset_pool(pool_t * pool)
+{
+    pool->free_head = NULL;
+    pool->used = 0;
+
+    if (pool->blocks == NULL)
+    {
+        return;
+    }
+
+    // Stack the blocks in address order
+    for (uint16_t i = pool->block_count; i > 0; i--)
+    {
+        pool_block_t * block = (pool_block_t *) (pool->blocks + (size_t) (i - 1) * pool->block_size);
+
+        block->next = pool->free_head;
+        pool->free_head = block;
+    }
+}
+
+
+/* Private pool functions */
+
+static void set_up_pool(pool_t * pool, void * blocks, size_t item_size, uint16_t block_count, bool owns_blocks)
+{
+    pool->blocks = blocks;
+    pool->block_size = pool_block_size(item_size);
+    pool->block_count = (blocks != NULL)? block_count: 0;
+    pool->owns_blocks = owns_blocks;
+
+    pool->high_water = 0;
+    pool->alloc_count = 0;
+    pool->failed_allocs = 0;
+
+    reset_pool(pool);
+}
@@ -0,0 +1,105 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Pool types */
+
+// Blocks are aligned for any of the types they could hold
+typedef union
+{
+    void * ptr;
+    long long ll;
+    double d;
+    long double ld;
+    void (*func)(void);
+
+} pool_align_t;
+
+
+// A free block (the free list is kept inside the free blocks themselves)
+typedef struct pool_block
+{
+    struct pool_block * next;
+
+} pool_block_t;
+
+
+/**Fixed-block memory pool
+ * 
+ * A pool hands out blocks of the same size from a single chunk of
+ * memory. The free blocks are kept in a stack, so allocating and
+ * freeing a block are O(1). The chunk can either be allocated by
+ * the pool or given to it (e.g., a static array made with
+ * POOL_BACKING), so a pool can be used without the heap.
+ * 
+ * The pool also keeps its usage, so the amount of blocks a system
+ * needs can be tuned with the high-water mark.
+ */
+typedef struct
+{
+    uint8_t * blocks;         // Memory of the blocks (NULL if the pool was not initialized)
+    pool_block_t * free_head; // Stack of the free blocks
+    size_t block_size;        // Size of a block (rounded up to the alignment)
+    uint16_t block_count;     // Amount of blocks in the pool
+    bool owns_blocks;         // Indicates if the memory of the blocks was allocated by the pool
+
+    // Usage statistics
+    uint16_t used;            // Blocks currently handed out
+    uint16_t high_water;      // Most blocks that were handed out at once
+    uint32_t alloc_count;     // Successful allocations
+    uint32_t failed_allocs;   // Allocations that found the pool empty
+
+} pool_t;
+
+
+/* Pool macros */
+
+#define POOL_ALIGNMENT sizeof(pool_align_t)
+
+// Size of the blocks that hold an item of a given size
+#define pool_block_size(item_size) ((((item_size) < sizeof(pool_block_t)? sizeof(pool_block_t): (item_size)) + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT)
+
+/**Declare the memory for a pool of items
+ * 
+ * Declares an aligned array that can back a pool with count blocks
+ * of the given type. Pass it to init_static_pool.
+ */
+#define POOL_BACKING(name, type, count) pool_align_t name[(pool_block_size(sizeof(type)) * (count) + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT]
+
+// Typed allocation and initialization shorthands
+#define alloc_pool_item(pool, type) ((type *) alloc_pool_block(pool))
+#define init_pool_of(pool, type, count) init_pool((pool), sizeof(type), (count))
+#define init_static_pool_of(pool, backing, type, count) init_static_pool((pool), (backing), sizeof(type), (count))
+
+// Pool status shorthands
+#define pool_initialized(pool) ((pool)->blocks != NULL)
+#define pool_is_full(pool) ((pool)->free_head == NULL)
+#define get_pool_available(pool) ((uint16_t) ((pool)->block_count - (pool)->used))
+
+
+/* Pool methods */
+
+bool init_pool(pool_t * pool, size_t item_size, uint16_t block_count);
+bool init_static_pool(pool_t * pool, void * backing, size_t item_size, uint16_t block_count);
+void deinit_pool(pool_t * pool);
+
+void * alloc_pool_block(pool_t * pool);
+void free_pool_block(pool_t * pool, void * block);
+void reset_pool(pool_t * pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,35 @@
 #include "task_table/table.h"
 
 
+// Coalescing policy of a task
+typedef struct
+{
+    uint8_t id;        // Id of the task
+    uint8_t key_size;  // Payload bytes that tell the queued copies of the task apart
+
+} coalesce_policy_t;
+
+
+// Task the other system sent with a sequence that was already performed
+typedef struct
+{
+    uint8_t id;           // Id of the task
+    uint8_t seq;          // Sequence the other system gave to the task (NO_SEQ if the slot is free)
+    uint8_t ret_code;     // Return code the task was acknowledged with
+    unsigned long time;   // Time marker of the completion
+
+} completed_task_t;
+
+
+// Queue entry with the buffer of its packet (a block of the queue pool)
+typedef struct
+{
+    queue_entry_t entry;
+    uint8_t pkt_buf[MAX_DECODED_PKT_BUF_SIZE];
+
+} queue_block_t;
+
+
 /**Scheduler object
  * 
  */
@@ -15,18 +44,33 @@ typedef struct
     task_table_t table;
     serial_pkt_t rx_pkt;
     rx_schedule_cb rx_cb;
+    completed_task_t completed[SEQ_WINDOW_SIZE];  // Window of the latest tasks performed with a sequence
+    uint8_t completed_head;                       // Slot of the window that is reused next
 
     // Tx attributes
-    int16_t prev_task;
+    queue_entry_t * in_flight;  // Normal task waiting for a reply (NULL if there's none)
+    uint8_t tx_seq;            // Sequence given to the last normal task that was sent
+    uint8_t peer_credit;       // Queue space the other system last advertised
+    unsigned long credit_time; // Time marker of the last credit update or credit probe
     tx_schedule_cb tx_cb;
     unsigned long start_time;
     schedule_queues_t * queues;
     timer_schedule_cb timer_cb;
 
+    uint8_t tx_frame[MAX_ENCODED_PKT_BUF_SIZE];  // Frame a queued task is encoded into right before it's sent
+
+    capture_schedule_cb capture_cb;  // Records the frames of the link (NULL if it's not recorded)
+    completion_schedule_cb completion_cb;  // Gets the outcome of the normal tasks (NULL if nobody waits on them)
+
+    // Coalescing attributes
+    coalesce_policy_t coalesced[MAX_COALESCED_TASKS];
+    uint8_t coalesced_cnt;
+
 } task_scheduler_t;
 
 
-static task_scheduler_t scheduler;
+static THREAD_LOCAL task_scheduler_t scheduler;
+static THREAD_LOCAL POOL_BACKING(queue_backing, queue_block_t, QUEUE_SIZE);  // Memory of the queue entries, so they don't take heap space
 
 
 /* Private scheduler macro functions */
@@ -36,11 +80,19 @@ static task_scheduler_t scheduler;
 
 #define prioritize_task() move_to_front(&scheduler.queues->priority_head, &scheduler.queues->normal_head)
 
+#define ALERT_PAYLOAD_SIZE 3  // Id, return code and sequence of the task that was completed
+
 
 /* Scheduler function prototypes */
 
 static void perform_task(void);
+static bool peer_has_credit(void);
 static void process_current_task(void);
+static void complete_normal_task(uint8_t id, uint8_t ret_code, bool is_answered);
+static bool transmit_task(queue_entry_t * entry, bool is_normal);
+static coalesce_policy_t * find_coalesce_policy(uint8_t id);
+static completed_task_t * find_completed_task(uint8_t id, uint8_t seq);
+static void record_completed_task(uint8_t id, uint8_t seq, uint8_t ret_code);
 
 
 /* Public scheduler functions */
@@ -48,7 +100,17 @@ static void process_current_task(void);
 // Initialize task scheduler
 bool init_task_scheduler(rx_schedule_cb rx_cb, tx_schedule_cb tx_cb, timer_schedule_cb timer_cb)
 {
-    scheduler.prev_task = -1;
+    scheduler.in_flight = NULL;
+    scheduler.tx_seq = NO_SEQ;
+    scheduler.coalesced_cnt = 0;
+    scheduler.completed_head = 0;
+    for (uint8_t i = 0; i < SEQ_WINDOW_SIZE; i++)
+    {
+        scheduler.completed[i].seq = NO_SEQ;
+    }
+    scheduler.credit_time = 0;
+    scheduler.peer_credit = UNKNOWN_CREDIT;
+    scheduler.completion_cb = NULL;
 
     scheduler.rx_cb = rx_cb;
     scheduler.tx_cb = tx_cb;
@@ -56,7 +118,7 @@ bool init_task_scheduler(rx_schedule_cb rx_cb, tx_schedule_cb tx_cb, timer_sched
 
     scheduler.table = init_task_table(TABLE_SIZE);
     scheduler.rx_pkt = init_serial_pkt(MAX_ENCODED_PKT_BUF_SIZE);
-    scheduler.queues = init_scheduling_queues(QUEUE_SIZE, MAX_ENCODED_PKT_BUF_SIZE);
+    scheduler.queues = init_scheduling_queues(QUEUE_SIZE, MAX_DECODED_PKT_BUF_SIZE, queue_backing);
 
     // Verify if the scheduler was initialized correctly
 
@@ -77,6 +139,8 @@ void deinit_task_scheduler(void)
     deinit_task_table(scheduler.table);
     deinit_serial_pkt(&scheduler.rx_pkt);
     deinit_scheduling_queues(scheduler.queues);
+
+    scheduler.queues = NULL;
 }
 
 
@@ -92,39 +156,158 @@ void build_rx_task_pkt(uint8_t byte)
 {
     if (process_incoming_byte(&scheduler.rx_pkt, byte))
     {
+        if (scheduler.capture_cb != NULL && scheduler.rx_pkt.byte_count)
+        {
+            scheduler.capture_cb(false, scheduler.rx_pkt.buf, scheduler.rx_pkt.byte_count);
+        }
         perform_task();
     }
 }
 
 
+// Record the frames the scheduler sends and receives (NULL stops the recording)
+void set_capture_callback(capture_schedule_cb capture_cb)
+{
+    scheduler.capture_cb = capture_cb;
+}
+
+
+// Report the outcome of the normal tasks (NULL stops the reports)
+void set_completion_callback(completion_schedule_cb completion_cb)
+{
+    scheduler.completion_cb = completion_cb;
+}
+
+
+/**Get the usage of the scheduling queues
+ * 
+ * The high-water mark is the most entries that were queued at once
+ * since the scheduler was initialized, so QUEUE_SIZE can be tuned
+ * with it.
+*/
+queue_usage_t get_queue_usage(void)
+{
+    queue_usage_t usage = {0, QUEUE_SIZE, 0, 0};
+
+    if (scheduler.queues != NULL)
+    {
+        usage.high_water = get_queue_high_water(scheduler.queues);
+        usage.queued = get_queued_task_count(scheduler.queues);
+        usage.refused = get_refused_task_count(scheduler.queues);
+    }
+
+    return usage;
+}
+
+
 // A null/empty task for the scheduling system
 void null_scheduler_task(void * _){}
 
 
-// Schedule a task for an external device to perform
-void schedule_task(uint8_t id, uint8_t type, uint8_t * pkt, uint8_t pkt_size, bool is_priority, bool is_fast)
+/**Coalesce the queued copies of a task by their payload key
+ * 
+ * By default, a task is not scheduled while another copy of it is
+ * queued. With a coalescing policy, the copies are told apart by the
+ * first key_size bytes of their payload instead, and a copy with the
+ * same key takes the payload of the newer one in place, so only the
+ * latest value of each key is sent.
+*/
+bool set_task_coalescing(uint8_t id, uint8_t key_size)
+{
+    coalesce_policy_t * policy = find_coalesce_policy(id);
+
+    if (key_size > MAX_COALESCE_KEY_SIZE)
+    {
+        return false;
+    }
+
+    if (policy == NULL)
+    {
+        if (scheduler.coalesced_cnt == MAX_COALESCED_TASKS)
+        {
+            return false;
+        }
+
+        policy = &scheduler.coalesced[scheduler.coalesced_cnt++];
+        policy->id = id;
+    }
+
+    policy->key_size = key_size;
+
+    return true;
+}
+
+
+/**Schedule a task for an external device to perform
+ * 
+ * The task is refused (false is given back) if it can't be queued:
+ * its payload doesn't fit, a copy of it is queued already (unless the
+ * task is coalesced), or there's no room left in the queues. When the
+ * queues are full, a queued priority task is sent to make room. Queued
+ * normal tasks are never sent early, so they keep their order.
+ */
+bool schedule_task(uint8_t id, uint8_t type, uint8_t * pkt, uint8_t pkt_size, bool is_priority, bool is_fast)
 {
-    if (!in_queue(scheduler.queues, id))
+    coalesce_policy_t * policy = find_coalesce_policy(id);
+
+    if (pkt_size + DECODED_HDR_SIZE > MAX_DECODED_PKT_BUF_SIZE)
     {
-        // Send a task to free up space in queues (if queues were full)
-        if (queues_are_full(scheduler.queues))
+        return false;
+    }
+
+    if (policy != NULL && pkt_size >= policy->key_size)
+    {
+        // A copy that is waiting for a reply was already sent, so it keeps its payload
+        queue_entry_t * entry = find_queued_task(scheduler.queues, id, pkt, policy->key_size, scheduler.in_flight);
+
+        if (entry != NULL)
         {
-            if (is_priority_queue_empty(scheduler.queues))
+            build_outgoing_pkt(&entry->pkt, id, type, pkt, pkt_size);
+            entry->type = type;
+            entry->seq = NO_SEQ;  // The new payload is not a retransmission of a copy that was sent
+
+            if (is_fast)
             {
-                prioritize_normal_task(scheduler.queues);
+                send_task();
             }
+            return true;
+        }
+    }
+    else if (in_queue(scheduler.queues, id))
+    {
+        return false;
+    }
 
-            send_task();
+    // Send a priority task to free up space in queues (if queues were full)
+    if (queues_are_full(scheduler.queues))
+    {
+        // Queued normal tasks keep their order and wait for their replies, so the task is refused
+        if (is_priority_queue_empty(scheduler.queues))
+        {
+            return false;
         }
 
-        push_task(scheduler.queues, id, type, pkt, pkt_size, is_priority, is_fast);  // Put task in appropiate queue
+        send_task();
 
-        // Send task immediately if it's a fast task
-        if (is_fast)
+        if (queues_are_full(scheduler.queues))
         {
-            send_task();
+            return false;
         }
     }
+
+    // Put task in appropiate queue
+    if (!push_task(scheduler.queues, id, type, pkt, pkt_size, is_priority, is_fast))
+    {
+        return false;
+    }
+
+    // Send task immediately if it's a fast task
+    if (is_fast)
+    {
+        send_task();
+    }
+
+    return true;
 }
 
 
@@ -138,17 +321,31 @@ void send_task(void)
 
         if (!is_priority_queue_empty(queues))  // Send priority tasks
         {
-            scheduler.tx_cb(entry->pkt.buf, entry->pkt.byte_count);
-            pop_priority_task(scheduler.queues);
+            if (transmit_task(entry, false))
+            {
+                pop_priority_task(scheduler.queues);
+            }
         }
         else  // Send normal task
         {
             // Check if the task has been sent already
-            if (scheduler.prev_task != entry->id)
+            if (scheduler.in_flight != entry)
             {
-                scheduler.prev_task = entry->id;
+                // A retransmission keeps the sequence, so the other system can tell it apart from a new task
+                if (entry->seq == NO_SEQ)
+                {
+                    scheduler.tx_seq = (scheduler.tx_seq == UINT8_MAX)? NO_SEQ + 1: scheduler.tx_seq + 1;
+                    entry->seq = scheduler.tx_seq;
+                }
+
+                // Hold the task until the other system has space for it
+                if (!transmit_task(entry, true))
+                {
+                    return;
+                }
+
+                scheduler.in_flight = entry;
                 scheduler.start_time = scheduler.timer_cb();
-                scheduler.tx_cb(entry->pkt.buf, entry->pkt.byte_count);  // Run the serial tx routine
             }
 
             // Check if elapsed time passed the reply window
@@ -167,10 +364,15 @@ void send_task(void)
             {
                 if (entry->rescheduled) // Second reply window range check
                 {
+                    uint8_t id = entry->id;
+
+                    scheduler.in_flight = NULL;
                     pop_normal_task(scheduler.queues);
+                    complete_normal_task(id, 0, false);
                 }
                 else // First reply window range check
                 {
+                    scheduler.in_flight = NULL;  // The retransmission is sent again even if it's the only normal task
                     entry->rescheduled = true;
                     reschedule_normal_task();
                 }
@@ -185,7 +387,7 @@ void send_task(void)
 // Modify a task printer value in the main computer
 void send_printer_task_var(uint8_t task_id, uint8_t task_type, uint8_t value_id, uint8_t value_type, void * value, size_t size)
 {
-    static uint8_t var_buf[sizeof(MAX_PRINTER_SEND_TYPE) + 4];  // Static storage to place the value of the variable
+    static THREAD_LOCAL uint8_t var_buf[sizeof(MAX_PRINTER_SEND_TYPE) + 4];  // Static storage to place the value of the variable
 
     if (size <= sizeof(MAX_PRINTER_SEND_TYPE))
     {
@@ -204,24 +406,36 @@ void send_printer_task_var(uint8_t task_id, uint8_t task_type, uint8_t value_id,
  * This function is recognized as one of the internal commands of the
  * scheduling system. If the return code in the packet is non-zero, then
  * the system will reschedule the task. Otherwise, it will be taken out
- * of the normal queue.
+ * of the normal queue. A reply only counts for the copy of the task
+ * with the same sequence.
  */ 
 static void process_current_task(void)
 {
-    if (scheduler.queues->normal_head != NULL)
+    uint8_t * payload = scheduler.rx_pkt.buf + PAYLOAD_OFFSET;
+
+    if (scheduler.queues->normal_head != NULL && scheduler.rx_pkt.byte_count >= DECODED_HDR_SIZE + ALERT_PAYLOAD_SIZE)
     {
         queue_entry_t* entry = peek_normal(scheduler.queues);
 
-        if (scheduler.rx_pkt.buf[PAYLOAD_OFFSET] == entry->id)
+        if (payload[0] == entry->id && payload[2] == entry->seq)
         {
-            if (scheduler.rx_pkt.buf[PAYLOAD_OFFSET + 1] && !entry->rescheduled)
+            if (payload[1] && !entry->rescheduled)
             {
                 entry->rescheduled = true;
+                entry->seq = NO_SEQ;  // The other system ran the task, so the retry is performed as a new task
+                scheduler.in_flight = NULL;  // The retry is sent again even if it's the only normal task
                 reschedule_normal_task();
             }
             else
             {
+                uint8_t id = entry->id;
+
+                if (scheduler.in_flight == entry)
+                {
+                    scheduler.in_flight = NULL;
+                }
                 pop_normal_task(scheduler.queues);
+                complete_normal_task(id, payload[1], true);
             }
         }
     }
@@ -241,16 +455,170 @@ static void perform_task(void)
     serial_pkt_t * rx_pkt = &scheduler.rx_pkt;
     task_entry_t * entry = process_incoming_pkt(scheduler.table, rx_pkt);
 
+    // Every verified packet carries the queue space of the other system
+    if (rx_pkt->decoded && get_task_credit(rx_pkt) != UNKNOWN_CREDIT)
+    {
+        scheduler.peer_credit = get_task_credit(rx_pkt);
+        scheduler.credit_time = scheduler.timer_cb();
+    }
+
     if (entry != NULL) // If all checks passed, run rx callback (this is the handler for external tasks)
     {
-        ret_code = scheduler.rx_cb(entry->id, entry->task, rx_pkt->buf + PAYLOAD_OFFSET);
-        alert_task_completion(entry->id, ret_code);
+        uint8_t seq = get_task_seq(rx_pkt);
+        completed_task_t * completed = find_completed_task(entry->id, seq);
+
+        // A retransmission of a task that was already performed is only acknowledged again
+        if (completed != NULL)
+        {
+            ret_code = completed->ret_code;
+        }
+        else
+        {
+            ret_code = scheduler.rx_cb(entry->id, entry->task, rx_pkt->buf + PAYLOAD_OFFSET);
+            record_completed_task(entry->id, seq, ret_code);
+        }
+
+        alert_task_completion(entry->id, ret_code, seq);
     }
 
-    else if (get_task_type(rx_pkt) == INTERNAL_TASK && get_task_id(rx_pkt) == ALERT_SYSTEM)
+    else if (rx_pkt->decoded && get_task_type(rx_pkt) == INTERNAL_TASK && get_task_id(rx_pkt) == ALERT_SYSTEM)
     {
         process_current_task();
     }
 
     rx_pkt->byte_count = 0;  // Reset rx packet buffer
+}
+
+
+/**Check if the other system can take in another normal task
+ * 
+ * The other system advertises how much space it has left in its
+ * queues with every packet it sends (its replies included). When it
+ * runs out, normal tasks are held in the queues until it advertises
+ * more space.
+ * 
+ * Since the other system might not have anything to send after
+ * freeing up space, a task is let through every once in a while
+ * to probe it for a new credit.
+ */
+static bool peer_has_credit(void)
+{
+    if (scheduler.peer_credit == UNKNOWN_CREDIT || scheduler.peer_credit > 0)
+    {
+        return true;
+    }
+
+    if (scheduler.timer_cb() - scheduler.credit_time >= CREDIT_PROBE_TIMER)
+    {
+        scheduler.credit_time = scheduler.timer_cb();
+        return true;
+    }
+
+    return false;
+}
+
+
+/**Send a queued task through the tx callback
+ * 
+ * A normal task consumes one credit from the other system, since it
+ * takes a queue entry there for the reply. Priority tasks (the task
+ * completion alerts included) are always sent, since they are not
+ * answered and nothing would refill the credit they take.
+ */
+static bool transmit_task(queue_entry_t * entry, bool is_normal)
+{
+    if (is_normal)
+    {
+        if (!peer_has_credit())
+        {
+            return false;
+        }
+
+        if (scheduler.peer_credit != UNKNOWN_CREDIT && scheduler.peer_credit > 0)
+        {
+            scheduler.peer_credit--;
+        }
+    }
+
+    uint8_t frame_size = encode_outgoing_pkt(&entry->pkt, get_available_entries(scheduler.queues), entry->seq, scheduler.tx_frame);
+    scheduler.tx_cb(scheduler.tx_frame, frame_size);
+
+    if (scheduler.capture_cb != NULL)
+    {
+        scheduler.capture_cb(true, scheduler.tx_frame, frame_size - 1);  // Leave out the delimiter
+    }
+
+    return true;
+}
+
+
+// Report the outcome of a normal task that left the queue
+static void complete_normal_task(uint8_t id, uint8_t ret_code, bool is_answered)
+{
+    if (scheduler.completion_cb != NULL)
+    {
+        scheduler.completion_cb(id, ret_code, is_answered);
+    }
+}
+
+
+// Get the coalescing policy of a task (NULL if it doesn't have one)
+static coalesce_policy_t * find_coalesce_policy(uint8_t id)
+{
+    for (uint8_t i = 0; i < scheduler.coalesced_cnt; i++)
+    {
+        if (scheduler.coalesced[i].id == id)
+        {
+            return &scheduler.coalesced[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**Find a task in the window of completed sequences (NULL if it's not there)
+ * 
+ * The other system only retransmits a task within a bounded time, so
+ * the sequences that are older than that are forgotten. This keeps a
+ * system that restarted its sequences from having its first tasks
+ * taken for retransmissions.
+ */
+static completed_task_t * find_completed_task(uint8_t id, uint8_t seq)
+{
+    if (seq == NO_SEQ)
+    {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < SEQ_WINDOW_SIZE; i++)
+    {
+        completed_task_t * completed = &scheduler.completed[i];
+
+        if (completed->seq == seq && completed->id == id && scheduler.timer_cb() - completed->time < SEQ_WINDOW_TIMER)
+        {
+            return completed;
+        }
+    }
+
+    return NULL;
+}
+
+
+// Remember the return code of a task performed with a sequence (the oldest one in the window is replaced)
+static void record_completed_task(uint8_t id, uint8_t seq, uint8_t ret_code)
+{
+    if (seq == NO_SEQ)
+    {
+        return;
+    }
+
+    completed_task_t * completed = &scheduler.completed[scheduler.completed_head];
+
+    completed->id = id;
+    completed->seq = seq;
+    completed->ret_code = ret_code;
+    completed->time = scheduler.timer_cb();
+
+    scheduler.completed_head = (scheduler.completed_head + 1) % SEQ_WINDOW_SIZE;
 }
\ No newline at end of file
@@ -71,6 +71,34 @@ typedef void (*tx_schedule_cb)(uint8_t * pkt, uint8_t pkt_size);
 */
 typedef uint8_t (*rx_schedule_cb)(uint8_t task_id, task_t task, uint8_t * pkt);
 
+/**Capture callback function
+ * 
+ * If it's set, this callback is given every frame the scheduler sends
+ * or receives, so the link can be recorded. The frames are COBS
+ * encoded and they don't carry the delimiter.
+ */
+typedef void (*capture_schedule_cb)(bool is_tx, const uint8_t * frame, uint8_t frame_size);
+
+/**Completion callback function
+ * 
+ * If it's set, this callback is given the outcome of every normal task
+ * once it leaves the queue. The return code is the one the other system
+ * replied with. If the reply windows passed, is_answered is false
+ * instead. The task is already out of the queue, so the callback can
+ * schedule others.
+ */
+typedef void (*completion_schedule_cb)(uint8_t id, uint8_t ret_code, bool is_answered);
+
+// Usage of the scheduling queues
+typedef struct
+{
+    uint16_t high_water;  // Most entries that were queued at once
+    uint16_t size;        // Entries the queues have
+    uint32_t queued;      // Tasks that were queued
+    uint32_t refused;     // Tasks that found the queues full
+
+} queue_usage_t;
+
 
 /* Scheduler functions */
 
@@ -80,6 +108,9 @@ bool init_task_scheduler(rx_schedule_cb rx_cb, tx_schedule_cb tx_cb, timer_sched
 void send_task(void);
 void null_scheduler_task(void *);
 void build_rx_task_pkt(uint8_t byte);
+void set_capture_callback(capture_schedule_cb capture_cb);
+void set_completion_callback(completion_schedule_cb completion_cb);
+queue_usage_t get_queue_usage(void);
 
 void register_task_private(uint8_t id, int payload_size, task_t task);
 
@@ -95,7 +126,8 @@ void register_task_private(uint8_t id, int payload_size, task_t task);
 
 // Task scheduling methods
 
-void schedule_task(uint8_t id, uint8_t type, uint8_t * pkt, uint8_t pkt_size, bool is_priority, bool is_fast);
+bool schedule_task(uint8_t id, uint8_t type, uint8_t * pkt, uint8_t pkt_size, bool is_priority, bool is_fast);
+bool set_task_coalescing(uint8_t id, uint8_t key_size);
 
 /**Schedule a normal task
  * 
@@ -103,12 +135,23 @@ void schedule_task(uint8_t id, uint8_t type, uint8_t * pkt, uint8_t pkt_size, bo
  * an external device running the scheduling system so it can remove the
  * task from the normal scheduling queue. 
  * 
+ * Normal tasks are flow controlled. Every packet carries the free queue
+ * entries of its sender (the credit), which is the room it has left to
+ * answer normal tasks, since every reply is queued as a completion
+ * alert. A normal task takes one credit when it's sent, and the reply
+ * brings the updated credit back. While the other system has no credit
+ * left, normal tasks are held in the queue, and one is let through
+ * every CREDIT_PROBE_TIMER to probe it for a new credit. Priority and
+ * fast tasks are never held and don't take credit.
+ * 
  * It uses the timer callback to check if the allowed reply time has passed to
  * wait for the other system to reply. If it does not reply in time, the task
  * will be rescheduled with a larger timer window for the other system to reply.
- * If this also fails, the system will reschedule the task in the priority queue
- * and tell the other system to execute it and unschedule it afterwards without
- * verifying if it was executed properly in the other system.
+ * If this also fails, the task is unscheduled and reported as unanswered.
+ * 
+ * When the queues are full, a queued priority task is sent to make room.
+ * If there are only normal tasks, the new task is refused (false is
+ * returned), so the queued normal tasks keep their order.
  */
 #define schedule_normal_task(id, payload_pkt, payload_size) schedule_task(id, EXTERNAL_TASK, payload_pkt, payload_size, false, false)
 
@@ -142,9 +185,10 @@ void schedule_task(uint8_t id, uint8_t type, uint8_t * pkt, uint8_t pkt_size, bo
  * 
  * The id and return code must be a number from 0 to 255. If the return
  * code is non-zero, the system will assume an error has ocurred while
- * running the task.
+ * running the task. The sequence of the task tells the other system
+ * which of the copies it sent is being answered.
 */
-#define alert_task_completion(id, ret_code) schedule_fast_task(ALERT_SYSTEM, INTERNAL_TASK, ((uint8_t []) {id, ret_code}), sizeof(uint8_t) * 2)
+#define alert_task_completion(id, ret_code, seq) schedule_fast_task(ALERT_SYSTEM, INTERNAL_TASK, ((uint8_t []) {id, ret_code, seq}), sizeof(uint8_t) * 3)
 
 #define print_message(id, msg_num) schedule_fast_task(PRINT_MESSAGE, INTERNAL_TASK, ((uint8_t []) {id, EXTERNAL_TASK, msg_num}), sizeof(uint8_t) * 3)
 #define print_internal_message(id, msg_num) schedule_fast_task(PRINT_MESSAGE, INTERNAL_TASK, ((uint8_t []) {id, INTERNAL_TASK, msg_num}), sizeof(uint8_t) * 3)
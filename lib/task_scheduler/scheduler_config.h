@@ -25,6 +25,35 @@
 
 # define QUEUE_SIZE 5  // Max amount of tasks can be allocated in the scheduler
 
+// Modifiable coalescing constants
+
+#define MAX_COALESCED_TASKS   2  // Max amount of tasks that can have a coalescing policy
+#define MAX_COALESCE_KEY_SIZE 4  // Max amount of payload bytes that identify a coalesced task
+
+// Modifiable sequencing constants
+
+#define SEQ_WINDOW_SIZE 4  // Amount of completed task sequences remembered to detect retransmissions
+
+
+/* Storage constants */
+
+// Modifiable storage constants
+
+/**The scheduler and the subsystems built on it keep their state in
+ * file scope singletons. A host that runs many of them at once (one
+ * per thread) defines THREAD_LOCAL_STATE, so every thread gets its own
+ * copy of the singletons. The MCUs leave it undefined.
+*/
+#ifdef THREAD_LOCAL_STATE
+#ifdef __cplusplus
+#define THREAD_LOCAL thread_local
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+#else
+#define THREAD_LOCAL
+#endif
+
 
 /* Packet constants */
 
@@ -36,8 +65,8 @@
 
 // Packet size constants
 
-#define ENCODED_HDR_SIZE         5
-#define DECODED_HDR_SIZE         4
+#define ENCODED_HDR_SIZE         7
+#define DECODED_HDR_SIZE         6
 #define MAX_ALLOWED_PKT_SIZE     255
 #define MAX_DECODED_PKT_BUF_SIZE DECODED_HDR_SIZE + MAX_PAYLOAD_SIZE
 #define MAX_ENCODED_PKT_BUF_SIZE ENCODED_HDR_SIZE + MAX_PAYLOAD_SIZE + 1  // A
@@ -47,7 +76,9 @@
 #define CRC16_OFFSET      0
 #define TASK_ID_OFFSET    2
 #define TASK_TYPE_OFFSET  3
-#define PAYLOAD_OFFSET    4
+#define CREDIT_OFFSET     4
+#define SEQ_OFFSET        5
+#define PAYLOAD_OFFSET    6
 
 
 /* Scheduler constants */
@@ -61,6 +92,14 @@
 #define SHORT_TIMER 350  // Allowed time for the first reply time range
 #define LONG_TIMER  500  // Allowed time for the second reply time range
 
+// Flow control constants
+
+#define CREDIT_PROBE_TIMER LONG_TIMER  // Time to wait before sending a task to a system that has no credit left
+
+// Sequencing constants
+
+#define SEQ_WINDOW_TIMER (QUEUE_SIZE * (SHORT_TIMER + LONG_TIMER))  // Time a completed sequence is remembered (longer than a retransmission can be held back)
+
 /* Immutable Scheduler constants */
 
 // Task types
@@ -68,6 +107,14 @@
 #define INTERNAL_TASK 0
 #define EXTERNAL_TASK 1
 
+// Credit value used until the other system advertises its available queue space
+
+#define UNKNOWN_CREDIT 0xFF
+
+// Sequence of the tasks that are not waiting for a reply (they are never retransmitted, so they are not tracked)
+
+#define NO_SEQ 0
+
 // Internal command ids
 
 #define ALERT_SYSTEM        0
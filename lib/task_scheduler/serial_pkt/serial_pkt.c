@@ -24,6 +24,11 @@
 // Possible encoding errors
 
 
+/* Private serial function prototypes */
+
+static void fill_outgoing_pkt(uint8_t * decoded_pkt, uint8_t task_id, uint8_t task_type, uint8_t * payload_pkt, uint8_t payload_size);
+
+
 /* Public serial functions */
 
 // Initialize a packet
@@ -32,6 +37,7 @@ serial_pkt_t init_serial_pkt(uint8_t pkt_size)
     serial_pkt_t pkt;
 
     pkt.byte_count = 0;
+    pkt.decoded = false;
 
     // Check if requested size is less than the allowed pkt size
     if (pkt_size < MAX_ALLOWED_PKT_SIZE)
@@ -85,8 +91,9 @@ bool process_incoming_byte(serial_pkt_t * rx_pkt, uint8_t byte)
  */ 
 task_entry_t * process_incoming_pkt(task_table_t table, serial_pkt_t * rx_pkt)
 {
-    static uint8_t encoded_pkt[MAX_ENCODED_PKT_BUF_SIZE];
+    static THREAD_LOCAL uint8_t encoded_pkt[MAX_ENCODED_PKT_BUF_SIZE];
 
+    rx_pkt->decoded = false;
     memcpy(encoded_pkt, rx_pkt->buf, rx_pkt->byte_count);  // Pass encoded pkt to inner buffer
 
     // Check for minimum header length
@@ -109,6 +116,8 @@ task_entry_t * process_incoming_pkt(task_table_t table, serial_pkt_t * rx_pkt)
         return NULL;
     }
 
+    rx_pkt->decoded = true;  // Header can be trusted from this point on
+
     // If task is an internal task, skip table lookup and pass decoded pkt to rx_pkt
     if (rx_pkt->buf[TASK_TYPE_OFFSET] == INTERNAL_TASK)
     {
@@ -143,9 +152,10 @@ task_entry_t * process_incoming_pkt(task_table_t table, serial_pkt_t * rx_pkt)
 }
 
 
+// Build a one-off task packet that is COBS encoded right away
 bool process_outgoing_pkt(serial_pkt_t * tx_pkt, uint8_t task_id, uint8_t task_type, uint8_t * payload_pkt, uint8_t payload_size)
 {
-    static uint8_t decoded_pkt[MAX_DECODED_PKT_BUF_SIZE];
+    static THREAD_LOCAL uint8_t decoded_pkt[MAX_DECODED_PKT_BUF_SIZE];
 
     // Check if the task payload is small enough to fit
     if (payload_size + DECODED_HDR_SIZE > MAX_DECODED_PKT_BUF_SIZE)
@@ -153,15 +163,61 @@ bool process_outgoing_pkt(serial_pkt_t * tx_pkt, uint8_t task_id, uint8_t task_t
         return false;
     }
 
+    fill_outgoing_pkt(decoded_pkt, task_id, task_type, payload_pkt, payload_size);
+    tx_pkt->byte_count = cobs_encode(decoded_pkt, DECODED_HDR_SIZE + payload_size, tx_pkt->buf);
+    tx_pkt->decoded = false;
+
+    return true;
+}
+
+
+/**Build a task packet that is held until it's sent
+ * 
+ * The packet is kept decoded, since its credit and sequence are only
+ * known when it's about to be sent. It's encoded by
+ * encode_outgoing_pkt once those are stamped.
+ */
+bool build_outgoing_pkt(serial_pkt_t * tx_pkt, uint8_t task_id, uint8_t task_type, uint8_t * payload_pkt, uint8_t payload_size)
+{
+    // Check if the task payload is small enough to fit
+    if (payload_size + DECODED_HDR_SIZE > MAX_DECODED_PKT_BUF_SIZE || payload_size + DECODED_HDR_SIZE > tx_pkt->size)
+    {
+        return false;
+    }
+
+    fill_outgoing_pkt(tx_pkt->buf, task_id, task_type, payload_pkt, payload_size);
+    tx_pkt->byte_count = DECODED_HDR_SIZE + payload_size;
+    tx_pkt->decoded = true;
+
+    return true;
+}
+
+
+// Stamp the credit and sequence of a held packet and encode it into a frame (the size of the frame is given back)
+uint8_t encode_outgoing_pkt(serial_pkt_t * tx_pkt, uint8_t credit, uint8_t seq, uint8_t * frame)
+{
+    tx_pkt->buf[CREDIT_OFFSET] = credit;
+    tx_pkt->buf[SEQ_OFFSET] = seq;
+
+    return cobs_encode(tx_pkt->buf, tx_pkt->byte_count, frame);
+}
+
+
+/* Private serial functions */
+
+// Fill the header and payload of a decoded task packet
+static void fill_outgoing_pkt(uint8_t * decoded_pkt, uint8_t task_id, uint8_t task_type, uint8_t * payload_pkt, uint8_t payload_size)
+{
     // Pass task attributes to tx_pkt buffer
     decoded_pkt[TASK_ID_OFFSET] = task_id;
     decoded_pkt[TASK_TYPE_OFFSET] = task_type;
-    memcpy(decoded_pkt + PAYLOAD_OFFSET, payload_pkt, payload_size);
+    decoded_pkt[CREDIT_OFFSET] = UNKNOWN_CREDIT;  // Stamped with the actual credit right before it's sent
+    decoded_pkt[SEQ_OFFSET] = NO_SEQ;             // Stamped with the sequence of the task right before it's sent
+    if (payload_size)
+    {
+        memcpy(decoded_pkt + PAYLOAD_OFFSET, payload_pkt, payload_size);  // Tasks without a payload can pass NULL
+    }
 
     // TODO: Put crc16 stuff here for the in_buf (add checksum to header; for now, I'm passing 0)
     memcpy(decoded_pkt + CRC16_OFFSET, (uint16_t []){0}, 2);
-
-    tx_pkt->byte_count = cobs_encode(decoded_pkt, DECODED_HDR_SIZE + payload_size, tx_pkt->buf);
-
-    return true;
 }
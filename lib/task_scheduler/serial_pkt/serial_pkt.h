@@ -8,6 +8,10 @@
 #include "../task_table/table.h"
 #include "../scheduler_config.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // /* Public serial constants */
 
 // #define PKT_BUF_SIZE 30  // Move to config file
@@ -30,6 +34,7 @@ typedef struct
 {
     uint8_t size;
     uint8_t * buf;
+    bool decoded;       // Indicates the buffer holds a decoded packet (an rx packet that passed verification or a tx packet held until it's sent)
     size_t byte_count;
 
 } serial_pkt_t;
@@ -43,11 +48,19 @@ serial_pkt_t init_serial_pkt(uint8_t pkt_size);
 bool process_incoming_byte(serial_pkt_t * rx_pkt, uint8_t byte);
 task_entry_t * process_incoming_pkt(task_table_t table, serial_pkt_t * rx_pkt);
 bool process_outgoing_pkt(serial_pkt_t * tx_pkt, uint8_t task_id, uint8_t task_type, uint8_t * payload_pkt, uint8_t payload_size);
+bool build_outgoing_pkt(serial_pkt_t * tx_pkt, uint8_t task_id, uint8_t task_type, uint8_t * payload_pkt, uint8_t payload_size);
+uint8_t encode_outgoing_pkt(serial_pkt_t * tx_pkt, uint8_t credit, uint8_t seq, uint8_t * frame);
 
 #define get_task_id(pkt) (pkt)->buf[TASK_ID_OFFSET]
 #define get_task_type(pkt) (pkt)->buf[TASK_TYPE_OFFSET]
+#define get_task_credit(pkt) (pkt)->buf[CREDIT_OFFSET]
+#define get_task_seq(pkt) (pkt)->buf[SEQ_OFFSET]
 
 // Unitialize a packet
 #define deinit_serial_pkt(pkt) free((pkt)->buf)
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -5,64 +5,48 @@
 #include "../scheduler.h"
 
 
-/*Scheduling queue constants */
-
-// Sections where the scheduling queue initialization can fail
-
-#define FAILED_SCHEDULING_QUEUES 0
-#define FAILED_MEMORY_POOL       1
-#define FAILED_QUEUE_ENTRIES     2
-
-
 /* Scheduling queue prototypes */
 
-static void link_queues(schedule_queues_t * queues, uint8_t queue_size);
-static bool init_queue_entries(schedule_queues_t * queues, uint8_t queue_size, uint8_t pkt_size);
-static list_node_t ** prepare_unscheduled_task(schedule_queues_t * queues, uint8_t task_id, uint8_t task_type, uint8_t* payload_pkt, uint8_t payload_size);
+static list_node_t * prepare_unscheduled_task(schedule_queues_t * queues, uint8_t task_id, uint8_t task_type, uint8_t* payload_pkt, uint8_t payload_size);
 
 
 /** Public scheduling queue methods **/
 
-// Initializes scheduling queues
-schedule_queues_t * init_scheduling_queues(uint8_t queue_size, uint8_t pkt_size)
+/**Initializes scheduling queues
+ * 
+ * The entries are taken from the backing memory if it's given (see
+ * POOL_BACKING, with blocks of an entry plus pkt_size bytes), so the
+ * entries don't touch the heap. Otherwise, they are allocated.
+*/
+schedule_queues_t * init_scheduling_queues(uint8_t queue_size, uint8_t pkt_size, void * backing)
 {
-    uint8_t init_fail_section = FAILED_SCHEDULING_QUEUES;
     schedule_queues_t * queues = malloc(sizeof(schedule_queues_t));
 
     // Check if scheduler queues where initialized
     if (queues == NULL)
     {
-        goto handle_queue_deinit;
+        return NULL;
     }
 
     // Define attributes for scheduling system
     queues->size = queue_size;
-    queues->schedule_pool = malloc(sizeof(list_node_t) * queue_size);  // Memory pool for scheduling tasks
+    queues->pkt_size = pkt_size;
+    queues->normal_head = NULL;
+    queues->normal_tail = NULL;
+    queues->priority_head = NULL;
+    queues->priority_tail = NULL;
+
+    // Memory pool for scheduling tasks
+    bool is_pool_set_up = (backing != NULL)? init_static_pool(&queues->pool, backing, sizeof(queue_entry_t) + pkt_size, queue_size):
+                                              init_pool(&queues->pool, sizeof(queue_entry_t) + pkt_size, queue_size);
 
-    // Check if the schedule pool and the entries inside it where initialized
-    if (queues->schedule_pool== NULL || !init_queue_entries(queues, queue_size, pkt_size))
+    if (!is_pool_set_up)
     {
-        init_fail_section = (queues->schedule_pool == NULL)? FAILED_MEMORY_POOL: FAILED_QUEUE_ENTRIES;
-        goto handle_queue_deinit;
+        free(queues);
+        return NULL;
     }
 
-    link_queues(queues, queue_size);
     return queues;
-
-handle_queue_deinit:
-
-    // Intentionally using switch fall-through to free up memory in order
-    // when a part of scheduling fifos are not initialized correctly
-    switch (init_fail_section)
-    {
-        case FAILED_QUEUE_ENTRIES:
-            free(queues->schedule_pool);
-        
-        case FAILED_MEMORY_POOL:
-            free(queues);
-    }    
-
-    return NULL;
 }
 
 
@@ -71,15 +55,7 @@ void deinit_scheduling_queues(schedule_queues_t * queues)
 {
     if (queues != NULL)
     {
-        for (uint8_t i = 0; i < queues->size; i++)
-        {
-            queue_entry_t * entry = queues->schedule_pool[i].item;
-
-            deinit_serial_pkt(&entry->pkt);
-        }
-
-        free(queues->schedule_pool->item);
-        free(queues->schedule_pool);
+        deinit_pool(&queues->pool);
         free(queues);
     }
 }
@@ -87,23 +63,29 @@ void deinit_scheduling_queues(schedule_queues_t * queues)
 
 bool push_task(schedule_queues_t * queues, uint8_t task_id, uint8_t task_type, uint8_t * payload_pkt, uint8_t payload_size, bool is_priority, bool to_front)
 {
-    list_node_t ** unscheduled_task_node = prepare_unscheduled_task(queues, task_id, task_type, payload_pkt, payload_size);
+    list_node_t * task_node = prepare_unscheduled_task(queues, task_id, task_type, payload_pkt, payload_size);
 
     // If there are no unscheduled tasks, then tell the system
     // tasks were scheduled
-    if (unscheduled_task_node == NULL)
+    if (task_node == NULL)
     {
         return false;
     }
 
     // Place unscheduled task in one of the queues
 
-    list_node_t * next_unscheduled_head = (*unscheduled_task_node)->next;
-
     if (to_front) // Place task in the front
     {
         list_node_t ** head_task_node = (is_priority)? &queues->priority_head: &queues->normal_head;
-        move_to_front(head_task_node, unscheduled_task_node); 
+        list_node_t ** tail_task_node = (is_priority)? &queues->priority_tail: &queues->normal_tail;
+
+        // If the queue is empty, the new head is also the tail
+        if ((*tail_task_node) == NULL)
+        {
+            *tail_task_node = task_node;
+        }
+
+        move_to_front(head_task_node, &task_node); 
     }
     else  // Place task in the back
     {
@@ -115,14 +97,12 @@ bool push_task(schedule_queues_t * queues, uint8_t task_id, uint8_t task_type, u
         {
             list_node_t** head_task_node = (is_priority) ? &queues->priority_head : &queues->normal_head;
             
-            *head_task_node = *unscheduled_task_node;
+            *head_task_node = task_node;
         }
 
-        move_to_back(tail_task_node, unscheduled_task_node);
+        move_to_back(tail_task_node, &task_node);
     }
 
-    *unscheduled_task_node = next_unscheduled_head;
-
     return true;
 }
 
@@ -154,18 +134,10 @@ void pop_task(schedule_queues_t * queues, bool is_priority)
             *tail_node = NULL;
         }
 
-        // Reset old task
-        queue_entry_t * completed_task = (*head_node)->item;
-
-        completed_task->id = -1;
-        completed_task->pkt.byte_count = 0;
-        completed_task->rescheduled = false;
+        list_node_t * completed_node = *head_node;
 
-        list_node_t * next_head = (*head_node)->next;
-
-        move_to_front(&queues->unscheduled, head_node);  // Push completed task to unscheduled task
-
-        *head_node = next_head;
+        *head_node = completed_node->next;
+        free_pool_block(&queues->pool, list_entry(completed_node, queue_entry_t, link));  // Give the completed task back to the pool
     }
 }
 
@@ -175,6 +147,17 @@ void prioritize_normal_task(schedule_queues_t * queues)
 {
     list_node_t * next_normal_head = queues->normal_head->next;
 
+    // Adjust the tails if the task is the last one in the normal
+    // FIFO or the first one in the priority FIFO
+    if (queues->normal_head == queues->normal_tail)
+    {
+        queues->normal_tail = NULL;
+    }
+    if (queues->priority_tail == NULL)
+    {
+        queues->priority_tail = queues->normal_head;
+    }
+
     move_to_front(&queues->priority_head, &queues->normal_head);
 
     queues->normal_head = next_normal_head;
@@ -197,16 +180,22 @@ void reschedule_queue_task(schedule_queues_t * queues, bool is_priority)
         tail_node = &queues->normal_tail;
     }
 
-    ((queue_entry_t *) (*head_node)->item)->rescheduled = true;
+    peek(head_node, queue_entry_t, link)->rescheduled = true;
 
-    move_to_back(tail_node, head_node);
+    // A task that is alone in its FIFO is already in the back
+    if (*head_node != *tail_node)
+    {
+        list_node_t * next_head = (*head_node)->next;
+
+        move_to_back(tail_node, head_node);
+        *head_node = next_head;
+    }
 }
 
 
 // Checks if a task is in the task queue
 bool in_queue(schedule_queues_t * queues, uint8_t id)
 {
-    queue_entry_t * entry;
     list_node_t * queue_array[] = {queues->normal_head, queues->priority_head};
 
     // Search the normal and priority pending task fifos for a matching task id
@@ -214,8 +203,7 @@ bool in_queue(schedule_queues_t * queues, uint8_t id)
     {
         for (list_iterator(queue_array[i], queue_node))
         {
-            entry = queue_node->item;
-            if (entry->id  == id)
+            if (list_entry(queue_node, queue_entry_t, link)->id == id)
             {
                 return true;
             }
@@ -226,92 +214,71 @@ bool in_queue(schedule_queues_t * queues, uint8_t id)
 }
 
 
-/** Private scheduling queue methods **/
-
-// Initialize entries in the scheduling memory pool
-static bool init_queue_entries(schedule_queues_t * queues, uint8_t queue_size, uint8_t pkt_size)
+/**Find a queued task with the given id and payload key
+ * 
+ * The key is compared against the first key_size bytes of the
+ * payloads (a key size of 0 only matches the id). The skipped entry
+ * (e.g., a task waiting for a reply) is never given out.
+*/
+queue_entry_t * find_queued_task(schedule_queues_t * queues, uint8_t id, const uint8_t * key, uint8_t key_size, const queue_entry_t * skipped)
 {
-    int i = 0;
-
-    // Create entries with packets
-
-    queue_entry_t * schedule_item_pool = malloc(sizeof(queue_entry_t) * queue_size);
+    list_node_t * queue_array[] = {queues->normal_head, queues->priority_head};
 
-    if (schedule_item_pool != NULL)
+    for (uint8_t i = 0; i < 2; i++)
     {
-        for (i = 0; i < queue_size; i++)
+        for (list_iterator(queue_array[i], queue_node))
         {
-            queue_entry_t * entry = &schedule_item_pool[i];
-
-            queues->schedule_pool[i].item = entry;
+            queue_entry_t * entry = list_entry(queue_node, queue_entry_t, link);
 
-            // Initialize entry attributes
-            entry->id = -1;
-            entry->rescheduled = false;
-            entry->pkt = init_serial_pkt(pkt_size);
-
-            // If buffers where not initialized correctly
-            if (entry->pkt.buf == NULL)
+            if (entry->id == id && entry != skipped && (!key_size || !memcmp(entry->key, key, key_size)))
             {
-                break;
+                return entry;
             }
-            
         }
     }
 
-    // Unitialize entries if no more space is left
-    if (i != (int) queue_size)
-    {
-        for (; i < 0; i--)
-        {
-            queue_entry_t * entry = queues->schedule_pool[i].item;
-            deinit_serial_pkt(&entry->pkt);
-        }
-
-        free(schedule_item_pool);
-    }
-
-    return i == (int) queue_size;
+    return NULL;
 }
 
 
-/**Link queues and memory pool
- */ 
-static void link_queues(schedule_queues_t * queues, uint8_t queue_size)
-{
-    // Queue linking
-    queues->normal_head = NULL;
-    queues->normal_tail = NULL;
-    queues->priority_head = NULL;
-    queues->priority_tail = NULL;
-    queues->unscheduled = queues->schedule_pool;
-
-    // Link up memory pool
-    for (uint8_t i = 0; i < queue_size; i++)
-    {
-        queues->schedule_pool[i].next = (i < queue_size - 1)? &queues->schedule_pool[i + 1]: NULL;
-    }
-}
-
+/** Private scheduling queue methods **/
 
-// Check and prepare unscheduled task for scheduling
-static list_node_t ** prepare_unscheduled_task(schedule_queues_t * queues, uint8_t task_id, uint8_t task_type, uint8_t* payload_pkt, uint8_t payload_size)
+// Take a task from the pool and prepare it for scheduling
+static list_node_t * prepare_unscheduled_task(schedule_queues_t * queues, uint8_t task_id, uint8_t task_type, uint8_t* payload_pkt, uint8_t payload_size)
 {
+    queue_entry_t * new_task = alloc_pool_item(&queues->pool, queue_entry_t);
+
     // If no task is available for scheduling, then return nothing
-    if (queues_are_full(queues))
+    if (new_task == NULL)
     {
         return NULL;
     }
 
-    queue_entry_t * new_task = queues->unscheduled->item;  // Fetch an unscheduled task from stack
+    new_task->link.next = NULL;
+
+    new_task->rescheduled = false;
+    new_task->seq = NO_SEQ;
+    new_task->pkt.size = queues->pkt_size;
+    new_task->pkt.buf = (uint8_t *) (new_task + 1);  // The packet buffer comes right after the entry
+    new_task->pkt.decoded = false;
+    new_task->pkt.byte_count = 0;
 
-    // Verify if outgoing packet object was processed correctly
-    if (!process_outgoing_pkt(&new_task->pkt, task_id, task_type, payload_pkt, payload_size))
+    // Verify if outgoing packet object was processed correctly (it's encoded once it's sent)
+    if (!build_outgoing_pkt(&new_task->pkt, task_id, task_type, payload_pkt, payload_size))
     {
+        free_pool_block(&queues->pool, new_task);
         return NULL;
     }
 
     new_task->id = task_id;  // Pass the task id to the unscheduled task node
+    new_task->type = task_type;
 
-    return &queues->unscheduled;
-}
\ No newline at end of file
+    // Keep the start of the payload, so the task can be coalesced
+    memset(new_task->key, 0, MAX_COALESCE_KEY_SIZE);
+    if (payload_size)
+    {
+        memcpy(new_task->key, payload_pkt, (payload_size < MAX_COALESCE_KEY_SIZE)? payload_size: MAX_COALESCE_KEY_SIZE);
+    }
+
+    return &new_task->link;
+}
@@ -7,7 +7,9 @@
 #include <stdbool.h>
 #endif
 
-#include "../list/list.h"
+#include <list.h>
+#include <pool.h>
+
 #include "../serial_pkt/serial_pkt.h"
 
 #ifdef __cplusplus
@@ -17,8 +19,12 @@ extern "C" {
 
 typedef struct
 {
+    list_node_t link;  // Link of the entry in its scheduling fifo
     int16_t id;        // Id to keep track of pending task
+    uint8_t type;      // Type of the pending task (internal or external)
     bool rescheduled;  // Flag to determine if entry has been rescheduled
+    uint8_t seq;       // Sequence of the task on the link (NO_SEQ until it's sent as a normal task)
+    uint8_t key[MAX_COALESCE_KEY_SIZE];  // First payload bytes of the task (zero padded), used to coalesce it
     serial_pkt_t pkt;  // Packet given to the pending task
 
 } queue_entry_t;
@@ -26,17 +32,19 @@ typedef struct
 
 /**Queues for scheduling tasks
  * 
- * 
+ * Every scheduled task takes a block from the queue pool. A block
+ * holds the entry of the task (which embeds its FIFO link) and the
+ * buffer of its packet, so scheduling a task doesn't touch the heap.
 */
 typedef struct task_queues
 {
     uint8_t size;                  // Number of available task entries
-    list_node_t * unscheduled;     // Stack of unused entries in memory pool
+    uint8_t pkt_size;              // Size of the packet buffer of each entry
     list_node_t * normal_head;     // FIFO head for scheduled task entries
     list_node_t * normal_tail;     // FIFO tail for scheduled task entries
     list_node_t * priority_head;   // FIFO head for scheduled task entries with priority
     list_node_t * priority_tail;   // FIFO tail for scheduled task entries with priority
-    list_node_t * schedule_pool;   // Memory pool for tasks
+    pool_t pool;                   // Memory pool for tasks
 
 } schedule_queues_t;
 
@@ -46,7 +54,7 @@ typedef struct task_queues
 // Queue init/deinit methods
 
 void deinit_scheduling_queues(schedule_queues_t * queues);
-schedule_queues_t * init_scheduling_queues(uint8_t queue_size, uint8_t pkt_size);
+schedule_queues_t * init_scheduling_queues(uint8_t queue_size, uint8_t pkt_size, void * backing);
 
 // Queue peeking methods
 
@@ -56,8 +64,8 @@ schedule_queues_t * init_scheduling_queues(uint8_t queue_size, uint8_t pkt_size)
  * scheduling fifo.
 */
 
-#define peek_normal(queues) ((queue_entry_t *) (queues)->normal_head->item)      // Pass entry of the normal scheduling fifo
-#define peek_priority(queues) ((queue_entry_t *) (queues)->priority_head->item)  // Pass entry of the priority scheduling fifo
+#define peek_normal(queues) peek(&(queues)->normal_head, queue_entry_t, link)      // Pass entry of the normal scheduling fifo
+#define peek_priority(queues) peek(&(queues)->priority_head, queue_entry_t, link)  // Pass entry of the priority scheduling fifo
 
 // Queue popping methods
 
@@ -82,8 +90,17 @@ void reschedule_queue_task(schedule_queues_t * queues, bool is_priority);
 // Queue status verification methods
 
 bool in_queue(schedule_queues_t * queues, uint8_t id);
+queue_entry_t * find_queued_task(schedule_queues_t * queues, uint8_t id, const uint8_t * key, uint8_t key_size, const queue_entry_t * skipped);
+
+#define queues_are_full(queues) pool_is_full(&(queues)->pool)
+
+#define get_available_entries(queues) ((uint8_t) get_pool_available(&(queues)->pool))
+
+// Queue usage methods (kept by the queue pool)
 
-#define queues_are_full(queues) ((queues)->unscheduled == NULL)
+#define get_queue_high_water(queues) ((queues)->pool.high_water)       // Most entries that were queued at once
+#define get_queued_task_count(queues) ((queues)->pool.alloc_count)     // Tasks that were queued
+#define get_refused_task_count(queues) ((queues)->pool.failed_allocs)  // Tasks that found the queues full
 
 #define is_normal_queue_empty(queues) ((queues)->normal_head == NULL)
 #define is_priority_queue_empty(queues) ((queues)->priority_head == NULL) 
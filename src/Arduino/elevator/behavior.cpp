@@ -1,219 +1,334 @@
-#include <Arduino.h>
+#include <fsm.hpp>
 
 #include "elevator.h"
 
 
 /* Elevator behavior constants */
 
-#define ELEVATOR_MOVE_TIME 3000  // Time the elevator takes to move from floor to another
+#define LIGHTS_OFF_TIME 10000  // Time the lights stay on after the doors close
 
 
-enum idle_stages
+// Events that move an elevator between its states
+enum elevator_events
 {
-    CLOSE_DOOR_TIME = 4000,
-    LIGHTS_OFF_TIME = 10000
+    LIMITS_EXCEEDED,
+    LIMITS_RESTORED,
+    MAINTENANCE_STARTED,
+    MAINTENANCE_ENDED,
+    FLOOR_ASSIGNED,
+    FLOOR_REACHED,
+    ELEVATOR_EVENT_CNT
 };
 
 
-// state_t prototypes
+// State hook prototypes
 
-static void idle_run(void * args);
-static void moving_run(void * args);
-static void emergency_run(void * args);
+static void idle_entry(uint16_t car_index);
+static void moving_entry(uint16_t car_index);
+static void emergency_entry(uint16_t car_index);
+static void emergency_exit(uint16_t car_index);
 
-static uint8_t idle_change(void * args);
-static uint8_t moving_change(void * args);
-static uint8_t emergency_change(void * args);
-static uint8_t maintenance_change(void * args);
+static uint8_t idle_tick(uint16_t car_index);
+static uint8_t moving_tick(uint16_t car_index);
+static uint8_t emergency_tick(uint16_t car_index);
+static uint8_t maintenance_tick(uint16_t car_index);
 
+static void arm_idle_timer(car_fields_t * cars, uint16_t car_index);
+static unsigned long get_floor_pass_time(car_fields_t * cars, uint16_t car_index);
 
-// State for elevators
 
-static state_t idle = {.run = idle_run, .change = idle_change};
-static state_t moving = {.run = moving_run, .change = moving_change};
-static state_t emergency = {.run = emergency_run, .change = emergency_change};
-static state_t maintenance = {.run = emergency_run, .change = maintenance_change};
+/**Description of the elevator state machine
+ *
+ * The states are indexed by the elevator_states enum. The start
+ * state behaves as idle until an init state is added.
+ */
+struct elevator_fsm_t
+{
+    typedef uint16_t member_t;
+
+    static constexpr uint8_t STATE_CNT = ELEVATOR_STATE_CNT;
+    static constexpr uint8_t EVENT_CNT = ELEVATOR_EVENT_CNT;
+
+    static constexpr fsm_hooks_t<uint16_t> states[STATE_CNT] = {
+        {idle_entry, NULL, idle_tick},                       // IDLE
+        {idle_entry, NULL, idle_tick},                       // START
+        {moving_entry, NULL, moving_tick},                   // MOVING
+        {emergency_entry, emergency_exit, emergency_tick},  // EMERGENCY
+        {emergency_entry, NULL, maintenance_tick}            // MAINTENANCE
+    };
+
+    #define X FSM_NO_TRANSITION
+    static constexpr uint8_t transitions[STATE_CNT][EVENT_CNT] = {
+    //   LIMITS_EXCEEDED  LIMITS_RESTORED  MAINTENANCE_STARTED  MAINTENANCE_ENDED  FLOOR_ASSIGNED  FLOOR_REACHED
+        {EMERGENCY,       X,               MAINTENANCE,         X,                 MOVING,         X},     // IDLE
+        {EMERGENCY,       X,               MAINTENANCE,         X,                 MOVING,         X},     // START
+        {EMERGENCY,       X,               MAINTENANCE,         X,                 X,              IDLE},  // MOVING
+        {X,               IDLE,            X,                   X,                 X,              X},     // EMERGENCY
+        {X,               X,               X,                   IDLE,              X,              X}      // MAINTENANCE
+    };
+    #undef X
+};
+
+constexpr fsm_hooks_t<uint16_t> elevator_fsm_t::states[];
+constexpr uint8_t elevator_fsm_t::transitions[][ELEVATOR_EVENT_CNT];
+
 
-state_t * elevator_states[] = {&idle, &moving, &emergency, &maintenance};
+/* Elevator behavior global variables */
 
-// Elevator state functions
+static THREAD_LOCAL fsm_timed_group_t<elevator_fsm_t> elevator_behavior;  // State machines of the elevators
+
+
+// Elevator state functions (the car is only fetched for its limits, motion and maintenance flag)
 
 /* Emergency state functions */
 
-static void emergency_run(void * args)
+static void emergency_entry(uint16_t car_index)
 {
-    uint8_t car_index = *((uint8_t *) args);
-    elevator_t * car = get_elevator(car_index);
+    car_fields_t * cars = get_elevator_fields();
 
-    if (!car->attrs.action_started)
-    {
-        car->state.is_door_open = OPEN_DOOR;
-        car->state.is_light_on = LIGHTS_ON;
-        car->attrs.action_started = START_ACTION;
-
-        // Send updated states to manager
-        update_elevator_door_status(car_index, car);
-        update_elevator_light_status(car_index, car);
-        update_elevator_emergency_status(car_index, car);
-    }
+    cars->is_door_open[car_index] = OPEN_DOOR;
+    cars->is_light_on[car_index] = LIGHTS_ON;
+    elevator_behavior.disarm_timer(car_index);  // Only an attribute update can end the state
+
+    // Send updated states to manager
+    update_elevator_door_status(car_index);
+    update_elevator_light_status(car_index);
+    update_elevator_emergency_status(car_index);
 }
 
 
-static uint8_t emergency_change(void * args)
+static void emergency_exit(uint16_t car_index)
 {
-    uint8_t car_index = *((uint8_t *) args);
-    elevator_t * car = get_elevator(car_index);
+    update_elevator_emergency_status(car_index);
+}
 
-    if (elevator_within_limits(car))
-    {
-        car->attrs.action_started = END_ACTION;
-        update_elevator_emergency_status(car_index, car);
-        return IDLE;
-    }
-    return EMERGENCY;
+
+static uint8_t emergency_tick(uint16_t car_index)
+{
+    elevator_t * car = get_elevator(car_index);
+    return elevator_within_limits(car)? LIMITS_RESTORED: FSM_NO_EVENT;
 }
 
 
-/* Maintenance state functionS */
+/* Maintenance state functions */
 
-static uint8_t maintenance_change(void * args)
+static uint8_t maintenance_tick(uint16_t car_index)
 {
-    uint8_t car_index = *((uint8_t *) args);
     elevator_t * car = get_elevator(car_index);
-
-    if (!car->attrs.maintenance_needed)
-    {
-        car->attrs.action_started = END_ACTION;
-        return IDLE;
-    }
-    return MAINTENANCE;
+    return (!car->attrs.maintenance_needed)? MAINTENANCE_ENDED: FSM_NO_EVENT;
 }
 
 
 /* Moving state functions */
 
-static void moving_run(void * args)
+static void moving_entry(uint16_t car_index)
 {
-    uint8_t car_index = *((uint8_t *) args);
-    elevator_t * car = get_elevator(car_index);
+    car_fields_t * cars = get_elevator_fields();
+
+    cars->init_time[car_index] = get_elevator_time();
+    cars->run_floor[car_index] = cars->floor[car_index];
+    assign_elevator_direction(cars, car_index);
+    elevator_behavior.arm_timer(car_index, cars->init_time[car_index] + get_floor_pass_time(cars, car_index) + 1);
+    remove_elevator_from_floor(car_index, cars->floor[car_index]);
+}
 
-    if (!car->attrs.action_started)
-    {
-        car->attrs.action_started = START_ACTION;
-        car->attrs.init_time = millis();
-        assign_elevator_direction(car);
-    }
+
+static uint8_t moving_tick(uint16_t car_index)
+{
+    car_fields_t * cars = get_elevator_fields();
+    elevator_t * car = get_elevator(car_index);
 
     // Move from one floor to another
-    else if (millis() - car->attrs.init_time > ELEVATOR_MOVE_TIME)
+    if (get_elevator_time() - cars->init_time[car_index] > get_floor_pass_time(cars, car_index))
     {
         move_elevator(car, car_index);
-        if (car->attrs.next_floor == car->state.floor)
+        if (cars->next_floor[car_index] == cars->floor[car_index])
         {
-            car->attrs.next_floor = find_next_floor(car);
-            car->attrs.move = STOP;  
+            cars->next_floor[car_index] = find_next_floor(car, car_index);
+            cars->move[car_index] = STOP;
             exit_elevator(car, car_index);  // Get people out of the elevator
 
-            update_elevator_next_floor(car_index, car);
-            update_elevator_movement_state(car_index, car);
+            update_elevator_next_floor(car_index);
+            update_elevator_movement_state(car_index);
+        }
+        else
+        {
+            assign_elevator_direction(cars, car_index);
+            elevator_behavior.arm_timer(car_index, cars->init_time[car_index] + get_floor_pass_time(cars, car_index) + 1);
         }
-        car->attrs.action_started = END_ACTION;
     }
-}
-
-
-static uint8_t moving_change(void * args)
-{
-    uint8_t car_index = *((uint8_t *) args);
-    elevator_t * car = get_elevator(car_index);
 
     if (!elevator_within_limits(car))
     {
-        return EMERGENCY;
+        return LIMITS_EXCEEDED;
     }
 
     if (car->attrs.maintenance_needed)
     {
-        return MAINTENANCE;
+        return MAINTENANCE_STARTED;
     }
 
-    if (car->attrs.move == STOP)
+    if (cars->move[car_index] == STOP)
     {
-        alert_floor_arrival(car_index, car->state.floor);
-        return IDLE;
+        alert_floor_arrival(car_index, cars->floor[car_index]);
+        return FLOOR_REACHED;
     }
 
-    return MOVING;
+    return FSM_NO_EVENT;
 }
 
 
 /* Idle state functions */
 
-static void idle_run(void * args)
+static void idle_entry(uint16_t car_index)
 {
-    uint8_t car_index = *((uint8_t *) args);
-    elevator_t * car = get_elevator(car_index);
+    car_fields_t * cars = get_elevator_fields();
 
-    if (!car->attrs.action_started)
-    {
-        car->state.is_door_open = OPEN_DOOR;
-        car->state.is_light_on = LIGHTS_ON;
-        car->attrs.action_started = START_ACTION;
-        car->attrs.init_time = millis();
-
-        // Send updated states to manager
-        update_elevator_door_status(car_index, car);
-        update_elevator_light_status(car_index, car);
-    }
+    cars->is_door_open[car_index] = OPEN_DOOR;
+    cars->is_light_on[car_index] = LIGHTS_ON;
+    cars->init_time[car_index] = get_elevator_time();
+    arm_idle_timer(cars, car_index);
+
+    // Send updated states to manager
+    update_elevator_door_status(car_index);
+    update_elevator_light_status(car_index);
+}
+
+
+static uint8_t idle_tick(uint16_t car_index)
+{
+    car_fields_t * cars = get_elevator_fields();
+    elevator_t * car = get_elevator(car_index);
 
     // Verify timed events (closing door and turning lights off)
-    else if (car->state.is_door_open || car->state.is_light_on)
+    if (cars->is_door_open[car_index] || cars->is_light_on[car_index])
     {
-        bool event_timer_passed = (car->state.is_door_open)? millis() - car->attrs.init_time > CLOSE_DOOR_TIME: millis() - car->attrs.init_time > LIGHTS_OFF_TIME;
+        unsigned long elapsed = get_elevator_time() - cars->init_time[car_index];
+        bool event_timer_passed = (cars->is_door_open[car_index])? elapsed > car->attrs.motion.dwell: elapsed > LIGHTS_OFF_TIME;
     
         // Toggle states after enough time passed
         if (event_timer_passed)
         {
-            if (car->state.is_door_open)
+            if (cars->is_door_open[car_index])
             {
-                car->state.is_door_open = CLOSE_DOOR;
-                update_elevator_door_status(car_index, car);
+                cars->is_door_open[car_index] = CLOSE_DOOR;
+                update_elevator_door_status(car_index);
             }
             else
             {
-                car->state.is_light_on = LIGHTS_OFF;
-                update_elevator_light_status(car_index, car);
+                cars->is_light_on[car_index] = LIGHTS_OFF;
+                update_elevator_light_status(car_index);
             }
         } 
-    }        
-}
+    }
 
+    if (!elevator_within_limits(car))
+    {
+        return LIMITS_EXCEEDED;
+    }
 
-static uint8_t idle_change(void * args)
-{
-    uint8_t car_index = *(uint8_t *) args;
-    elevator_t * car = get_elevator(car_index);
+    if (car->attrs.maintenance_needed)
+    {
+        return MAINTENANCE_STARTED;
+    }
 
-    uint8_t next_state = IDLE;
-    if (!elevator_within_limits(car))
+    if (cars->next_floor[car_index] && !cars->is_door_open[car_index])
     {
-        next_state = EMERGENCY;
+        return FLOOR_ASSIGNED;
     }
-    else if (car->attrs.maintenance_needed)
+
+    arm_idle_timer(cars, car_index);
+    return FSM_NO_EVENT;
+}
+
+
+// Wait for the door to close or the lights to go off (whichever comes next)
+static void arm_idle_timer(car_fields_t * cars, uint16_t car_index)
+{
+    if (cars->is_door_open[car_index])
     {
-        next_state = MAINTENANCE;
+        elevator_behavior.arm_timer(car_index, cars->init_time[car_index] + get_elevator(car_index)->attrs.motion.dwell + 1);
     }
-    else if (car->attrs.next_floor && !car->state.is_door_open)
+    else if (cars->is_light_on[car_index])
     {
-        next_state = MOVING;
-        remove_elevator_from_floor(car_index, car->state.floor);
+        elevator_behavior.arm_timer(car_index, cars->init_time[car_index] + LIGHTS_OFF_TIME + 1);
     }
-    
-    // If the next state is not idle, then end the idle action
-    if (next_state)
+    else
     {
-        car->attrs.action_started = END_ACTION;
+        elevator_behavior.disarm_timer(car_index);
     }
-    
-    return next_state;
-}
\ No newline at end of file
+}
+
+
+/**Get the time the elevator passes the floor after its current one
+ * 
+ * The time is counted from the start of the run, which ends at the
+ * next floor, so the elevator speeds up and slows down along the run.
+ */
+static unsigned long get_floor_pass_time(car_fields_t * cars, uint16_t car_index)
+{
+    uint8_t run_floors = floor_distance(cars->run_floor[car_index], cars->next_floor[car_index]);
+    uint8_t floors = floor_distance(cars->run_floor[car_index], cars->floor[car_index]) + 1;
+
+    return get_motion_time(&get_elevator(car_index)->attrs.motion, run_floors, floors);
+}
+
+
+/* Elevator behavior functions */
+
+// Allocate the state machines of the elevators (they don't run until their state is set)
+bool init_elevator_behavior(uint16_t count)
+{
+    return elevator_behavior.init(count);
+}
+
+
+void deinit_elevator_behavior(void)
+{
+    elevator_behavior.deinit();
+}
+
+
+// Run the elevators that are awake or whose timers expired
+void run_elevator_behavior(void)
+{
+    elevator_behavior.run(get_elevator_time());
+}
+
+
+// Make an elevator run its state again (after something its state looks at changed)
+void wake_elevator_behavior(uint16_t car_index)
+{
+    elevator_behavior.wake(car_index);
+}
+
+
+// Place an elevator in a state (its entry actions run the next time the elevators are ran)
+void set_elevator_behavior_state(uint16_t car_index, uint8_t state)
+{
+    elevator_behavior.set_state(car_index, state);
+}
+
+
+// Get the id of the state an elevator is currently in
+uint8_t get_elevator_behavior_state(uint16_t index)
+{
+    return elevator_behavior.get_state(index);
+}
+
+
+/* Elevator timing functions */
+
+/**Get the time in which the elevators have to run next
+ * 
+ * The elevators that are waiting for a timed event (like the door
+ * closing or reaching the next floor) are only ran once the time
+ * comes, so the caller can sleep until then. If an elevator can make
+ * progress right away, then the current time is given out. If every
+ * elevator is waiting for an external event (like a request or an
+ * attribute update), then NO_ELEVATOR_DEADLINE is given out.
+ */
+unsigned long get_next_elevator_deadline(void)
+{
+    return elevator_behavior.get_next_deadline(get_elevator_time());
+}
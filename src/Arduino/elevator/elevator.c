@@ -6,50 +6,86 @@
 
 /* Private elevator constants */
 
-#define FLOOR_NAME_HEADER 2
+#define FLOOR_NAME_HEADER (DEVICE_ID_SIZE + 1)
 #define FLOOR_NAME_LIMIT 10
 
+// Attribute update packet offsets (the packets start with the tracker id and the car index)
+
+#define ATTR_ID_OFFSET        (1 + DEVICE_ID_SIZE)
+#define ATTR_TYPE_OFFSET      (ATTR_ID_OFFSET + 1)    // Only the updates for the computer carry the type
+#define ATTR_VALUE_OFFSET     (ATTR_TYPE_OFFSET + 1)  // Value offset in the updates for the computer
+#define MCU_ATTR_VALUE_OFFSET (ATTR_ID_OFFSET + 1)    // Value offset in the updates from the computer
+
 /* Elevator group global variables */
 
-static elevator_t * elevators;
+static THREAD_LOCAL elevator_t * elevators;
+static THREAD_LOCAL car_fields_t car_fields;  // Fields the states use on every step (indexed by the car index)
+static THREAD_LOCAL uint16_t elevator_count;
+static THREAD_LOCAL timer_schedule_cb elevator_timer;  // Clock used to time the elevator operations
 
 /* Elevator function prototypes*/
 
 static void create_elevators(void);
+static bool create_car_fields(uint16_t count);
+static void free_car_fields(void);
 static void update_elevator_attrs(uint8_t * pkt);
-static uint8_t find_requested_floors(elevator_t * car);
+static uint8_t find_requested_floors(elevator_t * car, uint8_t floor, uint8_t move);
+static uint8_t find_request_above(elevator_t * car, uint8_t floor);
+static uint8_t find_request_below(elevator_t * car, uint8_t floor);
+static uint8_t find_next_stop(elevator_t * car, uint8_t floor, uint8_t move, uint8_t target);
+static uint8_t find_closest_request(elevator_t * car, uint8_t floor);
+static void assign_next_floor(uint16_t car_index, uint8_t floor);
 static car_attrs_t init_misc_elevator_attrs(uint8_t floor_count, uint8_t capacity);
-static void pass_elevator_names(const char ** floor_names, uint8_t floor_count, uint8_t car_index);
-static void deinit_elevators(device_t * dev_elevators, uint8_t count);
-static void set_floor(uint8_t car_index, uint8_t * floor);
-static void set_weight(uint8_t car_index, uint8_t * weight);
-static void set_temperature(uint8_t car_index, uint8_t * temp);
-static void set_door_state(uint8_t car_index, uint8_t * state);
-static void set_light_state(uint8_t car_index, uint8_t * state);
-static void set_maintanence_state(uint8_t car_index, uint8_t * status);
+static void pass_elevator_names(const char ** floor_names, uint8_t floor_count, uint16_t car_index);
+static size_t pass_floor_number(char * buf, uint8_t floor);
+static void deinit_elevators(device_t * dev_elevators, uint16_t count);
+static void set_floor(uint16_t car_index, uint8_t * floor);
+static void set_weight(uint16_t car_index, uint8_t * weight);
+static void set_temperature(uint16_t car_index, uint8_t * temp);
+static void set_door_state(uint16_t car_index, uint8_t * state);
+static void set_light_state(uint16_t car_index, uint8_t * state);
+static void set_maintanence_state(uint16_t car_index, uint8_t * status);
 
 
 
 /* Public system elevator functions */
 
 // Initialize elevator subsystem
-void init_elevators(uint8_t count)
+void init_elevators(uint16_t count, timer_schedule_cb timer_cb)
+{
+    init_building_elevators(&count, 1, timer_cb);
+}
+
+/**Initialize an elevator subsystem that spans several buildings
+ * 
+ * The elevators of each building are given consecutive car indices,
+ * so the car indices of a building start after the ones of the
+ * previous building.
+ */
+void init_building_elevators(const uint16_t * car_counts, uint8_t building_count, timer_schedule_cb timer_cb)
 {
+    elevator_timer = timer_cb;
+
     const char * elevator_attrs[] = {"capacity", "current_floor", "door_state", "emergency_state", "floors", "maintanence_state", "movement", "next_floor", "light_state", "temperature", "weight"};
 
     // General elevator setup
-    register_device_tracker("elevator", ELEVATOR_TRACKER, count, deinit_elevators, update_elevator_attrs);
+    register_grouped_device_tracker("elevator", ELEVATOR_TRACKER, car_counts, building_count, deinit_elevators, update_elevator_attrs);
     add_device_attrs(ELEVATOR_TRACKER, elevator_attrs, 11);
     create_device_instances(ELEVATOR_TRACKER);
     create_elevators();
 
     // Register elevator tasks
-    register_device_task("enter_elevator", ENTER_ELEVATOR, 3, enter_elevator, NORMAL);
-    register_device_task("request_elevator", REQUEST_ELEVATOR, 2, request_elevator, NORMAL);
+    register_device_task("enter_elevator", ENTER_ELEVATOR, CAR_PAYLOAD_OFFSET + 2, enter_elevator, NORMAL);
+    register_device_task("request_elevator", REQUEST_ELEVATOR, CAR_PAYLOAD_OFFSET + 1, request_elevator, NORMAL);
+    register_device_task("request_floors", REQUEST_ELEVATOR_FLOORS, CAR_PAYLOAD_OFFSET + 1 + FLOOR_BATCH_SIZE, request_elevator_floors, NORMAL);
+    register_device_task("request_snapshot", REQUEST_ELEVATOR_SNAPSHOT, 0, pass_elevator_snapshot, NORMAL);
+
+    // The snapshot frames of different cars are told apart by their car index
+    set_task_coalescing(PASS_ELEVATOR_SNAPSHOT, DEVICE_ID_SIZE);
 }
 
 // Set up attributes for elevator object
-void set_elevator_attrs(uint8_t car_index, const char ** floor_names, uint8_t floor_count, uint8_t max_temp, uint8_t min_temp, uint8_t capacity, uint16_t weight)
+void set_elevator_attrs(uint16_t car_index, const char ** floor_names, uint8_t floor_count, uint8_t max_temp, uint8_t min_temp, uint8_t capacity, uint16_t weight)
 {
     elevator_t * car = get_elevator(car_index);
 
@@ -68,34 +104,38 @@ void set_elevator_attrs(uint8_t car_index, const char ** floor_names, uint8_t fl
         car_state_t car_state = 
         {
             .temp = ROOM_TEMPERATURE, 
-            .floor = NULL_FLOOR, 
-            .weight = ZERO_WEIGHT, 
-            .is_light_on = LIGHTS_ON,
-            .is_door_open =  CLOSE_DOOR
+            .weight = ZERO_WEIGHT
         };
 
         // Set up elevator object
         elevator_t car_copy = 
         {
-            .attrs = init_misc_elevator_attrs(floor_count, capacity),
             .state = car_state,
-            .behavior = create_fsm(ELEVATOR_STATE_CNT, elevator_states),
+            .attrs = init_misc_elevator_attrs(floor_count, capacity),
             .limits = car_limits
         };
 
-        car_copy.behavior.curr_state = elevator_states[START];  // Start with the idle state (Change to init later)
-
         memcpy(car, &car_copy, sizeof(elevator_t));
 
+        car_fields.floor[car_index] = NULL_FLOOR;
+        car_fields.move[car_index] = STOP;
+        car_fields.next_floor[car_index] = NULL_FLOOR;
+        car_fields.run_floor[car_index] = NULL_FLOOR;
+        car_fields.is_door_open[car_index] = CLOSE_DOOR;
+        car_fields.is_light_on[car_index] = LIGHTS_ON;
+        car_fields.init_time[car_index] = 0;
+
+        set_elevator_behavior_state(car_index, START);  // Start with the idle state (Change to init later)
+
         // Send initialized data to the computer
-        update_elevator_temp(car_index, car);
-        update_elevator_floor(car_index, car);
-        update_elevator_weight(car_index, car);
-        update_elevator_capacity(car_index, car);
-        update_elevator_next_floor(car_index, car);
-        update_elevator_light_status(car_index, car);
-        update_elevator_movement_state(car_index, car);
-        update_elevator_emergency_status(car_index, car);
+        update_elevator_temp(car_index);
+        update_elevator_floor(car_index);
+        update_elevator_weight(car_index);
+        update_elevator_capacity(car_index);
+        update_elevator_next_floor(car_index);
+        update_elevator_light_status(car_index);
+        update_elevator_movement_state(car_index);
+        update_elevator_emergency_status(car_index);
 
         pass_elevator_names(floor_names, floor_count, car_index);
     }
@@ -105,9 +145,8 @@ void set_elevator_attrs(uint8_t car_index, const char ** floor_names, uint8_t fl
 // Destructor for an elevator object
 void deinit_elevator(elevator_t * car)
 {
-    free(car->attrs.person_pool[0].item);  // Free up person item array address
-    free(car->attrs.person_pool);
-    free(car->attrs.pressed_floors);
+    free(car->attrs.floor_loads);
+    free(car->attrs.requested_floors);
 }
 
 
@@ -118,20 +157,38 @@ void deinit_elevator(elevator_t * car)
  * code to perform state-specific actions.
  */
 
-void alert_comp_elevator(uint8_t attr_id, uint8_t car_index, uint8_t floor)
+void alert_comp_elevator(uint8_t attr_id, uint16_t car_index, uint8_t floor)
+{
+    uint8_t pkt[DEVICE_ID_SIZE + 1];
+
+    pack_device_id(pkt, car_index);
+    pkt[DEVICE_ID_SIZE] = floor;
+
+    schedule_normal_task(attr_id, pkt, sizeof(pkt));
+}
+
+
+// Alert the computer that people left an elevator at a floor (one alert for all of them)
+void alert_comp_riders_removal(uint16_t car_index, uint8_t floor, uint8_t riders)
 {
-    schedule_normal_task(attr_id, ((uint8_t []){car_index, floor}), sizeof(uint8_t) * 2);
+    uint8_t pkt[DEVICE_ID_SIZE + 2];
+
+    pack_device_id(pkt, car_index);
+    pkt[DEVICE_ID_SIZE] = floor;
+    pkt[DEVICE_ID_SIZE + 1] = riders;
+
+    schedule_normal_task(ALERT_PERSON_REMOVAL, pkt, sizeof(pkt));
 }
 
 /**A person enters an elevator
  * 
  * In here, the information related to a specific person entering the
- * elevator is stored and the elevator's state is updated with this 
- * new information. 
+ * elevator is added to the totals of the floor the person goes to and
+ * the elevator's state is updated with this new information. 
  * 
  * This is done to keep track of the values that are changing in the
- * elevator, so when a person "exits" the elevator, the values related
- * to that person are also substracted.
+ * elevator, so when the people "exit" the elevator, the values related
+ * to them are also substracted.
  * 
  * The "attrs" argument is assumed to have the following information
  * in the order that is presented:
@@ -145,92 +202,166 @@ void alert_comp_elevator(uint8_t attr_id, uint8_t car_index, uint8_t floor)
  * and that this function will be called when the elevator reaches
  * said floor.
  */
-void enter_elevator(uint8_t car_index, uint8_t * attrs)
+void enter_elevator(uint16_t car_index, uint8_t * attrs)
 {
     elevator_t * car = get_elevator(car_index);
 
-    if (car->state.floor && car->state.floor <= car->limits.floor)
+    uint8_t car_floor = car_fields.floor[car_index];
+
+    if (car_floor && car_floor <= car->limits.floor)
     {
         uint8_t temp = attrs[0];
         uint8_t weight = attrs[1];
 
-        uint8_t floor = car->state.floor - 1;
+        uint8_t floor = car_floor - 1;
+        floor_load_t * load = &car->attrs.floor_loads[floor];
 
-        if (front_rider_is_not_empty(car, floor))  // If rider is not a placeholder to indicate this floor was requested
+        if (elevator_is_full(car))
         {
-            move_to_front(&car->attrs.pressed_floors[floor], &car->attrs.riders);  // Move rider to appropiate floor stack
+            return;
         }
 
-       person_t * rider = car->attrs.pressed_floors[floor]->item;
+        set_floor_request(car, car_floor);
 
-        // Update person information
-        rider->temp = temp;
-        rider->weight = weight;
+        // Add the person to the riders of the floor
+        load->riders++;
+        load->heat += temp;
+        load->weight += weight;
+        car->attrs.occupancy++;
 
         // Update elevator's state
         car->state.temp += temp;
         car->state.weight += weight;
 
         // Send new states to manager and alert user a person has been added
-        update_elevator_temp(car_index, car);
-        update_elevator_weight(car_index, car);
-        update_elevator_capacity(car_index, car);
+        update_elevator_temp(car_index);
+        update_elevator_weight(car_index);
+        update_elevator_capacity(car_index);
         alert_person_addition(car_index, floor);
+        wake_elevator_behavior(car_index);
     }
 }
 
 
 /**People exit the elevator
  * 
- * Given a floor for an elevator, its respective floor list will be
- * checked to see if any person has requested that floor (i.e., if
- * the floor list contains people/not empty.) The information stored
- * in these lists will be substracted from the current state of the
- * elevator.
+ * Given a floor for an elevator, the totals of the people going to
+ * that floor will be substracted from the current state of the
+ * elevator, and the computer is told how many people left.
 */
-void exit_elevator(elevator_t * car, uint8_t car_index)
+void exit_elevator(elevator_t * car, uint16_t car_index)
 {
-    uint8_t floor = car->state.floor - 1;
+    uint8_t floor = car_fields.floor[car_index];
+    floor_load_t * load = &car->attrs.floor_loads[floor - 1];
 
-    for (list_iterator(car->attrs.pressed_floors[floor], person_node))
+    if (load->riders)
     {
-        person_t * person = person_node->item;
-
         // Prevent arithmetic overflow of the elevator parameters
-        if (car->state.temp - person->temp > car->state.temp || car->state.weight - person->weight > car->state.weight)
+        if (load->heat > car->state.temp || load->weight > car->state.weight)
         {
             // Reset parameters to readjust internal state
             car->state.temp = 0;
             car->state.weight = 0;
-
-            break;
+        }
+        else
+        {
+            car->state.temp -= load->heat;
+            car->state.weight -= load->weight;
         }
 
-        // Update parameters in system
-        car->state.temp -= person->temp;
-        car->state.weight -= person->weight;
+        car->attrs.occupancy = (load->riders < car->attrs.occupancy)? car->attrs.occupancy - load->riders: 0;
+        alert_person_removal(car_index, floor, load->riders);
 
-        alert_person_removal(car_index, car->state.floor);
+        load->riders = 0;
+        load->heat = 0;
+        load->weight = 0;
     }
 
-    // Remove people from elevator at current floor
-    while(car->attrs.pressed_floors[floor] != NULL)
-    {
-        move_to_front(&car->attrs.riders, &car->attrs.pressed_floors[floor]);
-    }
+    clear_floor_request(car, floor);
 
     // Send updated states to manager
-    update_elevator_temp(car_index, car);
-    update_elevator_weight(car_index, car);
-    update_elevator_capacity(car_index, car);
+    update_elevator_temp(car_index);
+    update_elevator_weight(car_index);
+    update_elevator_capacity(car_index);
+}
+
+
+/**Pass the state of every elevator to the computer
+ * 
+ * Each car is packed in one frame with its state, a summary of its
+ * attributes and the state of its behavior, so the computer can
+ * rebuild all of them at once instead of waiting for every attribute
+ * update (e.g., after it restarts). All the cars are packed in the
+ * same call, so they are consistent with each other, and the last
+ * frame is flagged for the computer to apply the snapshot.
+*/
+void pass_elevator_snapshot(uint8_t * _)
+{
+    static THREAD_LOCAL uint8_t snapshot_num = 0;
+    uint8_t pkt[CAR_SNAPSHOT_SIZE];
+
+    snapshot_num++;
+
+    for (uint16_t car_index = 0; car_index < elevator_count; car_index++)
+    {
+        elevator_t * car = &elevators[car_index];
+
+        pack_device_id(&pkt[SNAPSHOT_CAR_OFFSET], car_index);
+        pkt[SNAPSHOT_NUM_OFFSET] = snapshot_num;
+        pkt[SNAPSHOT_FLAGS_OFFSET] = (car_index == elevator_count - 1)? SNAPSHOT_LAST_CAR: 0;
+        pkt[SNAPSHOT_BEHAVIOR_OFFSET] = get_elevator_behavior_state(car_index);
+
+        // Car state
+        pkt[SNAPSHOT_FLOOR_OFFSET] = car_fields.floor[car_index];
+        pkt[SNAPSHOT_TEMP_OFFSET] = car->state.temp;
+        memcpy(&pkt[SNAPSHOT_WEIGHT_OFFSET], &car->state.weight, sizeof(uint16_t));
+        pkt[SNAPSHOT_LIGHT_OFFSET] = car_fields.is_light_on[car_index];
+        pkt[SNAPSHOT_DOOR_OFFSET] = car_fields.is_door_open[car_index];
+
+        // Car attributes
+        pkt[SNAPSHOT_MOVE_OFFSET] = car_fields.move[car_index];
+        pkt[SNAPSHOT_NEXT_FLOOR_OFFSET] = car_fields.next_floor[car_index];
+        pkt[SNAPSHOT_MAINTENANCE_OFFSET] = car->attrs.maintenance_needed;
+        pkt[SNAPSHOT_OCCUPANCY_OFFSET] = car->attrs.occupancy;
+        pkt[SNAPSHOT_CAPACITY_OFFSET] = car->attrs.capacity;
+
+        schedule_fast_task(PASS_ELEVATOR_SNAPSHOT, EXTERNAL_TASK, pkt, sizeof(pkt));
+    }
 }
 
 
 // Fetch an elevator object from the elevator array
-elevator_t * get_elevator(uint8_t index)
+elevator_t * get_elevator(uint16_t index)
 {
-    device_tracker_t * tracker = get_tracker(ELEVATOR_TRACKER);
-    return (index < tracker->count)? get_device(tracker, index): NULL;
+    return (index < elevator_count)? &elevators[index]: NULL;
+}
+
+
+// Fetch the fields the elevator states use on every step
+car_fields_t * get_elevator_fields(void)
+{
+    return &car_fields;
+}
+
+
+// Get the current time of the elevator subsystem's clock
+unsigned long get_elevator_time(void)
+{
+    return elevator_timer();
+}
+
+
+// Get the amount of elevators in the subsystem
+uint16_t get_elevator_count(void)
+{
+    return elevator_count;
+}
+
+
+// Get the building an elevator belongs to
+uint8_t get_elevator_building(uint16_t index)
+{
+    return (index < elevator_count)? get_tracker(ELEVATOR_TRACKER)->devices[index].group_id: 0;
 }
 
 
@@ -239,39 +370,36 @@ elevator_t * get_elevator(uint8_t index)
  * This function will move the elevator based on the direction it's
  * currently moving.
 */
-void move_elevator(elevator_t * car, uint8_t car_index)
+void move_elevator(elevator_t * car, uint16_t car_index)
 {
-    uint8_t movement = car->attrs.move;
+    uint8_t movement = car_fields.move[car_index];
+    uint8_t * floor = &car_fields.floor[car_index];
 
-    if (movement == UP && car->state.floor < car->limits.floor)
+    if (movement == UP && *floor < car->limits.floor)
     {
-        car->state.floor++;
+        (*floor)++;
     }
-    else if (movement == DOWN && NULL_FLOOR < car->state.floor - 1)
+    else if (movement == DOWN && NULL_FLOOR < *floor - 1)
     {
-        car->state.floor--;
+        (*floor)--;
     }
 
-    update_elevator_floor(car_index, car);
+    update_elevator_floor(car_index);
 }
 
 
 // Find the next floor the elevator should go to
-uint8_t find_next_floor(elevator_t * car)
+uint8_t find_next_floor(elevator_t * car, uint16_t car_index)
 {
-    uint8_t floor  = find_requested_floors(car);  // Find a requested floor in the current direction
+    uint8_t car_floor = car_fields.floor[car_index];
+    uint8_t move = car_fields.move[car_index];
+    uint8_t floor  = find_requested_floors(car, car_floor, move);  // Find a requested floor in the current direction
 
     // Find a requested floor in the opposite direction if no floors were
     // found in the current direction.
     if (!floor)
     {
-        uint8_t move = car->attrs.move;
-
-        // This searches the opposite direction
-        car->attrs.move = (car->attrs.move == UP)? DOWN: UP;
-        floor = find_requested_floors(car);
-
-        car->attrs.move = move;  // Reset back to original direction
+        floor = find_requested_floors(car, car_floor, (move == UP)? DOWN: UP);
     }
 
     return floor;
@@ -281,42 +409,158 @@ uint8_t find_next_floor(elevator_t * car)
 /**Request the elevator to go a floor
  * 
  * This function assumes the elevator manager checked if the
- * elevator has not reached full capacity. A rider from the 
- * unassigned rider stack will be turned to a NULL rider and
- * placed into that floor it was requested to later find this
- * requested floor.
+ * elevator has not reached full capacity. The floor is marked in
+ * the requested floor bitset, so the elevator later finds it.
 */ 
-void request_elevator(uint8_t car_index, uint8_t * p_floor)
+void request_elevator(uint16_t car_index, uint8_t * p_floor)
 {
     elevator_t * car = get_elevator(car_index);
     schedule_fast_task(130, EXTERNAL_TASK, "requesting elevs", 16);
     if (*p_floor && *p_floor <= car->limits.floor)
     {
-        uint8_t floor = *p_floor - 1;
+        set_floor_request(car, *p_floor);
+
+        // If no floor is currently requested, then assign the requested
+        // floor as the next floor the elevator should go to
+        assign_next_floor(car_index, *p_floor);
+
+        wake_elevator_behavior(car_index);
+    }
+}
+
 
-        // Assign an empty rider if one hasn't been placed already on requested floor
-        if (car->attrs.pressed_floors[floor] == NULL)
+/**Request the elevator to go to many floors at once
+ * 
+ * The batch starts with the first floor it covers, followed by a
+ * bitmap of FLOOR_BATCH_SIZE bytes (bit i of byte j is the floor
+ * first + 8j + i). All the floors are requested with one task, so
+ * the computer only waits for one reply. An elevator with no floor
+ * to go to heads to the closest requested one.
+*/
+void request_elevator_floors(uint16_t car_index, uint8_t * batch)
+{
+    elevator_t * car = get_elevator(car_index);
+    uint8_t first_floor = batch[0];
+    bool is_requested = false;
+
+    for (uint8_t i = 0; i < FLOOR_BATCH_SIZE; i++)
+    {
+        // Go through the set bits of the byte only
+        for (uint8_t bits = batch[1 + i]; bits; bits &= bits - 1)
         {
-            schedule_fast_task(130, EXTERNAL_TASK, "placing empty rider", 19);
-            person_t * rider = car->attrs.riders->item;
+            uint16_t floor = first_floor + i * 8 + __builtin_ctz(bits);
+
+            if (floor && floor <= car->limits.floor)
+            {
+                set_floor_request(car, floor);
+                is_requested = true;
+            }
+        }
+    }
+
+    if (is_requested)
+    {
+        assign_next_floor(car_index, find_closest_request(car, car_fields.floor[car_index]));
+        wake_elevator_behavior(car_index);
+    }
+}
+
+
+// Give an elevator its own motion (a car that can't move is not taken)
+bool set_elevator_motion(uint16_t car_index, const car_motion_t * motion)
+{
+    elevator_t * car = get_elevator(car_index);
+
+    if (car == NULL || !motion->speed || !motion->accel)
+    {
+        return false;
+    }
+
+    car->attrs.motion = *motion;
+
+    return true;
+}
 
-            rider->weight = 0; 
 
-            move_to_front(&car->attrs.pressed_floors[floor], &car->attrs.riders);
+/**Estimate the time an elevator takes to reach a floor (ms)
+ * 
+ * The elevator ends its current run, and then it serves its requested
+ * floors in the order find_next_floor picks them: first the ones in its
+ * current direction and then the ones in the other direction, stopping
+ * at each one for its dwell time. A floor that wasn't requested is taken
+ * as a new request. Elevators that are in an emergency or in maintenance
+ * give out NO_ARRIVAL.
+*/
+unsigned long estimate_arrival_ms(uint16_t car_index, uint8_t floor)
+{
+    elevator_t * car = get_elevator(car_index);
+
+    if (car == NULL || floor == NULL_FLOOR || floor > car->limits.floor)
+    {
+        return NO_ARRIVAL;
+    }
+
+    uint8_t state = get_elevator_behavior_state(car_index);
+    if (state == EMERGENCY || state == MAINTENANCE)
+    {
+        return NO_ARRIVAL;
+    }
+
+    const car_motion_t * motion = &car->attrs.motion;
+    unsigned long elapsed = get_elevator_time() - car_fields.init_time[car_index];
+    uint8_t next_floor = car_fields.next_floor[car_index];
+    unsigned long eta;
+    uint8_t position;
+    uint8_t move;
+
+    if (state == MOVING)  // Wait for the current run to end
+    {
+        unsigned long run_time = get_travel_time(motion, floor_distance(car_fields.run_floor[car_index], next_floor));
+
+        eta = (run_time > elapsed)? run_time - elapsed: 0;
+        if (floor == next_floor)
+        {
+            return eta;
         }
 
-        // If no floor is currently requested, then assign the requested
-        // floor as the next floor the elevator should go to
-        if (!car->attrs.next_floor)
+        eta += motion->dwell;
+        position = next_floor;
+        move = car_fields.move[car_index];
+    }
+    else  // Wait for the doors to close
+    {
+        eta = (car_fields.is_door_open[car_index] && motion->dwell > elapsed)? motion->dwell - elapsed: 0;
+        if (floor == car_fields.floor[car_index])
         {
-            car->attrs.next_floor = *p_floor;
-            car->attrs.move = (car->state.floor > car->attrs.next_floor)? DOWN: UP;
-            
-            schedule_fast_task(130, EXTERNAL_TASK, "assigned next floor", 19);
-            update_elevator_next_floor(car_index, car);
-            update_elevator_movement_state(car_index, car);
+            return 0;
+        }
+
+        position = car_fields.floor[car_index];
+        move = (next_floor && next_floor != position)? next_floor: floor;
+        move = (move > position)? UP: DOWN;
+    }
+
+    uint8_t origin = position;
+
+    // Serve the requests in the direction the elevator is going and then the ones behind it
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        for (uint8_t stop = find_next_stop(car, origin, move, floor); stop; stop = find_next_stop(car, stop, move, floor))
+        {
+            eta += get_travel_time(motion, floor_distance(position, stop));
+            if (stop == floor)
+            {
+                return eta;
+            }
+
+            eta += motion->dwell;
+            position = stop;
         }
+
+        move = (move == UP)? DOWN: UP;
     }
+
+    return NO_ARRIVAL;
 }
 
 
@@ -325,79 +569,76 @@ void run_elevators(void)
 {
     if (is_comp_device_setup_complete(ELEVATOR_TRACKER))
     {
-        device_tracker_t * tracker = get_tracker(ELEVATOR_TRACKER);
-
-        for (uint8_t i = 0; i < tracker->count; i++)
-        {
-            run_fsm(&elevators[i].behavior, &i);
-        }
+        run_elevator_behavior();
     }
 }
 
 // Update elevator attribute in comp
-void update_comp_elevator_attr(uint8_t car_index, elevator_t * car, uint8_t attr_id)
+void update_comp_elevator_attr(uint16_t car_index, uint8_t attr_id)
 {
-    uint8_t pkt[6];
+    elevator_t * car = get_elevator(car_index);
+    uint8_t pkt[ATTR_VALUE_OFFSET + sizeof(uint16_t)];
     uint8_t pkt_size;
 
     // Add default packet values
     pkt[0] = ELEVATOR_TRACKER;
-    pkt[1] = car_index;
-    pkt[2] = attr_id;
+    pack_device_id(pkt + 1, car_index);
+    pkt[ATTR_ID_OFFSET] = attr_id;
 
     // Add the rest of the packet values
     if (attr_id == WEIGHT)  // For updating the weight attribute
     {
-        pkt_size = 6;
-        pkt[3] = ATTR_UINT16_T;
-        memcpy(pkt + 4, &car->state.weight, sizeof(uint16_t));
+        pkt_size = ATTR_VALUE_OFFSET + sizeof(uint16_t);
+        pkt[ATTR_TYPE_OFFSET] = ATTR_UINT16_T;
+        memcpy(pkt + ATTR_VALUE_OFFSET, &car->state.weight, sizeof(uint16_t));
     }
     else  // For updating everything else
     {
-        pkt_size = 5;
-        pkt[3] = ATTR_UINT8_T;
+        pkt_size = ATTR_VALUE_OFFSET + 1;
+        pkt[ATTR_TYPE_OFFSET] = ATTR_UINT8_T;
 
         switch (attr_id)
         {
             case CAPACITY:
-                pkt[4] = car->attrs.riders != NULL;
+                pkt[ATTR_VALUE_OFFSET] = car->attrs.occupancy;
                 break;  
 
             case TEMPERATURE:
-                pkt[4] = car->state.temp;
+                pkt[ATTR_VALUE_OFFSET] = car->state.temp;
                 break;  
             
             case CURRENT_FLOOR:
-                pkt[4] = car->state.floor;
+                pkt[ATTR_VALUE_OFFSET] = car_fields.floor[car_index];
                 break;  
             
             case DOOR_STATE:
-                pkt[4] = car->state.is_door_open;
+                pkt[ATTR_VALUE_OFFSET] = car_fields.is_door_open[car_index];
                 break;  
             
             case LIGHT_STATE:
-                pkt[4] = car->state.is_light_on;
+                pkt[ATTR_VALUE_OFFSET] = car_fields.is_light_on[car_index];
                 break; 
 
             case MAINTENANCE_STATE:
-                pkt[4] = car->attrs.maintenance_needed;
+                pkt[ATTR_VALUE_OFFSET] = car->attrs.maintenance_needed;
                 break;   
 
             case MOVEMENT:
-                pkt[4] = car->attrs.move;
+                pkt[ATTR_VALUE_OFFSET] = car_fields.move[car_index];
                 break;  
             
             case EMERGENCY_STATE:
-                pkt[4] = car->behavior.curr_state == car->behavior.states[EMERGENCY];
+                pkt[ATTR_VALUE_OFFSET] = get_elevator_behavior_state(car_index) == EMERGENCY;
                 break;  
             
             case NEXT_FLOOR:
-                pkt[4] = car->attrs.next_floor;
+                pkt[ATTR_VALUE_OFFSET] = car_fields.next_floor[car_index];
                 break;
         }
     }
     
-    schedule_fast_task(UPDATE_DEVICE_ATTR_COMP, EXTERNAL_TASK, pkt, pkt_size);
+    // Queued until the next send, so a newer value of the attribute replaces this one
+    schedule_priority_task(UPDATE_DEVICE_ATTR_COMP, pkt, pkt_size);
 
 //     if (is_comp_device_setup_complete(ELEVATOR_TRACKER))
 //     {
@@ -418,65 +659,105 @@ static void create_elevators(void)
     device_tracker_t * tracker = get_tracker(ELEVATOR_TRACKER);
     elevators = malloc(sizeof(elevator_t) * tracker->count);
 
+    if (elevators != NULL && !create_car_fields(tracker->count))
+    {
+        free(elevators);
+        elevators = NULL;
+    }
+
+    if (elevators != NULL && !init_elevator_behavior(tracker->count))
+    {
+        free_car_fields();
+        free(elevators);
+        elevators = NULL;
+    }
+
     if (elevators != NULL)
     {
         device_t * dev_elevators = tracker->devices;
-        for (uint8_t i = 0; i < tracker->count; i++)
+        for (uint16_t i = 0; i < tracker->count; i++)
         {
             dev_elevators[i].device = &elevators[i];
         }
+
+        elevator_count = tracker->count;
     }
 }
 
+// Allocate the field arrays of the elevators
+static bool create_car_fields(uint16_t count)
+{
+    car_fields.floor = malloc(sizeof(uint8_t) * count);
+    car_fields.move = malloc(sizeof(uint8_t) * count);
+    car_fields.next_floor = malloc(sizeof(uint8_t) * count);
+    car_fields.run_floor = malloc(sizeof(uint8_t) * count);
+    car_fields.is_door_open = malloc(sizeof(uint8_t) * count);
+    car_fields.is_light_on = malloc(sizeof(uint8_t) * count);
+    car_fields.init_time = malloc(sizeof(unsigned long) * count);
+
+    if (car_fields.floor == NULL || car_fields.move == NULL || car_fields.next_floor == NULL || car_fields.run_floor == NULL ||
+        car_fields.is_door_open == NULL || car_fields.is_light_on == NULL || car_fields.init_time == NULL)
+    {
+        free_car_fields();
+        return false;
+    }
+
+    return true;
+}
+
+
+// Free the field arrays of the elevators
+static void free_car_fields(void)
+{
+    free(car_fields.floor);
+    free(car_fields.move);
+    free(car_fields.next_floor);
+    free(car_fields.run_floor);
+    free(car_fields.is_door_open);
+    free(car_fields.is_light_on);
+    free(car_fields.init_time);
+
+    memset(&car_fields, 0, sizeof(car_fields_t));
+}
+
+
 // Initialize miscellaneous attributes for the elevator object
 static car_attrs_t init_misc_elevator_attrs(uint8_t floor_count, uint8_t capacity)
 {
     car_attrs_t car_attrs = 
     {
-        .move = STOP,
-        .init_time = 0,
-        .pressed_floors = NULL,
-        .next_floor = NULL_FLOOR,
-        .action_started = false,
+        .capacity = capacity,
+        .occupancy = 0,
+        .floor_loads = NULL,
+        .requested_floors = NULL,
         .maintenance_needed = false,
+        .motion = DEFAULT_CAR_MOTION
     };
 
-    // Create list nodes to store passendgers for rider floor placement
-    car_attrs.person_pool = malloc(sizeof(list_node_t) * capacity);
-    car_attrs.riders = car_attrs.person_pool;
+    // Create the rider totals for each floor
+    car_attrs.floor_loads = malloc(sizeof(floor_load_t) * floor_count);
 
-    if (car_attrs.person_pool == NULL)
+    if (car_attrs.floor_loads == NULL)
     {
         goto handle_null_elevator;
     }
 
-    // Create passenger stacks for each floor
-    car_attrs.pressed_floors = malloc(sizeof(list_node_t *) * floor_count);
-
-    if (car_attrs.pressed_floors == NULL)
-    {
-        goto handle_null_elevator;
-    }
-
-    // Set up floor stacks
     for (uint8_t i = 0; i < floor_count; i++)
     {
-        car_attrs.pressed_floors[i] = NULL;
+        car_attrs.floor_loads[i] = (floor_load_t) {.riders = 0, .heat = 0, .weight = 0};
     }
 
-    // Create person pool items to store info in
-    person_t * person_array = malloc(sizeof(person_t) * capacity); 
+    // Create the requested floor bitset
+    car_attrs.requested_floors = malloc(sizeof(floor_word_t) * floor_word_count(floor_count));
 
-    if (car_attrs.person_pool[0].item == NULL)
+    if (car_attrs.requested_floors == NULL)
     {
         goto handle_null_elevator;
     }
 
-    // Set up person pool stack
-    for (uint8_t i = 0; i < floor_count; i++)
+    for (uint8_t i = 0; i < floor_word_count(floor_count); i++)
     {
-        car_attrs.person_pool[i].item = &person_array[i];
-        car_attrs.person_pool[i].next = (i < floor_count - 1)? &car_attrs.person_pool[i + 1]: NULL;
+        car_attrs.requested_floors[i] = 0;
     }
 
     return car_attrs;
@@ -484,57 +765,151 @@ static car_attrs_t init_misc_elevator_attrs(uint8_t floor_count, uint8_t capacit
 
 handle_null_elevator:
     
-    free(car_attrs.person_pool);
-    free(car_attrs.pressed_floors);
+    free(car_attrs.floor_loads);
+    free(car_attrs.requested_floors);
+
+    car_attrs.floor_loads = NULL;
+    car_attrs.requested_floors = NULL;
 
     return car_attrs;
 }
 
 
 // Finds a requested floor in the current direction
-static uint8_t find_requested_floors(elevator_t * car)
+static uint8_t find_requested_floors(elevator_t * car, uint8_t floor, uint8_t move)
 {
-    switch (car->attrs.move)
+    switch (move)
     {
         case UP:  // Verify the upper floors for any requests
-    
-            for (uint8_t floor = car->state.floor; floor <= car->limits.floor; floor++)
-            {
-                if (car->attrs.pressed_floors[floor - 1] != NULL)
-                {
-                    return floor;
-                }
-            }
-
-            break;
+            return find_request_above(car, floor);
 
         case DOWN:  // Verify the lower floors for any requests
+            return find_request_below(car, floor);
+    }
 
-            for (uint8_t floor = car->state.floor; NULL_FLOOR < floor; floor--)
-            {
-                if (car->attrs.pressed_floors[floor - 1] != NULL)
-                {
-                    return floor;
-                }
-            }
+    return NULL_FLOOR;  // Otherwise, no requests were found for the current direction
+}
 
-            break;
+
+// Find the closest stop past a floor in a direction (the target floor is also taken as a stop)
+static uint8_t find_next_stop(elevator_t * car, uint8_t floor, uint8_t move, uint8_t target)
+{
+    uint8_t stop;
+
+    if (move == UP)
+    {
+        stop = (floor < car->limits.floor)? find_request_above(car, floor + 1): NULL_FLOOR;
+        return (target > floor && (!stop || target < stop))? target: stop;
     }
 
-    return NULL_FLOOR;  // Otherwise, no requests were found for the current direction
+    stop = (floor > 1)? find_request_below(car, floor - 1): NULL_FLOOR;
+    return (target < floor && target > stop)? target: stop;
+}
+
+
+// Find the requested floor closest to the elevator (the one above wins a tie)
+static uint8_t find_closest_request(elevator_t * car, uint8_t floor)
+{
+    uint8_t above = find_request_above(car, floor);
+    uint8_t below = find_request_below(car, floor);
+
+    if (!below || (above && above - floor <= floor - below))
+    {
+        return above;
+    }
+    return below;
+}
+
+
+// Make the elevator go to a floor if it has no floor to go to yet
+static void assign_next_floor(uint16_t car_index, uint8_t floor)
+{
+    if (!car_fields.next_floor[car_index] && floor)
+    {
+        car_fields.next_floor[car_index] = floor;
+        car_fields.move[car_index] = (car_fields.floor[car_index] > floor)? DOWN: UP;
+
+        schedule_fast_task(130, EXTERNAL_TASK, "assigned next floor", 19);
+        update_elevator_next_floor(car_index);
+        update_elevator_movement_state(car_index);
+    }
+}
+
+
+/**Find the closest requested floor at or above a floor
+ * 
+ * The requested floor bitset is scanned a word at a time, so the
+ * lowest set bit in a word gives out the closest requested floor.
+ */
+static uint8_t find_request_above(elevator_t * car, uint8_t floor)
+{
+    uint8_t first_floor = (floor > NULL_FLOOR)? floor: 1;
+    uint8_t word_index = floor_word_index(first_floor);
+
+    // Ignore the floors below the starting floor in its word
+    floor_word_t word = car->attrs.requested_floors[word_index] & ~(floor_word_bit(first_floor) - 1);
+
+    while (true)
+    {
+        if (word)
+        {
+            return word_index * FLOOR_WORD_BITS + __builtin_ctzl(word) + 1;
+        }
+
+        if (++word_index >= floor_word_count(car->limits.floor))
+        {
+            return NULL_FLOOR;
+        }
+
+        word = car->attrs.requested_floors[word_index];
+    }
+}
+
+
+/**Find the closest requested floor at or below a floor
+ * 
+ * Same as the upward search, but the highest set bit in a word gives
+ * out the closest requested floor.
+ */
+static uint8_t find_request_below(elevator_t * car, uint8_t floor)
+{
+    if (floor == NULL_FLOOR)
+    {
+        return NULL_FLOOR;
+    }
+
+    uint8_t word_index = floor_word_index(floor);
+
+    // Ignore the floors above the starting floor in its word
+    floor_word_t word = car->attrs.requested_floors[word_index] & ((floor_word_bit(floor) << 1) - 1);
+
+    while (true)
+    {
+        if (word)
+        {
+            return word_index * FLOOR_WORD_BITS + (FLOOR_WORD_BITS - 1 - __builtin_clzl(word)) + 1;
+        }
+
+        if (word_index-- == 0)
+        {
+            return NULL_FLOOR;
+        }
+
+        word = car->attrs.requested_floors[word_index];
+    }
 }
 
 
 // Pass the floor names to the computer
-static void pass_elevator_names(const char ** floor_names, uint8_t floor_count, uint8_t car_index)
+static void pass_elevator_names(const char ** floor_names, uint8_t floor_count, uint16_t car_index)
 {
     size_t name_len;
     char name_pkt[FLOOR_NAME_LIMIT + FLOOR_NAME_HEADER];
 
-    name_pkt[0] = car_index;  // Add the car index to the packet
+    pack_device_id((uint8_t *) name_pkt, car_index);  // Add the car index to the packet
     for (uint8_t i = 0; i < floor_count; i++)
     {
-        name_pkt[1] = i + 1;  // Add floor number to packet
+        name_pkt[DEVICE_ID_SIZE] = i + 1;  // Add floor number to packet
 
         // Pass floor name to the packet
         name_len = strlen(floor_names[i]);
@@ -544,7 +919,7 @@ static void pass_elevator_names(const char ** floor_names, uint8_t floor_count,
         }
         else
         {
-            name_len = strlen(itoa(i, &name_pkt[FLOOR_NAME_HEADER], 10));  // Uses the floor number as the floor name
+            name_len = pass_floor_number(&name_pkt[FLOOR_NAME_HEADER], i);  // Uses the floor number as the floor name
         }
 
         schedule_fast_task(PASS_ELEVATOR_FLOOR_NAME, EXTERNAL_TASK, (uint8_t *) name_pkt, FLOOR_NAME_HEADER + name_len);
@@ -552,113 +927,134 @@ static void pass_elevator_names(const char ** floor_names, uint8_t floor_count,
 }
 
 
+// Write the decimal digits of a floor number in a buffer
+static size_t pass_floor_number(char * buf, uint8_t floor)
+{
+    size_t digit_count = (floor >= 100)? 3: (floor >= 10)? 2: 1;
+
+    for (size_t i = digit_count; i > 0; i--)
+    {
+        buf[i - 1] = '0' + floor % 10;
+        floor /= 10;
+    }
+
+    return digit_count;
+}
+
+
 // Set elevator attributes
 static void update_elevator_attrs(uint8_t * pkt)
 {
-    // Get corresponding elevator
-    uint8_t car_index = pkt[0];
-    uint8_t attr_id = pkt[1];
+    // Get corresponding elevator (the packet starts with the tracker id)
+    uint16_t car_index = unpack_device_id(pkt + 1);
+    uint8_t attr_id = pkt[ATTR_ID_OFFSET];
+
+    if (car_index >= elevator_count)
+    {
+        return;
+    }
 
     // Set correnposding attribute for given elevator
     switch (attr_id)
     {
         case LIGHT_STATE:
-            set_light_state(car_index, &pkt[3]);
+            set_light_state(car_index, &pkt[MCU_ATTR_VALUE_OFFSET]);
             break;
         
         case DOOR_STATE:
-            set_door_state(car_index, &pkt[3]);
+            set_door_state(car_index, &pkt[MCU_ATTR_VALUE_OFFSET]);
             break;
         
         case CURRENT_FLOOR:
-            set_floor(car_index, &pkt[3]);
+            set_floor(car_index, &pkt[MCU_ATTR_VALUE_OFFSET]);
             break;
         
         case TEMPERATURE:
-            set_temperature(car_index, &pkt[3]);
+            set_temperature(car_index, &pkt[MCU_ATTR_VALUE_OFFSET]);
             break;
 
         case WEIGHT:
-            set_weight(car_index, &pkt[3]);
+            set_weight(car_index, &pkt[MCU_ATTR_VALUE_OFFSET]);
             break;
         
         case MAINTENANCE_STATE:
-            set_maintanence_state(car_index, &pkt[3]);
+            set_maintanence_state(car_index, &pkt[MCU_ATTR_VALUE_OFFSET]);
             break;
     }
+
+    wake_elevator_behavior(car_index);  // Let the elevator's state see the new value
 }
 
 
 // Uninitialize objects related to the elevator subsystem
-static void deinit_elevators(device_t * _, uint8_t count)
+static void deinit_elevators(device_t * _, uint16_t count)
 {
-    for (uint8_t i = 0; i < count; i++)
+    for (uint16_t i = 0; i < count; i++)
     {
         deinit_elevator(&elevators[i]);
     }
 
+    deinit_elevator_behavior();
+    free_car_fields();
     free(elevators);
+    elevator_count = 0;
 }
 
 
 // Set the light on the elevator to a specific state
-static void set_light_state(uint8_t car_index, uint8_t * state)
+static void set_light_state(uint16_t car_index, uint8_t * state)
 {
-    elevator_t * car = get_elevator(car_index);
-
-    car->state.is_light_on = (*state > 0);
-    update_elevator_light_status(car_index, car);
+    car_fields.is_light_on[car_index] = (*state > 0);
+    update_elevator_light_status(car_index);
 }
 
 
 // Set the door of the elevator to a specific state
-static void set_door_state(uint8_t car_index, uint8_t * state)
+static void set_door_state(uint16_t car_index, uint8_t * state)
 {
-    elevator_t * car = get_elevator(car_index);
-
-    car->state.is_door_open = (*state > 0);
-    update_elevator_door_status(car_index, car);
+    car_fields.is_door_open[car_index] = (*state > 0);
+    update_elevator_door_status(car_index);
 }
 
 
 // Set the elevator to a specfic floor
-static void set_floor(uint8_t car_index, uint8_t * floor)
+static void set_floor(uint16_t car_index, uint8_t * floor)
 {
     elevator_t * car = get_elevator(car_index);
 
     if (*floor && *floor <= car->limits.floor)
     {
-        car->state.floor = *floor;
-        update_elevator_floor(car_index, car);
+        car_fields.floor[car_index] = *floor;
+        update_elevator_floor(car_index);
     }
 }
 
 
 // Set the elevator's car to a specific temperature
-static void set_temperature(uint8_t car_index, uint8_t * temp)
+static void set_temperature(uint16_t car_index, uint8_t * temp)
 {
     elevator_t * car = get_elevator(car_index);
 
     car->state.temp = *temp;
-    update_elevator_temp(car_index, car);
+    update_elevator_temp(car_index);
 }
 
 
 // Set the load in the elevator to a specific weight
-static void set_weight(uint8_t car_index, uint8_t * weight)
+static void set_weight(uint16_t car_index, uint8_t * weight)
 {
     elevator_t * car = get_elevator(car_index);
 
     memcpy(&car->state.weight, weight, sizeof(uint16_t));
-    update_elevator_weight(car_index, car);
+    update_elevator_weight(car_index);
 }
 
 
 // Set the elevator's car to a specific temperature
-static void set_maintanence_state(uint8_t car_index, uint8_t * status)
+static void set_maintanence_state(uint16_t car_index, uint8_t * status)
 {
     elevator_t * car = get_elevator(car_index);
 
     car->attrs.maintenance_needed = *status;
-    update_elevator_maintenance_status(car_index, car);
+    update_elevator_maintenance_status(car_index);
 }
\ No newline at end of file
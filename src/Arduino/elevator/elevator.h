@@ -7,11 +7,11 @@
 #include <stdbool.h>
 #endif
 
-#include <fsm.h>
-#include <list.h>
 #include <devices.h>
 #include <scheduler.h>
 
+#include "motion.h"
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,8 +39,42 @@ extern "C" {
 
 // Offsets for payload processing in serial callback
 
-#define CAR_INDEX_OFFSET 0    // Offset for the index of the car
-#define CAR_PAYLOAD_OFFSET 1  // Offset for the payload data
+#define CAR_INDEX_OFFSET 0                // Offset for the index of the car (a 16 bit device id)
+#define CAR_PAYLOAD_OFFSET DEVICE_ID_SIZE  // Offset for the payload data
+
+// Batched floor requests (a batch covers FLOOR_BATCH_SIZE * 8 floors from its first floor)
+
+#define FLOOR_BATCH_SIZE 8  // Bytes of the floor bitmap of a batched request
+#define FLOOR_BATCH_FLOORS (FLOOR_BATCH_SIZE * 8)
+
+// Flags of a car snapshot
+
+#define SNAPSHOT_LAST_CAR 0x01  // The car is the last one of its snapshot
+
+/**Layout of a car snapshot
+ * 
+ * A snapshot has a frame for each car with its state, its attributes
+ * and the state of its behavior. The frames of a snapshot share its
+ * number, so the computer can tell them apart from an older one.
+*/
+enum car_snapshot_offsets
+{
+    SNAPSHOT_CAR_OFFSET = 0,               // Index of the car (a 16 bit device id)
+    SNAPSHOT_NUM_OFFSET = DEVICE_ID_SIZE,  // Number of the snapshot
+    SNAPSHOT_FLAGS_OFFSET,
+    SNAPSHOT_BEHAVIOR_OFFSET,
+    SNAPSHOT_FLOOR_OFFSET,
+    SNAPSHOT_TEMP_OFFSET,
+    SNAPSHOT_WEIGHT_OFFSET,                // 16 bits
+    SNAPSHOT_LIGHT_OFFSET = SNAPSHOT_WEIGHT_OFFSET + sizeof(uint16_t),
+    SNAPSHOT_DOOR_OFFSET,
+    SNAPSHOT_MOVE_OFFSET,
+    SNAPSHOT_NEXT_FLOOR_OFFSET,
+    SNAPSHOT_MAINTENANCE_OFFSET,
+    SNAPSHOT_OCCUPANCY_OFFSET,
+    SNAPSHOT_CAPACITY_OFFSET,
+    CAR_SNAPSHOT_SIZE
+};
 
 // Elevator attributes that can be updated in the manager
 enum elevator_attrs
@@ -84,7 +118,13 @@ enum elevator_task_ids
     // Elevator management tasks
 
     ENTER_ELEVATOR,
-    REQUEST_ELEVATOR
+    REQUEST_ELEVATOR,
+    REQUEST_ELEVATOR_FLOORS,
+
+    // Resync tasks (the computer requests a snapshot and the Arduino passes it)
+
+    REQUEST_ELEVATOR_SNAPSHOT,
+    PASS_ELEVATOR_SNAPSHOT
 };
 
 
@@ -135,13 +175,6 @@ enum init_state
 };
 
 
-enum action_state
-{
-    END_ACTION,
-    START_ACTION
-};
-
-
 enum elevator_states
 {
     IDLE,
@@ -153,30 +186,31 @@ enum elevator_states
 
 /* Elevator user-defined types */
 
-/**Person object
+// Word used to store the requested floor bits (the native word keeps the bit scans to one instruction)
+typedef unsigned long floor_word_t;
+
+/**Riders going to a floor
  * 
- * This object holds a information about a person that enters the
- * elevator. It is used to keep track of the changes in the state
- * of the elevator car itself. When a person enters or leaves the
- * elevator car, this will be referenced to change the weight and
+ * The people that enter the elevator are only kept as totals of the
+ * floor they go to, so a person entering or the people leaving at a
+ * floor change the state of the elevator in constant time. When the
+ * riders leave, their totals are taken out of the weight and the
  * temperature of the elevator.
 */
 typedef struct
 {
-    uint8_t temp;     // Temperature change the person added
-    uint8_t weight;   // Weight of the person
+    uint8_t riders;   // Amount of people going to the floor
+    uint16_t heat;    // Temperature change the people added
+    uint16_t weight;  // Weight of the people
 
-} person_t;
+} floor_load_t;
 
 
-// Current state of the elevator
+// Current load of the elevator
 typedef struct
 {
-    uint8_t temp;          // Current temperature
-    uint8_t floor;         // Current floor
-    uint16_t weight;       // Current weight
-    uint8_t is_light_on;   // Current light state
-    uint8_t is_door_open;  // Current door state
+    uint8_t temp;     // Current temperature
+    uint16_t weight;  // Current weight
 
 } car_state_t;
 
@@ -196,118 +230,158 @@ typedef struct
 typedef struct
 {
     // State tracking attributes
-    uint8_t move;             // States current movement
-    uint8_t next_floor;       // Next floor the elevator must go to
-    bool action_started;      // Indicate whether or not an action has started
     bool maintenance_needed;  // Elevator needs maintenance
-    unsigned long init_time;  // Initial time marker for an elevator operation
+    car_motion_t motion;      // Speed, acceleration and dwell of the car
 
 
     // Floor management attributes
-    list_node_t * riders;           // Stack for unasigned riders
-    list_node_t * person_pool;      // Memory pool for riders
-    list_node_t ** pressed_floors;  // Stacks to store riders
+    uint8_t capacity;                 // Max amount of people in the elevator
+    uint8_t occupancy;                // Amount of people in the elevator
+    floor_load_t * floor_loads;       // Riders going to each floor (index 0 is floor 1)
+    floor_word_t * requested_floors;  // Bitset with the floors that have riders or requests (bit 0 is floor 1)
 
 } car_attrs_t;
 
 
 /**Elevator object
  * 
- * This is an elevator object. It contains the behavior, quantitative
- * and qualitative descriptions, and the limits the elevator can reach.
+ * This is an elevator object. It contains the quantitative and
+ * qualitative descriptions, and the limits the elevator can reach.
+ * The fields the states change on every step are kept apart in the
+ * car fields, and the state id and the timer deadline of every car
+ * are kept in the state machine group of the elevators.
 */
 typedef struct
 {
-    fsm_t behavior;       // Behavior of the elevator
     car_state_t state;    // Quantitative information of the elevator
     car_attrs_t attrs;    // Additional attributes of the elevator
     const car_limits_t limits;  // Limits of the elevator
 
 } elevator_t;
 
-// Shorthand type for a task in the elevator system
-typedef void (*elevator_task_t)(uint8_t, uint8_t *);
 
-/* Elevator variables */
+/**Fields the elevator states use on every step
+ * 
+ * Each field is an array indexed by the car index, so stepping many
+ * cars only goes through the arrays of the fields the current states
+ * look at, instead of through whole elevator objects.
+*/
+typedef struct
+{
+    uint8_t * floor;            // Current floor
+    uint8_t * move;             // Current movement
+    uint8_t * next_floor;       // Next floor the elevator must go to
+    uint8_t * run_floor;        // Floor the current run started from
+    uint8_t * is_door_open;     // Current door state
+    uint8_t * is_light_on;      // Current light state
+    unsigned long * init_time;  // Initial time marker for an elevator operation
 
-extern state_t * elevator_states[];
+} car_fields_t;
+
+// Shorthand type for a task in the elevator system
+typedef void (*elevator_task_t)(uint16_t, uint8_t *);
+
+// Returned by get_next_elevator_deadline when no elevator has timed events pending
+#define NO_ELEVATOR_DEADLINE ((unsigned long) -1)
 
 /* Elevator methods */
 
 // Assign the direction the elevator should take to reach the next floor
-#define assign_elevator_direction(car) car->attrs.move = (car->attrs.next_floor > car->state.floor)? UP: DOWN
+#define assign_elevator_direction(cars, car_index) (cars)->move[car_index] = ((cars)->next_floor[car_index] > (cars)->floor[car_index])? UP: DOWN
 
 /**Check if elevator was initialized correctly
  * 
  * An elevator is said to have been initialized correctly if the 
- * state in the state machine and the rider list array were 
- * allocated in memory (i.e., they are not NULL.) An elevator
- * that was not initialized correctly will be called a null
- * elevator.
+ * rider totals and the requested floors were allocated in memory
+ * (i.e., they are not NULL.) An elevator that was not initialized
+ * correctly will be called a null elevator.
 */
-#define elevator_is_null(car) (car->attrs.riders == NULL) || (car->behavior == NULL) || (car->attrs.pressed_buttons == NULL)
+#define elevator_is_null(car) ((car->attrs.floor_loads == NULL) || (car->attrs.requested_floors == NULL))
 
-// Check if first rider object in floor stack is being used as a placeholder to request a floor
-#define front_rider_is_not_empty(car, floor) (((person_t *)((car)->attrs.pressed_floors[(floor)]->item))->weight)
+// Check if no more people fit in the elevator
+#define elevator_is_full(car) ((car)->attrs.occupancy >= (car)->attrs.capacity)
+
+// Requested floor bitset helpers (floors are given starting from 1)
+#define FLOOR_WORD_BITS (sizeof(floor_word_t) * 8)
+#define floor_word_count(floor_count) (((floor_count) + FLOOR_WORD_BITS - 1) / FLOOR_WORD_BITS)
+#define floor_word_index(floor) (((floor) - 1) / FLOOR_WORD_BITS)
+#define floor_word_bit(floor) (((floor_word_t) 1) << (((floor) - 1) % FLOOR_WORD_BITS))
 
 /**See what floor was requested
  * 
  * This verifies if the the floor was requested by a person. If no
- * person has requested, this will yield false (i.e., the rider's
- * list for that floor is empty.) Otherwise, if a person has requested
- * this floor, then it will give out a true value (i.e., the rider's
- * list for that floor will have at least one member.)
+ * person has requested it and no rider goes to it, this will yield
+ * false. Otherwise, this will give out a true value.
 */
-#define floor_was_requested(car, floor) get_list_length(car->attrs.riders[floor]) != 0
+#define floor_was_requested(car, floor) (((car)->attrs.requested_floors[floor_word_index(floor)] & floor_word_bit(floor)) != 0)
 
-// Set the elevator to move on a specific direction
-#define set_elevator_movement(car, move) car->attrs.move = move
+// Mark or unmark a floor in the requested floor bitset
+#define set_floor_request(car, floor) (car)->attrs.requested_floors[floor_word_index(floor)] |= floor_word_bit(floor)
+#define clear_floor_request(car, floor) (car)->attrs.requested_floors[floor_word_index(floor)] &= ~floor_word_bit(floor)
 
-// Shorthand for verifying if elevator is currently performing an action
-#define elevator_performing_action(car) car->attrs.action_started
+// Amount of floors between two floors
+#define floor_distance(a, b) (((a) > (b))? (a) - (b): (b) - (a))
 
-// Specify if the elevator is performing an action or not
-#define set_elevator_action(car, action) car->attrs.action_started = action
+// Set the elevator to move on a specific direction
+#define set_elevator_movement(cars, car_index, movement) (cars)->move[car_index] = movement
 
 // Verify if the elevator is within its limits
-#define elevator_within_limits(car) (car->state.weight < car->limits.weight) && (car->limits.l_temp < car->state.temp) && (car->state.temp < car->limits.h_temp)
+#define elevator_within_limits(car) ((car->state.weight < car->limits.weight) && (car->limits.l_temp < car->state.temp) && (car->state.temp < car->limits.h_temp))
 
 // Functions meant to be used internally by the Arduino
 
-void init_elevators(uint8_t count);
+void init_elevators(uint16_t count, timer_schedule_cb timer_cb);
+void init_building_elevators(const uint16_t * car_counts, uint8_t building_count, timer_schedule_cb timer_cb);
 void deinit_elevator(elevator_t * car);
-uint8_t find_next_floor(elevator_t * car);
-state_t * get_elevator_state(uint8_t state_id);
-void enter_elevator(uint8_t car_index, uint8_t * attrs);
-void exit_elevator(elevator_t * car, uint8_t car_index);
-void move_elevator(elevator_t * car, uint8_t car_index);
-void request_elevator(uint8_t car_index, uint8_t * p_floor);
-void update_comp_elevator_attr(uint8_t car_index, elevator_t * car, uint8_t attr_id);
-void set_elevator_attrs(uint8_t car_index, const char ** floor_names, uint8_t floor_count, uint8_t max_temp, uint8_t min_temp, uint8_t capacity, uint16_t weight);
+uint8_t find_next_floor(elevator_t * car, uint16_t car_index);
+void enter_elevator(uint16_t car_index, uint8_t * attrs);
+void exit_elevator(elevator_t * car, uint16_t car_index);
+void move_elevator(elevator_t * car, uint16_t car_index);
+void request_elevator(uint16_t car_index, uint8_t * p_floor);
+void request_elevator_floors(uint16_t car_index, uint8_t * batch);
+void pass_elevator_snapshot(uint8_t * _);
+void update_comp_elevator_attr(uint16_t car_index, uint8_t attr_id);
+void set_elevator_attrs(uint16_t car_index, const char ** floor_names, uint8_t floor_count, uint8_t max_temp, uint8_t min_temp, uint8_t capacity, uint16_t weight);
+bool set_elevator_motion(uint16_t car_index, const car_motion_t * motion);
+unsigned long estimate_arrival_ms(uint16_t car_index, uint8_t floor);
 
 // Update values in computer for the relevant attribute
 
-#define update_elevator_capacity(car_index, car)                  update_comp_elevator_attr(car_index, car, CAPACITY)
-#define update_elevator_temp(car_index, car)                      update_comp_elevator_attr(car_index, car, TEMPERATURE)
-#define update_elevator_floor(car_index, car)                     update_comp_elevator_attr(car_index, car, CURRENT_FLOOR)
-#define update_elevator_door_status(car_index, car)               update_comp_elevator_attr(car_index, car, DOOR_STATE)
-#define update_elevator_light_status(car_index, car)              update_comp_elevator_attr(car_index, car, LIGHT_STATE)
-#define update_elevator_maintenance_status(car_index, car)        update_comp_elevator_attr(car_index, car, MAINTENANCE_STATE)
-#define update_elevator_movement_state(car_index, car)            update_comp_elevator_attr(car_index, car, MOVEMENT)
-#define update_elevator_emergency_status(car_index, car)          update_comp_elevator_attr(car_index, car, EMERGENCY_STATE)
-#define update_elevator_weight(car_index, car)                    update_comp_elevator_attr(car_index, car, WEIGHT)
-#define update_elevator_next_floor(car_index, car)                update_comp_elevator_attr(car_index, car, NEXT_FLOOR)
+#define update_elevator_capacity(car_index)                       update_comp_elevator_attr(car_index, CAPACITY)
+#define update_elevator_temp(car_index)                           update_comp_elevator_attr(car_index, TEMPERATURE)
+#define update_elevator_floor(car_index)                          update_comp_elevator_attr(car_index, CURRENT_FLOOR)
+#define update_elevator_door_status(car_index)                    update_comp_elevator_attr(car_index, DOOR_STATE)
+#define update_elevator_light_status(car_index)                   update_comp_elevator_attr(car_index, LIGHT_STATE)
+#define update_elevator_maintenance_status(car_index)             update_comp_elevator_attr(car_index, MAINTENANCE_STATE)
+#define update_elevator_movement_state(car_index)                 update_comp_elevator_attr(car_index, MOVEMENT)
+#define update_elevator_emergency_status(car_index)               update_comp_elevator_attr(car_index, EMERGENCY_STATE)
+#define update_elevator_weight(car_index)                         update_comp_elevator_attr(car_index, WEIGHT)
+#define update_elevator_next_floor(car_index)                     update_comp_elevator_attr(car_index, NEXT_FLOOR)
 
 /* Elevator subsystem methods */
 
 void run_elevators(void);
-uint8_t get_elevator_count(void);
+uint16_t get_elevator_count(void);
+unsigned long get_elevator_time(void);
 void deinit_elevator_subsystem(void);
 uint8_t get_elevator_system_mode(void);
-elevator_t * get_elevator(uint8_t index);
+elevator_t * get_elevator(uint16_t index);
+car_fields_t * get_elevator_fields(void);
+uint8_t get_elevator_building(uint16_t index);
 void set_elevator_system_mode(uint8_t _, uint8_t * mode);
-void alert_comp_elevator(uint8_t attr_id, uint8_t car_index, uint8_t floor);
-bool init_elevator_subsystem(uint8_t count, rx_schedule_cb rx_cb, tx_schedule_cb tx_cb, timer_schedule_cb timer_cb);
+void alert_comp_elevator(uint8_t attr_id, uint16_t car_index, uint8_t floor);
+void alert_comp_riders_removal(uint16_t car_index, uint8_t floor, uint8_t riders);
+bool init_elevator_subsystem(uint16_t count, rx_schedule_cb rx_cb, tx_schedule_cb tx_cb, timer_schedule_cb timer_cb);
+
+/* Elevator behavior methods */
+
+bool init_elevator_behavior(uint16_t count);
+void deinit_elevator_behavior(void);
+void run_elevator_behavior(void);
+void wake_elevator_behavior(uint16_t car_index);
+unsigned long get_next_elevator_deadline(void);
+void set_elevator_behavior_state(uint16_t car_index, uint8_t state);
+uint8_t get_elevator_behavior_state(uint16_t index);
 
 // Alert computer that a floor has been reached
 #define alert_floor_arrival(car_index, floor)  alert_comp_elevator(ALERT_FLOOR_ARRIVAL, car_index, floor)
@@ -315,8 +389,8 @@ bool init_elevator_subsystem(uint8_t count, rx_schedule_cb rx_cb, tx_schedule_cb
 // Alert that a person has been added to the elevator
 #define alert_person_addition(car_index, floor)  alert_comp_elevator(ALERT_PERSON_ADDITION, car_index, floor)
 
-// Alert that a person has exited the elevator
-#define alert_person_removal(car_index, floor) alert_comp_elevator(ALERT_PERSON_REMOVAL, car_index, floor)
+// Alert that people have exited the elevator
+#define alert_person_removal(car_index, floor, riders) alert_comp_riders_removal(car_index, floor, riders)
 
 // Removes an elevator car from the requested elevator listing
 #define remove_elevator_from_floor(car_index, floor)  alert_comp_elevator(REMOVE_CAR_FROM_FLOOR, car_index, floor)
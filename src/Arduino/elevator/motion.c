@@ -0,0 +1,105 @@
+#include "motion.h"
+
+
+/* Private motion function prototypes */
+
+static uint32_t isqrt(uint64_t value);
+static unsigned long get_accel_time(const car_motion_t * motion, uint32_t distance);
+
+// Time to go a distance at a constant rate (ms), without overflowing the intermediate product
+#define scale_to_ms(distance, rate) (((distance) / (rate)) * 1000UL + ((distance) % (rate)) * 1000UL / (rate))
+
+
+/* Public motion functions */
+
+/**Get the time a car takes to pass a floor of its run (ms)
+ *
+ * The run starts with the car stopped and ends with the car stopped
+ * run_floors floors away. The time is counted from the start of the
+ * run until the car is the given amount of floors into it. A car that
+ * can't move gives out NO_ARRIVAL.
+*/
+unsigned long get_motion_time(const car_motion_t * motion, uint8_t run_floors, uint8_t floors)
+{
+    if (floors > run_floors)
+    {
+        floors = run_floors;
+    }
+
+    if (!floors)
+    {
+        return 0;
+    }
+
+    if (!motion->speed || !motion->accel)
+    {
+        return NO_ARRIVAL;
+    }
+
+    uint32_t run = (uint32_t) run_floors * motion->floor_height;
+    uint32_t position = (uint32_t) floors * motion->floor_height;
+    uint32_t ramp = (uint32_t) motion->speed * motion->speed / (2UL * motion->accel);  // Distance to reach the top speed
+
+    // The car turns around from accelerating to decelerating in the middle of the run
+    if (2 * ramp >= run)
+    {
+        if (2 * position <= run)
+        {
+            return get_accel_time(motion, position);
+        }
+        return get_accel_time(motion, 2 * run) - get_accel_time(motion, run - position);
+    }
+
+    unsigned long ramp_time = scale_to_ms((uint32_t) motion->speed, (uint32_t) motion->accel);
+
+    if (position <= ramp)
+    {
+        return get_accel_time(motion, position);
+    }
+    if (position <= run - ramp)
+    {
+        return ramp_time + scale_to_ms(position - ramp, (uint32_t) motion->speed);
+    }
+
+    unsigned long run_time = 2 * ramp_time + scale_to_ms(run - 2 * ramp, (uint32_t) motion->speed);
+
+    return run_time - get_accel_time(motion, run - position);
+}
+
+
+/* Private motion functions */
+
+// Time to go a distance from a stop while accelerating (ms)
+static unsigned long get_accel_time(const car_motion_t * motion, uint32_t distance)
+{
+    return isqrt((uint64_t) 2 * distance * 1000000 / motion->accel);
+}
+
+
+// Integer square root (rounded down), which only takes shifts and additions
+static uint32_t isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t) root;
+}
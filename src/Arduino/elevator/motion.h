@@ -0,0 +1,54 @@
+#ifndef ELEVATOR_MOTION_H
+#define ELEVATOR_MOTION_H
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Motion constants */
+
+// Default motion of a car (a run of n floors takes 3n + 1 seconds and the doors stay open for 4 seconds)
+#define DEFAULT_CAR_SPEED        1000  // Top speed (mm/s)
+#define DEFAULT_CAR_ACCEL        1000  // Acceleration and deceleration (mm/s^2)
+#define DEFAULT_CAR_FLOOR_HEIGHT 3000  // Distance between two floors (mm)
+#define DEFAULT_CAR_DWELL        4000  // Time the doors stay open at a stop (ms)
+
+// Initializer of a car with the default motion
+#define DEFAULT_CAR_MOTION {DEFAULT_CAR_SPEED, DEFAULT_CAR_ACCEL, DEFAULT_CAR_FLOOR_HEIGHT, DEFAULT_CAR_DWELL}
+
+// Returned when a car can't reach a floor
+#define NO_ARRIVAL ((unsigned long) -1)
+
+
+/**Motion of a car
+ *
+ * A car accelerates from a stop up to its top speed, cruises and then
+ * decelerates at the same rate to its next stop. A run that is too
+ * short to reach the top speed accelerates up to its middle and
+ * decelerates from there.
+*/
+typedef struct
+{
+    uint16_t speed;         // Top speed (mm/s)
+    uint16_t accel;         // Acceleration and deceleration (mm/s^2)
+    uint16_t floor_height;  // Distance between two floors (mm)
+    uint16_t dwell;         // Time the doors stay open at a stop (ms)
+
+} car_motion_t;
+
+
+/* Motion methods */
+
+unsigned long get_motion_time(const car_motion_t * motion, uint8_t run_floors, uint8_t floors);
+
+// Time a car takes to go a number of floors from one stop to the next
+#define get_travel_time(motion, floors) get_motion_time(motion, floors, floors)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
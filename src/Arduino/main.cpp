@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include <avr/sleep.h>
 #include <devices.h>
 #include <scheduler.h>
 
@@ -8,6 +9,7 @@
 /* Function prototypes */
 
 static void receive_serial_pkt(void);
+static void sleep_until_next_event(void);
 static void serial_tx_cb(uint8_t * pkt, uint8_t pkt_size);
 static uint8_t serial_rx_cb(uint8_t id, task_t task, uint8_t * pkt);
 
@@ -27,7 +29,7 @@ void setup()
 
         // schedule_fast_task(130, EXTERNAL_TASK, (uint8_t *) "Just testing", 12);
 
-        init_elevators(2);
+        init_elevators(ELEVATOR_COUNT, millis);
         
         // Setup elevator objects
         if (device_initialized(ELEVATOR_TRACKER))  // Check if the elevators where initialized
@@ -55,6 +57,7 @@ void loop()
     send_task();
     receive_serial_pkt();
     run_elevators();
+    sleep_until_next_event();
 }
 
 
@@ -73,6 +76,25 @@ static void receive_serial_pkt(void)
 }
 
 
+/**Idle the MCU while the elevators have nothing to do
+ * 
+ * The elevators are only ran when their timers expire or when a
+ * task wakes them up, so the MCU sleeps until the next interrupt.
+ * The millis() tick and the serial interrupts keep running in the
+ * idle sleep mode, and they wake the MCU up.
+ */
+static void sleep_until_next_event(void)
+{
+    unsigned long deadline = get_next_elevator_deadline();
+
+    if (!Serial.available() && (deadline == NO_ELEVATOR_DEADLINE || (long) (deadline - millis()) > 0))
+    {
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_mode();
+    }
+}
+
+
 // Callback for interpreting and running a task
 static uint8_t serial_rx_cb(uint8_t id, task_t task, uint8_t * pkt)
 {
@@ -81,9 +103,10 @@ static uint8_t serial_rx_cb(uint8_t id, task_t task, uint8_t * pkt)
         // Elevator tasks
         case ENTER_ELEVATOR:
         case REQUEST_ELEVATOR:
-            uint8_t car_index = pkt[CAR_INDEX_OFFSET];
+        case REQUEST_ELEVATOR_FLOORS:
+            uint16_t car_index = unpack_device_id(&pkt[CAR_INDEX_OFFSET]);
 
-            if (car_index < ELEVATOR_COUNT)
+            if (car_index < get_elevator_count())
             {
                 ((elevator_task_t) task)(car_index, &pkt[CAR_PAYLOAD_OFFSET]);
 
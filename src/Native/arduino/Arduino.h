@@ -0,0 +1,54 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**Shim of the Arduino core for Linux
+ *
+ * Only the parts of the core the firmware uses are provided, so the
+ * firmware in src/Arduino builds as it is. The serial port is backed
+ * by a pseudo-terminal, and the host opens its slave side like it
+ * would open the board's port.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long millis(void);
+void delay(unsigned long ms);
+
+#ifdef __cplusplus
+}
+
+
+// Serial port backed by the master side of a pseudo-terminal
+class HardwareSerial
+{
+    public:
+        void begin(unsigned long baudrate);
+        int available(void);
+        int read(void);
+        size_t write(uint8_t byte);
+        size_t write(const uint8_t * buf, size_t size);
+
+        int get_fd(void) const { return master_fd; }
+        unsigned long get_rx_count(void) const { return rx_count; }
+        unsigned long get_tx_count(void) const { return tx_count; }
+
+    private:
+        int master_fd = -1;
+        uint8_t rx_buf[256];
+        uint16_t rx_head = 0;
+        uint16_t rx_size = 0;
+        unsigned long rx_count = 0;  // Bytes the firmware read
+        unsigned long tx_count = 0;  // Bytes the firmware wrote
+};
+
+extern HardwareSerial Serial;
+
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <termios.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "avr/sleep.h"
+
+
+/* Shim constants */
+
+#define TICK_MS 1  // Period of the millis() tick that wakes the board from the idle sleep
+
+
+/* Shim objects */
+
+HardwareSerial Serial;
+
+static struct timespec start_time;           // Time the board was "powered on"
+static const char * link_path = NULL;        // Symlink to the slave side of the serial port (NULL if there's none)
+static unsigned long host_open_time;         // millis() when the host opened the serial port
+static volatile sig_atomic_t is_stopped = 0;
+
+
+/* Shim function prototypes */
+
+static void stop_firmware(int _);
+static void remove_link(void);
+static void report_firmware_stats(void);
+
+// Firmware entry points (src/Arduino/main.cpp)
+void setup(void);
+void loop(void);
+
+
+/* Arduino core functions */
+
+// Milliseconds since the board started
+unsigned long millis(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start_time.tv_sec) * 1000UL + (now.tv_nsec - start_time.tv_nsec) / 1000000L;
+}
+
+
+// Block for a number of milliseconds
+void delay(unsigned long ms)
+{
+    struct timespec duration = {(time_t) (ms / 1000), (long) (ms % 1000) * 1000000L};
+
+    while (nanosleep(&duration, &duration) && errno == EINTR && !is_stopped);
+}
+
+
+/**Open the serial port and wait for the host
+ *
+ * The board resets when the host opens its port, so the firmware only
+ * starts talking once the host is there. The slave side is opened and
+ * closed once, so the master sees a hangup until the host opens it.
+ */
+void HardwareSerial::begin(unsigned long _)
+{
+    struct termios attrs;
+
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+    if (master_fd < 0 || grantpt(master_fd) || unlockpt(master_fd))
+    {
+        perror("Could not open a pseudo-terminal");
+        exit(EXIT_FAILURE);
+    }
+
+    const char * slave_path = ptsname(master_fd);
+    int slave_fd = open(slave_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+
+    if (slave_fd >= 0)
+    {
+        if (tcgetattr(slave_fd, &attrs) == 0)
+        {
+            cfmakeraw(&attrs);
+            tcsetattr(slave_fd, TCSANOW, &attrs);
+        }
+        close(slave_fd);
+    }
+
+    if (link_path != NULL)
+    {
+        unlink(link_path);
+        if (symlink(slave_path, link_path))
+        {
+            fprintf(stderr, "Could not link %s to %s: %s\n", link_path, slave_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("%s\n", (link_path != NULL)? link_path: slave_path);
+    fflush(stdout);
+
+    // Wait until the host opens the slave side
+    struct pollfd port = {master_fd, POLLIN, 0};
+
+    while (!is_stopped)
+    {
+        port.revents = 0;
+        if (poll(&port, 1, TICK_MS) >= 0 && !(port.revents & POLLHUP))
+        {
+            break;
+        }
+        delay(TICK_MS);
+    }
+
+    if (is_stopped)
+    {
+        exit(EXIT_SUCCESS);
+    }
+
+    host_open_time = millis();
+}
+
+
+// Amount of bytes that can be read right away
+int HardwareSerial::available(void)
+{
+    if (rx_head == rx_size)
+    {
+        ssize_t byte_count = ::read(master_fd, rx_buf, sizeof(rx_buf));
+
+        rx_head = 0;
+        rx_size = (byte_count > 0)? byte_count: 0;  // EIO only means the host closed the port
+    }
+
+    return rx_size - rx_head;
+}
+
+
+// Read a byte (-1 if there's none)
+int HardwareSerial::read(void)
+{
+    if (!available())
+    {
+        return -1;
+    }
+
+    rx_count++;
+    return rx_buf[rx_head++];
+}
+
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+
+// Write bytes to the host (the bytes are dropped if the host closed the port, like a UART would)
+size_t HardwareSerial::write(const uint8_t * buf, size_t size)
+{
+    ssize_t written = ::write(master_fd, buf, size);
+
+    if (written < 0)
+    {
+        written = (errno == EAGAIN || errno == EINTR)? 0: size;
+    }
+
+    tx_count += written;
+    return written;
+}
+
+
+/* avr-libc sleep functions */
+
+void set_sleep_mode(uint8_t _) {}
+
+
+// Wait for a byte from the host or for the next tick
+void sleep_mode(void)
+{
+    struct pollfd port = {Serial.get_fd(), POLLIN, 0};
+
+    if (poll(&port, 1, TICK_MS) > 0 && (port.revents & POLLHUP))
+    {
+        delay(TICK_MS);  // There's no host, so poll doesn't block
+    }
+}
+
+
+/* Main function */
+
+/**Run the firmware on a pseudo-terminal
+ *
+ * The path of the serial port is printed once it's open (or the given
+ * link is made to point to it). The firmware starts when the host
+ * opens the port and runs until it's told to stop, at which point the
+ * serial traffic and the setup latency are reported.
+ */
+int main(int argc, char * argv[])
+{
+    static const struct option long_opts[] = {
+        {"link", required_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': link_path = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [--link PATH]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_firmware;  // No SA_RESTART, so the blocking calls give up
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    atexit(remove_link);
+
+    setup();
+    unsigned long setup_ms = millis() - host_open_time;
+
+    while (!is_stopped)
+    {
+        loop();
+    }
+
+    fprintf(stderr, "setup: %lu ms\n", setup_ms);
+    report_firmware_stats();
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Private shim functions */
+
+static void stop_firmware(int _)
+{
+    is_stopped = 1;
+}
+
+
+// Remove the link to the serial port
+static void remove_link(void)
+{
+    if (link_path != NULL)
+    {
+        unlink(link_path);
+    }
+}
+
+
+// Report the serial traffic since the host opened the port
+static void report_firmware_stats(void)
+{
+    unsigned long run_ms = millis() - host_open_time;
+
+    fprintf(stderr, "rx: %lu bytes, tx: %lu bytes in %lu ms", Serial.get_rx_count(), Serial.get_tx_count(), run_ms);
+    if (run_ms)
+    {
+        fprintf(stderr, " (%.1f kB/s)", (Serial.get_rx_count() + Serial.get_tx_count()) / (double) run_ms);
+    }
+    fprintf(stderr, "\n");
+}
@@ -0,0 +1,26 @@
+#ifndef AVR_SLEEP_H
+#define AVR_SLEEP_H
+
+#include <stdint.h>
+
+
+/**Shim of avr-libc's sleep modes
+ *
+ * Sleeping waits for the serial port or for the next millis() tick,
+ * which are the interrupts that wake the board up in the idle mode.
+ */
+
+#define SLEEP_MODE_IDLE 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void set_sleep_mode(uint8_t mode);
+void sleep_mode(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
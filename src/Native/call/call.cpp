@@ -0,0 +1,176 @@
+#include <string.h>
+
+#include "call.h"
+
+
+/* Call variables */
+
+static THREAD_LOCAL call_executor * executor;  // Executor of the thread's scheduler (NULL if there's none)
+
+
+/* Call awaiter functions */
+
+// Queue the call up and leave the routine suspended until it's done
+void call_awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    routine = handle;
+    executor->calls.push_back(this);
+}
+
+
+/* Call executor functions */
+
+// Start getting the outcome of the normal tasks of the thread's scheduler
+call_executor::call_executor(timer_schedule_cb timer_cb)
+{
+    this->timer_cb = timer_cb;
+    is_submitted = false;
+    memset(abandoned, 0, sizeof(abandoned));
+    executor = this;
+    set_completion_callback(completion_cb);
+}
+
+
+/**Stop getting the outcome of the normal tasks
+ *
+ * The routines that were not resumed yet are destroyed, since they
+ * would never be.
+ */
+call_executor::~call_executor()
+{
+    set_completion_callback(NULL);
+    executor = NULL;
+
+    for (size_t i = 0; i < calls.size(); i++)
+    {
+        calls[i]->routine.destroy();
+    }
+    for (size_t i = 0; i < ready.size(); i++)
+    {
+        ready[i].destroy();
+    }
+}
+
+
+// Make a call of a task with a copy of its payload (a payload that doesn't fit is never sent)
+call_awaiter call_executor::call(uint8_t id, const uint8_t * payload, uint8_t payload_size, unsigned long timeout)
+{
+    call_awaiter awaiter;
+
+    awaiter.executor = this;
+    awaiter.id = id;
+    awaiter.timeout = timeout;
+    awaiter.deadline = 0;
+    awaiter.is_done = payload_size > MAX_PAYLOAD_SIZE;
+    awaiter.payload_size = awaiter.is_done? 0: payload_size;
+
+    if (awaiter.payload_size)
+    {
+        memcpy(awaiter.payload, payload, awaiter.payload_size);
+    }
+
+    return awaiter;
+}
+
+
+// Build the packets of the other system byte-by-byte
+void call_executor::receive(uint8_t byte)
+{
+    build_rx_task_pkt(byte);
+}
+
+
+/**Run the scheduler and the routines with finished calls
+ *
+ * The next call is given to the scheduler before it sends its tasks,
+ * so it goes out right away. The routines are resumed after that, and
+ * the calls they make are handed to the scheduler on the next run.
+ */
+void call_executor::poll(void)
+{
+    expire_call();
+    submit_call();
+    send_task();
+
+    std::vector<std::coroutine_handle<> > routines;
+    routines.swap(ready);
+
+    for (size_t i = 0; i < routines.size(); i++)
+    {
+        routines[i].resume();
+    }
+}
+
+
+/* Private call executor functions */
+
+// Give the first call to the scheduler (the calls it refuses are finished unanswered)
+void call_executor::submit_call(void)
+{
+    while (!is_submitted && !calls.empty())
+    {
+        call_awaiter * call = calls.front();
+
+        if (schedule_normal_task(call->id, call->payload, call->payload_size))
+        {
+            call->deadline = timer_cb() + call->timeout;
+            is_submitted = true;
+        }
+        else
+        {
+            finish_call(std::nullopt);
+        }
+    }
+}
+
+
+// Finish the call in the scheduler if its timeout ran out (its task is left to the scheduler)
+void call_executor::expire_call(void)
+{
+    if (is_submitted && (long) (timer_cb() - calls.front()->deadline) >= 0)
+    {
+        abandoned[calls.front()->id]++;
+        finish_call(std::nullopt);
+    }
+}
+
+
+// Finish the first call (its routine is resumed in the next run)
+void call_executor::finish_call(std::optional<uint8_t> ret_code)
+{
+    call_awaiter * call = calls.front();
+
+    call->ret_code = ret_code;
+    calls.pop_front();
+    is_submitted = false;
+    ready.push_back(call->routine);
+}
+
+
+// Finish the call that was given to the scheduler with the outcome of its task
+void call_executor::complete_call(uint8_t id, uint8_t ret_code, bool is_answered)
+{
+    // The outcome of a task that timed out doesn't belong to a call anymore
+    if (abandoned[id])
+    {
+        abandoned[id]--;
+        return;
+    }
+
+    if (!is_submitted || calls.front()->id != id)
+    {
+        return;
+    }
+
+    finish_call(is_answered? std::optional<uint8_t>(ret_code): std::nullopt);
+}
+
+
+// Scheduler hook for the outcome of the normal tasks
+void call_executor::completion_cb(uint8_t id, uint8_t ret_code, bool is_answered)
+{
+    if (executor != NULL)
+    {
+        executor->complete_call(id, ret_code, is_answered);
+    }
+}
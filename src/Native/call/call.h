@@ -0,0 +1,128 @@
+#ifndef CALL_H
+#define CALL_H
+
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+#include <optional>
+#include <coroutine>
+#include <exception>
+
+#include <scheduler.h>
+
+
+/* Call constants */
+
+// Time a call waits for its reply by default (ms), which covers both reply windows of the scheduler and a credit probe
+#define DEFAULT_CALL_TIMEOUT (SHORT_TIMER + LONG_TIMER + CREDIT_PROBE_TIMER)
+
+
+/* Call objects */
+
+/**Host logic that awaits calls
+ *
+ * A routine starts running as soon as it's called and frees itself
+ * once it returns, so it only has to be started. Nothing is given
+ * back to the caller, and the routine is resumed by the executor
+ * every time one of its calls is done.
+ */
+struct call_routine
+{
+    struct promise_type
+    {
+        call_routine get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+
+class call_executor;
+
+
+/**Call of a task on the other system
+ *
+ * Awaiting a call suspends the routine until the other system replies
+ * to the task. The return code of the reply is given back, or nothing
+ * if the task went unanswered: its payload doesn't fit, the scheduler
+ * refused it, its reply windows passed or its timeout ran out.
+ */
+struct call_awaiter
+{
+    call_executor * executor;
+    uint8_t id;
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint8_t payload_size;
+    unsigned long timeout;            // Time the call waits for its reply once it's given to the scheduler (ms)
+    unsigned long deadline;
+    bool is_done;                     // The call was finished without suspending the routine
+    std::optional<uint8_t> ret_code;
+    std::coroutine_handle<> routine;  // Routine that awaits the call
+
+    bool await_ready() const noexcept { return is_done; }
+    void await_suspend(std::coroutine_handle<> handle);
+    std::optional<uint8_t> await_resume() const noexcept { return ret_code; }
+};
+
+
+/**Single-threaded executor of calls
+ *
+ * The executor drives the scheduler of its thread: the bytes from the
+ * other system are given to receive() and poll() is ran in the loop
+ * of the host, which is where the scheduler sends its tasks and where
+ * the routines with finished calls are resumed. Many routines can
+ * wait on calls at once without any threads.
+ *
+ * The scheduler only keeps one normal task waiting for a reply, so
+ * the calls are handed to it one at a time in the order they were
+ * made. That way the calls never fill its queues (a full queue refuses
+ * new tasks while it only holds normal tasks). A call is
+ * matched to the outcome of the next normal task with its id, so a
+ * copy of the task queued by someone else answers the call too.
+ *
+ * A call the scheduler refuses (e.g., a task with its id is already
+ * queued) is finished right away, and poll() finishes the call once its
+ * timeout runs out (e.g., the other system never gives credit back).
+ * Both go unanswered. The task of a call that timed out can still be
+ * queued, so its outcome is skipped instead of finishing a later call.
+ *
+ * There's a single executor per thread, since the scheduler is a
+ * singleton of its thread.
+ */
+class call_executor
+{
+public:
+    call_executor(timer_schedule_cb timer_cb);
+    ~call_executor();
+
+    call_executor(const call_executor &) = delete;
+    call_executor & operator=(const call_executor &) = delete;
+
+    call_awaiter call(uint8_t id, const uint8_t * payload, uint8_t payload_size, unsigned long timeout = DEFAULT_CALL_TIMEOUT);
+
+    void receive(uint8_t byte);
+    void poll(void);
+
+    size_t get_pending_calls(void) const { return calls.size(); }
+
+private:
+    friend struct call_awaiter;
+
+    timer_schedule_cb timer_cb;                    // Clock of the call timeouts
+    std::deque<call_awaiter *> calls;              // Calls waiting for their task to be done (the first one is in the scheduler)
+    bool is_submitted;                             // The first call was given to the scheduler
+    uint8_t abandoned[UINT8_MAX + 1];              // Tasks of each id that timed out but might still be queued
+    std::vector<std::coroutine_handle<> > ready;   // Routines to resume once the scheduler is done
+
+    void submit_call(void);
+    void expire_call(void);
+    void finish_call(std::optional<uint8_t> ret_code);
+    void complete_call(uint8_t id, uint8_t ret_code, bool is_answered);
+
+    static void completion_cb(uint8_t id, uint8_t ret_code, bool is_answered);
+};
+
+#endif
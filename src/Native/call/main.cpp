@@ -0,0 +1,287 @@
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include <devices.h>
+
+#include "call.h"
+#include "elevator.h"
+
+
+/* Call tool constants */
+
+#define NO_FD            -1
+#define DEFAULT_BAUDRATE 115200
+#define POLL_MS          10  // Longest time the loop waits for the other system
+#define MAX_TASK_ID      UINT8_MAX
+
+
+/* Call tool variables */
+
+static int link_fd = NO_FD;
+static size_t running_routines;
+static volatile sig_atomic_t is_stopped;
+
+
+/* Call tool function prototypes */
+
+static void print_usage(const char * prog);
+static void stop_calls(int _);
+static unsigned long get_time_ms(void);
+static int open_tty(const char * path, unsigned long baudrate);
+static speed_t get_baud_speed(unsigned long baudrate);
+static void link_tx_cb(uint8_t * pkt, uint8_t pkt_size);
+static uint8_t link_rx_cb(uint8_t id, task_t task, uint8_t * pkt);
+static call_routine request_floor(call_executor & executor, uint16_t car_index, uint8_t floor);
+
+
+/* Main function */
+
+/**Request elevator floors from the MCU and wait for its replies
+ *
+ * Every CAR:FLOOR given in the command line is requested by its own
+ * routine, which awaits the return code the MCU replies with. All the
+ * routines wait at once on a single thread, and the tool is done once
+ * every request was answered (or went unanswered). The tasks the MCU
+ * sends are acknowledged like the computer does it, so the MCU keeps
+ * running while the requests are made.
+ */
+int main(int argc, char * argv[])
+{
+    unsigned long baudrate = DEFAULT_BAUDRATE;
+
+    static const struct option long_opts[] = {
+        {"baud", required_argument, NULL, 'b'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': baudrate = strtoul(optarg, NULL, 10); break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind < 2)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    link_fd = open_tty(argv[optind], baudrate);
+    if (link_fd == NO_FD)
+    {
+        fprintf(stderr, "Could not open the serial port %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    if (!init_task_scheduler(link_rx_cb, link_tx_cb, get_time_ms))
+    {
+        close(link_fd);
+        return EXIT_FAILURE;
+    }
+
+    // Every task of the MCU is taken, so its normal tasks are acknowledged
+    for (uint16_t id = 0; id <= MAX_TASK_ID; id++)
+    {
+        register_empty_task(id);
+    }
+
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_calls;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    {
+        call_executor executor(get_time_ms);
+
+        for (int i = optind + 1; i < argc; i++)
+        {
+            unsigned long car_index;
+            unsigned long floor;
+
+            if (sscanf(argv[i], "%lu:%lu", &car_index, &floor) != 2 || car_index > UINT16_MAX || floor > UINT8_MAX)
+            {
+                fprintf(stderr, "Invalid request %s (expected CAR:FLOOR)\n", argv[i]);
+                continue;
+            }
+
+            request_floor(executor, car_index, floor);
+        }
+
+        while (running_routines && !is_stopped)
+        {
+            struct pollfd port = {link_fd, POLLIN, 0};
+            uint8_t buf[MAX_ENCODED_PKT_BUF_SIZE];
+
+            if (poll(&port, 1, POLL_MS) > 0)
+            {
+                ssize_t byte_count;
+
+                while ((byte_count = read(link_fd, buf, sizeof(buf))) > 0)
+                {
+                    for (ssize_t j = 0; j < byte_count; j++)
+                    {
+                        executor.receive(buf[j]);
+                    }
+                }
+
+                if (port.revents & POLLHUP)
+                {
+                    fprintf(stderr, "The serial port was closed\n");
+                    break;
+                }
+            }
+
+            executor.poll();
+        }
+    }
+
+    deinit_task_scheduler();
+    close(link_fd);
+
+    return running_routines? EXIT_FAILURE: EXIT_SUCCESS;
+}
+
+
+/* Call tool functions */
+
+static void print_usage(const char * prog)
+{
+    fprintf(stderr, "usage: %s [--baud N] PORT CAR:FLOOR...\n", prog);
+}
+
+
+static void stop_calls(int _)
+{
+    is_stopped = 1;
+}
+
+
+// Timer of the scheduler (ms)
+static unsigned long get_time_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+// Open a serial link in raw mode without blocking
+static int open_tty(const char * path, unsigned long baudrate)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    struct termios attrs;
+
+    if (fd == NO_FD)
+    {
+        return NO_FD;
+    }
+
+    if (tcgetattr(fd, &attrs) == 0)
+    {
+        cfmakeraw(&attrs);
+        attrs.c_cflag |= CLOCAL | CREAD;
+        attrs.c_cc[VMIN] = 1;  // Reads without data fail with EAGAIN instead of returning 0
+        attrs.c_cc[VTIME] = 0;
+        cfsetspeed(&attrs, get_baud_speed(baudrate));
+
+        if (tcsetattr(fd, TCSANOW, &attrs))
+        {
+            close(fd);
+            return NO_FD;
+        }
+    }
+
+    return fd;
+}
+
+
+// Map a baudrate to its termios speed (unknown baudrates use the Arduino's default)
+static speed_t get_baud_speed(unsigned long baudrate)
+{
+    switch (baudrate)
+    {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return B115200;
+    }
+}
+
+
+// Write a frame to the serial link (a full link is waited on, so the frame is not cut short)
+static void link_tx_cb(uint8_t * pkt, uint8_t pkt_size)
+{
+    size_t sent = 0;
+
+    while (sent < pkt_size)
+    {
+        ssize_t byte_count = write(link_fd, pkt + sent, pkt_size - sent);
+
+        if (byte_count > 0)
+        {
+            sent += byte_count;
+        }
+        else if (byte_count < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            struct pollfd port = {link_fd, POLLOUT, 0};
+            poll(&port, 1, POLL_MS);
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+
+// The tasks of the MCU are only acknowledged
+static uint8_t link_rx_cb(uint8_t, task_t, uint8_t *)
+{
+    return 0;
+}
+
+
+// Request a floor and print the return code the MCU replies with
+static call_routine request_floor(call_executor & executor, uint16_t car_index, uint8_t floor)
+{
+    uint8_t pkt[CAR_PAYLOAD_OFFSET + 1];
+    unsigned long start_time = get_time_ms();
+
+    pack_device_id(&pkt[CAR_INDEX_OFFSET], car_index);
+    pkt[CAR_PAYLOAD_OFFSET] = floor;
+
+    running_routines++;
+    std::optional<uint8_t> ret_code = co_await executor.call(REQUEST_ELEVATOR, pkt, sizeof(pkt));
+    running_routines--;
+
+    if (ret_code.has_value())
+    {
+        printf("car %u floor %u: %u (%lu ms)\n", car_index, floor, *ret_code, get_time_ms() - start_time);
+    }
+    else
+    {
+        printf("car %u floor %u: unanswered (%lu ms)\n", car_index, floor, get_time_ms() - start_time);
+    }
+}
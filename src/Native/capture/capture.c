@@ -0,0 +1,197 @@
+#include <string.h>
+
+#include "capture.h"
+
+
+/* Private capture constants */
+
+#define PCAP_MAGIC         0xA1B2C3D4  // Magic number of the pcap files with us timestamps
+#define PCAP_NANO_MAGIC    0xA1B23C4D  // Magic number of the pcap files with ns timestamps
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+
+#define US_PER_SEC 1000000ULL
+
+
+/* Private capture objects */
+
+// Header at the start of a pcap file
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t time_zone;
+    uint32_t sig_figs;
+    uint32_t snap_len;
+    uint32_t link_type;
+
+} pcap_file_hdr_t;
+
+
+// Header in front of every pcap record
+typedef struct
+{
+    uint32_t time_sec;
+    uint32_t time_frac;  // us or ns, depending on the magic number
+    uint32_t incl_len;
+    uint32_t orig_len;
+
+} pcap_record_hdr_t;
+
+
+/* Private capture macros */
+
+#define swap_u32(value) __builtin_bswap32(value)
+
+// Give out a field of a file in the byte order of this machine
+#define capture_u32(capture, value) ((capture)->is_swapped? swap_u32(value): (value))
+
+
+/* Public capture functions */
+
+// Create a capture file (an existing file is replaced)
+bool create_capture(capture_t * capture, const char * path)
+{
+    pcap_file_hdr_t hdr = {
+        .magic = PCAP_MAGIC,
+        .version_major = PCAP_VERSION_MAJOR,
+        .version_minor = PCAP_VERSION_MINOR,
+        .time_zone = 0,
+        .sig_figs = 0,
+        .snap_len = CAPTURE_HDR_SIZE + CAPTURE_MAX_FRAME_SIZE,
+        .link_type = CAPTURE_LINK_TYPE
+    };
+
+    capture->is_swapped = false;
+    capture->is_nano = false;
+    capture->file = fopen(path, "wb");
+
+    if (capture->file == NULL)
+    {
+        return false;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, capture->file) != 1)
+    {
+        close_capture(capture);
+        return false;
+    }
+
+    return true;
+}
+
+
+// Open a capture file to read its frames (it must have been written with the capture link type)
+bool open_capture(capture_t * capture, const char * path)
+{
+    pcap_file_hdr_t hdr;
+
+    capture->file = fopen(path, "rb");
+
+    if (capture->file == NULL)
+    {
+        return false;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, capture->file) != 1)
+    {
+        goto invalid_capture;
+    }
+
+    capture->is_swapped = hdr.magic == swap_u32(PCAP_MAGIC) || hdr.magic == swap_u32(PCAP_NANO_MAGIC);
+    capture->is_nano = capture_u32(capture, hdr.magic) == PCAP_NANO_MAGIC;
+
+    if ((capture_u32(capture, hdr.magic) != PCAP_MAGIC && !capture->is_nano) || capture_u32(capture, hdr.link_type) != CAPTURE_LINK_TYPE)
+    {
+        goto invalid_capture;
+    }
+
+    return true;
+
+    invalid_capture:
+        close_capture(capture);
+        return false;
+}
+
+
+void close_capture(capture_t * capture)
+{
+    if (capture->file != NULL)
+    {
+        fclose(capture->file);
+        capture->file = NULL;
+    }
+}
+
+
+// Add a frame to a capture file
+bool write_capture_frame(capture_t * capture, uint64_t time_us, uint16_t link, uint8_t direction, const uint8_t * frame, uint16_t size)
+{
+    size = (size > CAPTURE_MAX_FRAME_SIZE)? CAPTURE_MAX_FRAME_SIZE: size;
+
+    pcap_record_hdr_t record_hdr = {
+        .time_sec = (uint32_t) (time_us / US_PER_SEC),
+        .time_frac = (uint32_t) (time_us % US_PER_SEC),
+        .incl_len = CAPTURE_HDR_SIZE + size,
+        .orig_len = CAPTURE_HDR_SIZE + size
+    };
+
+    uint8_t frame_hdr[CAPTURE_HDR_SIZE] = {direction, (uint8_t) link, (uint8_t) (link >> 8)};
+
+    return fwrite(&record_hdr, sizeof(record_hdr), 1, capture->file) == 1 &&
+           fwrite(frame_hdr, sizeof(frame_hdr), 1, capture->file) == 1 &&
+           fwrite(frame, 1, size, capture->file) == size;
+}
+
+
+/**Read the next frame of a capture file
+ *
+ * Gives out false once the end of the file is reached or if a record
+ * is malformed. Records that are too short to hold the frame header
+ * are skipped.
+ */
+bool read_capture_frame(capture_t * capture, capture_frame_t * frame)
+{
+    pcap_record_hdr_t record_hdr;
+    uint8_t frame_hdr[CAPTURE_HDR_SIZE];
+
+    while (fread(&record_hdr, sizeof(record_hdr), 1, capture->file) == 1)
+    {
+        uint32_t incl_len = capture_u32(capture, record_hdr.incl_len);
+        uint64_t time_frac = capture_u32(capture, record_hdr.time_frac);
+
+        if (incl_len > CAPTURE_HDR_SIZE + CAPTURE_MAX_FRAME_SIZE)
+        {
+            return false;
+        }
+
+        if (incl_len < CAPTURE_HDR_SIZE)
+        {
+            if (fseek(capture->file, incl_len, SEEK_CUR))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (fread(frame_hdr, sizeof(frame_hdr), 1, capture->file) != 1)
+        {
+            return false;
+        }
+
+        frame->size = incl_len - CAPTURE_HDR_SIZE;
+        if (fread(frame->frame, 1, frame->size, capture->file) != frame->size)
+        {
+            return false;
+        }
+
+        frame->time_us = capture_u32(capture, record_hdr.time_sec) * US_PER_SEC + (capture->is_nano? time_frac / 1000: time_frac);
+        frame->direction = frame_hdr[0];
+        frame->link = frame_hdr[1] | (frame_hdr[2] << 8);
+
+        return true;
+    }
+
+    return false;
+}
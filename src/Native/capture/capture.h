@@ -0,0 +1,75 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Capture constants */
+
+#define CAPTURE_LINK_TYPE      147  // LINKTYPE_USER0 (pcap's link type for private protocols)
+#define CAPTURE_HDR_SIZE       3    // Size of the header in front of every frame
+#define CAPTURE_MAX_FRAME_SIZE 255  // Max size of a recorded frame
+
+/**Capture record layout
+ *
+ * Captures are pcap files, so they can be opened with the usual
+ * tools. Every record starts with a short header, followed by the
+ * COBS encoded frame without its delimiter:
+ *
+ *   byte 0:    direction (capture_direction)
+ *   bytes 1-2: link index (little endian, 0 for single link captures)
+ */
+enum capture_direction
+{
+    CAPTURE_TO_MCU,    // Frame sent by the computer
+    CAPTURE_FROM_MCU   // Frame sent by the MCU
+};
+
+
+/* Capture objects */
+
+// A recorded frame
+typedef struct
+{
+    uint64_t time_us;   // Time the frame was recorded (us)
+    uint16_t link;      // Link the frame went through
+    uint8_t direction;  // Direction of the frame (capture_direction)
+    uint16_t size;      // Size of the frame
+    uint8_t frame[CAPTURE_MAX_FRAME_SIZE];
+
+} capture_frame_t;
+
+
+// A capture file that is being written or read
+typedef struct
+{
+    FILE * file;
+    bool is_swapped;  // The file was written with the other byte order
+    bool is_nano;     // The timestamps are in ns instead of us
+
+} capture_t;
+
+
+/* Capture methods */
+
+bool create_capture(capture_t * capture, const char * path);
+bool open_capture(capture_t * capture, const char * path);
+void close_capture(capture_t * capture);
+
+bool write_capture_frame(capture_t * capture, uint64_t time_us, uint16_t link, uint8_t direction, const uint8_t * frame, uint16_t size);
+bool read_capture_frame(capture_t * capture, capture_frame_t * frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <devices.h>
+#include <scheduler.h>
+
+#include "elevator.h"
+#include "capture.h"
+
+
+/* Replay constants */
+
+#define DEFAULT_LINK    0
+#define DEFAULT_SPEED   1.0  // Replay at the speed the frames were recorded
+#define DEFAULT_FLOORS  7
+#define DEFAULT_BUILDINGS 1
+#define DEFAULT_CARS    ELEVATOR_COUNT  // Elevators per building
+
+#define REPLAY_MAX_STEPS_PER_TIME 8  // Max times the MCU is ran at the same virtual time
+#define US_PER_MS 1000
+
+
+/* Replay objects */
+
+// Counters gathered while replaying a capture
+typedef struct
+{
+    unsigned long rx_frames;  // Frames fed to the scheduler
+    unsigned long rx_bytes;
+    unsigned long tx_frames;  // Frames the MCU sent back
+    unsigned long steps;      // Times the MCU loop was ran
+
+} replay_stats_t;
+
+
+/* Replay variables */
+
+static unsigned long replay_time;  // Virtual clock (ms since the first replayed frame)
+static replay_stats_t replay_stats;
+static capture_t replay_output;    // Frames of the replay itself (if they're recorded)
+
+
+/* Replay function prototypes */
+
+static void print_usage(const char * prog);
+static void run_mcu(void);
+static void run_mcu_until(unsigned long end_time);
+static unsigned long replay_clock(void);
+static void replay_tx_cb(uint8_t * pkt, uint8_t pkt_size);
+static uint8_t replay_rx_cb(uint8_t id, task_t task, uint8_t * pkt);
+static void capture_replay_frame(bool is_tx, const uint8_t * frame, uint8_t frame_size);
+
+
+/* Main function */
+
+/**Feed the frames a computer sent in a capture to the elevator subsystem
+ *
+ * The elevator subsystem is set up like the captured unit and the
+ * frames sent to it are passed through build_rx_task_pkt. The MCU's
+ * clock follows the capture, so a replay always gives the same
+ * result. The speed only sets how fast the frames are fed in real
+ * time (0 feeds them as fast as possible), which makes a capture
+ * usable as a repeatable workload.
+ */
+int main(int argc, char * argv[])
+{
+    unsigned long link = DEFAULT_LINK;
+    double speed = DEFAULT_SPEED;
+    const char * output_path = NULL;
+    unsigned long floor_count = DEFAULT_FLOORS;
+    unsigned long building_count = DEFAULT_BUILDINGS;
+    unsigned long cars_per_building = DEFAULT_CARS;
+
+    static const struct option long_opts[] = {
+        {"link",      required_argument, NULL, 'l'},
+        {"speed",     required_argument, NULL, 's'},
+        {"output",    required_argument, NULL, 'o'},
+        {"buildings", required_argument, NULL, 'b'},
+        {"cars",      required_argument, NULL, 'c'},
+        {"floors",    required_argument, NULL, 'f'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:s:o:b:c:f:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': link = strtoul(optarg, NULL, 10); break;
+            case 's': speed = strtod(optarg, NULL); break;
+            case 'o': output_path = optarg; break;
+            case 'b': building_count = strtoul(optarg, NULL, 10); break;
+            case 'c': cars_per_building = strtoul(optarg, NULL, 10); break;
+            case 'f': floor_count = strtoul(optarg, NULL, 10); break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || link > UINT16_MAX || speed < 0 || !building_count || building_count > UINT8_MAX ||
+        !cars_per_building || building_count * cars_per_building > UINT16_MAX || !floor_count || floor_count > UINT8_MAX)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    capture_t capture;
+    if (!open_capture(&capture, argv[optind]))
+    {
+        fprintf(stderr, "Could not read the capture %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    replay_output.file = NULL;
+    if (output_path != NULL && !create_capture(&replay_output, output_path))
+    {
+        fprintf(stderr, "Could not create the capture %s\n", output_path);
+        close_capture(&capture);
+        return EXIT_FAILURE;
+    }
+
+    // Set up the elevator subsystem like the captured unit
+    if (!init_task_scheduler(replay_rx_cb, replay_tx_cb, replay_clock))
+    {
+        fprintf(stderr, "Could not initialize the scheduler\n");
+        close_capture(&capture);
+        close_capture(&replay_output);
+        return EXIT_FAILURE;
+    }
+
+    if (replay_output.file != NULL)
+    {
+        set_capture_callback(capture_replay_frame);
+    }
+
+    std::vector<uint16_t> building_cars(building_count, (uint16_t) cars_per_building);
+    std::vector<std::vector<char> > floor_name_bufs(floor_count, std::vector<char>(4));
+    std::vector<const char *> floor_names(floor_count);
+
+    for (uint8_t i = 0; i < floor_count; i++)
+    {
+        snprintf(floor_name_bufs[i].data(), 4, "%u", i + 1);
+        floor_names[i] = floor_name_bufs[i].data();
+    }
+
+    init_device_trackers(1);
+    register_platform("elevator_system");
+    init_building_elevators(building_cars.data(), building_count, replay_clock);
+
+    for (uint16_t i = 0; i < get_elevator_count(); i++)
+    {
+        set_elevator_attrs(i, floor_names.data(), floor_count, ELEVATOR_MAX_TEMP, ELEVATOR_MIN_TEMP, ELEVATOR_CAPACITY, ELEVATOR_MAX_WEIGHT);
+    }
+    alert_setup_completion();
+
+    // Feed the frames the computer sent through the chosen link
+    capture_frame_t frame;
+    bool is_first_frame = true;
+    uint64_t first_time_us = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    while (read_capture_frame(&capture, &frame))
+    {
+        if (frame.link != link || frame.direction != CAPTURE_TO_MCU)
+        {
+            continue;
+        }
+
+        if (is_first_frame)
+        {
+            first_time_us = frame.time_us;
+            is_first_frame = false;
+        }
+
+        uint64_t frame_time_us = (frame.time_us > first_time_us)? frame.time_us - first_time_us: 0;
+
+        if (speed > 0)
+        {
+            std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t) (frame_time_us / speed)));
+        }
+
+        run_mcu_until(frame_time_us / US_PER_MS);
+
+        for (uint16_t i = 0; i < frame.size; i++)
+        {
+            build_rx_task_pkt(frame.frame[i]);
+        }
+        build_rx_task_pkt(0);
+
+        replay_stats.rx_frames++;
+        replay_stats.rx_bytes += frame.size + 1;
+
+        run_mcu();
+    }
+
+    std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start;
+
+    printf("virtual time:  %lu ms\n", replay_time);
+    printf("wall time:     %.3f s\n", wall_time.count());
+    printf("rx frames:     %lu\n", replay_stats.rx_frames);
+    printf("rx bytes:      %lu\n", replay_stats.rx_bytes);
+    printf("tx frames:     %lu\n", replay_stats.tx_frames);
+    printf("steps:         %lu\n", replay_stats.steps);
+    printf("frames/s:      %.0f\n", (wall_time.count() > 0)? replay_stats.rx_frames / wall_time.count(): 0.0);
+
+    set_capture_callback(NULL);
+    deinit_devices();
+    deinit_task_scheduler();
+    close_capture(&capture);
+    close_capture(&replay_output);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Private replay functions */
+
+static void print_usage(const char * prog)
+{
+    fprintf(stderr, "usage: %s [--link N] [--speed X] [--output CAPTURE] [--buildings N] [--cars PER_BUILDING] [--floors N] CAPTURE\n", prog);
+}
+
+
+// Run the loop of the MCU once
+static void run_mcu(void)
+{
+    send_task();
+    run_elevators();
+    replay_stats.steps++;
+}
+
+
+// Run the MCU at the times its elevators have something to do, up to the given time
+static void run_mcu_until(unsigned long end_time)
+{
+    while (replay_time < end_time)
+    {
+        unsigned long next_deadline = replay_time;
+
+        for (uint8_t i = 0; i < REPLAY_MAX_STEPS_PER_TIME && next_deadline <= replay_time; i++)
+        {
+            run_mcu();
+            next_deadline = get_next_elevator_deadline();
+        }
+
+        // Move the clock forward even if an elevator keeps asking to run
+        if (next_deadline <= replay_time)
+        {
+            next_deadline = replay_time + 1;
+        }
+
+        replay_time = (next_deadline < end_time)? next_deadline: end_time;
+    }
+}
+
+
+// The virtual clock given to the scheduler and the elevators
+static unsigned long replay_clock(void)
+{
+    return replay_time;
+}
+
+
+// Count the frames the MCU sends back (they have nowhere to go)
+static void replay_tx_cb(uint8_t *, uint8_t)
+{
+    replay_stats.tx_frames++;
+}
+
+
+// Run the tasks the same way the Arduino's serial rx callback does
+static uint8_t replay_rx_cb(uint8_t id, task_t task, uint8_t * pkt)
+{
+    switch (id)
+    {
+        // Elevator tasks
+        case ENTER_ELEVATOR:
+        case REQUEST_ELEVATOR:
+        {
+            uint16_t car_index = unpack_device_id(&pkt[CAR_INDEX_OFFSET]);
+
+            if (car_index < get_elevator_count())
+            {
+                ((elevator_task_t) task)(car_index, &pkt[CAR_PAYLOAD_OFFSET]);
+                return 0;
+            }
+            return INVALID_CAR_INDEX;
+        }
+    }
+
+    ((set_dev_attr_cb) task)(pkt);
+    return 0;
+}
+
+
+// Record the frames of the replay, so two replays can be compared
+static void capture_replay_frame(bool is_tx, const uint8_t * frame, uint8_t frame_size)
+{
+    write_capture_frame(&replay_output, (uint64_t) replay_time * US_PER_MS, 0, is_tx? CAPTURE_FROM_MCU: CAPTURE_TO_MCU, frame, frame_size);
+}
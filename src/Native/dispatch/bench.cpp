@@ -0,0 +1,181 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "elevator.h"
+#include "dispatch.h"
+#include "sim/traffic.h"
+
+
+/* Benchmark constants */
+
+#define DEFAULT_SEED   1
+#define DEFAULT_CARS   4000
+#define DEFAULT_GROUPS 4
+#define DEFAULT_FLOORS 60
+#define DEFAULT_CALLS  100000
+
+
+/* Main function */
+
+/**Measure the hall call assignment latency of the dispatch engine
+ *
+ * The cars are spread across the groups, and every assignment is
+ * followed by a random car event, so the indexes keep changing like
+ * they do with a running system. The hall calls are made from random
+ * landings, or from the floors of the people of a scenario file (the
+ * people of a building call the cars of a group).
+ *
+ * The max latency also counts the time the thread spent preempted,
+ * which is what the rare millisecond outliers are on a busy machine.
+ * The percentiles and the max CPU time of a call are shown as well,
+ * so the cost of the engine itself can be told apart from that.
+ */
+int main(int argc, char * argv[])
+{
+    unsigned long seed = DEFAULT_SEED;
+    unsigned long car_count = DEFAULT_CARS;
+    unsigned long group_count = DEFAULT_GROUPS;
+    unsigned long floor_count = DEFAULT_FLOORS;
+    unsigned long call_count = DEFAULT_CALLS;
+    const char * scenario_path = NULL;
+
+    static const struct option long_opts[] = {
+        {"seed",   required_argument, NULL, 's'},
+        {"cars",   required_argument, NULL, 'c'},
+        {"groups", required_argument, NULL, 'g'},
+        {"floors", required_argument, NULL, 'f'},
+        {"calls",  required_argument, NULL, 'n'},
+        {"scenario", required_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:c:g:f:n:o:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            case 'c': car_count = strtoul(optarg, NULL, 10); break;
+            case 'g': group_count = strtoul(optarg, NULL, 10); break;
+            case 'f': floor_count = strtoul(optarg, NULL, 10); break;
+            case 'n': call_count = strtoul(optarg, NULL, 10); break;
+            case 'o': scenario_path = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [--seed N] [--cars N] [--groups N] [--floors N] [--calls N] [--scenario FILE]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (!car_count || car_count > UINT16_MAX || !group_count || group_count > UINT8_MAX || !floor_count || floor_count > UINT8_MAX)
+    {
+        fprintf(stderr, "usage: %s [--seed N] [--cars N] [--groups N] [--floors N] [--calls N] [--scenario FILE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<traffic_person_t> people;
+    if (scenario_path != NULL)
+    {
+        traffic_config_t traffic;
+        uint32_t duration;
+
+        if (!read_scenario(scenario_path, &traffic, &duration, people) || people.empty())
+        {
+            fprintf(stderr, "Could not read the scenario %s\n", scenario_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    dispatch_engine_t * engine = create_dispatch_engine();
+    if (engine == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> floors(1, floor_count);
+    std::uniform_int_distribution<int> moves(STOP, UP);
+    std::uniform_int_distribution<unsigned long> cars(0, car_count - 1);
+
+    // Every car serves every landing of its group
+    std::vector<uint8_t> landings(floor_count);
+    for (unsigned long i = 0; i < floor_count; i++)
+    {
+        landings[i] = i + 1;
+    }
+
+    for (unsigned long i = 0; i < car_count; i++)
+    {
+        add_dispatch_car(engine, i, i % group_count, landings.data(), floor_count);
+        set_dispatch_car_state(engine, i, floors(rng), floors(rng), moves(rng), true);
+    }
+
+    double total_time = 0, max_time = 0, max_cpu_time = 0;
+    unsigned long unassigned = 0;
+    std::vector<double> times;
+
+    times.reserve(call_count);
+
+    for (unsigned long i = 0; i < call_count; i++)
+    {
+        uint8_t group_id = i % group_count;
+        uint8_t landing;
+
+        if (!people.empty())
+        {
+            const traffic_person_t & person = people[i % people.size()];
+
+            group_id = person.building % group_count;
+            landing = (person.origin <= floor_count)? person.origin: floor_count;
+        }
+        else
+        {
+            landing = floors(rng);
+        }
+
+        struct timespec cpu_start, cpu_end;
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int32_t car_id = assign_hall_call(engine, group_id, landing);
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+
+        double cpu_time = (cpu_end.tv_sec - cpu_start.tv_sec) * 1e6 + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e3;
+
+        total_time += elapsed.count();
+        max_time = (elapsed.count() > max_time)? elapsed.count(): max_time;
+        max_cpu_time = (cpu_time > max_cpu_time)? cpu_time: max_cpu_time;
+        times.push_back(elapsed.count());
+        unassigned += (car_id == DISPATCH_NO_CAR);
+
+        // Move a random car around
+        uint16_t moved_car = cars(rng);
+        uint8_t floor = floors(rng);
+
+        alert_dispatch_arrival(engine, moved_car, floor);
+        set_dispatch_car_state(engine, moved_car, floor, floors(rng), moves(rng), true);
+    }
+
+    printf("cars:          %lu\n", car_count);
+    printf("groups:        %lu\n", group_count);
+    printf("hall calls:    %lu\n", call_count);
+    printf("unassigned:    %lu\n", unassigned);
+    printf("mean latency:  %.2f us\n", call_count? total_time / call_count: 0.0);
+    std::sort(times.begin(), times.end());
+
+    printf("p99 latency:   %.2f us\n", times.empty()? 0.0: times[times.size() * 99 / 100]);
+    printf("p99.9 latency: %.2f us\n", times.empty()? 0.0: times[times.size() * 999 / 1000]);
+    printf("max latency:   %.2f us\n", max_time);
+    printf("max cpu time:  %.2f us\n", max_cpu_time);
+
+    deinit_dispatch_engine(engine);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,543 @@
+#include <set>
+#include <new>
+#include <vector>
+#include <utility>
+
+#include "elevator.h"
+#include "dispatch.h"
+
+
+/* Dispatch constants */
+
+#define MOVEMENT_CNT 3     // Amount of movement types (STOP, DOWN and UP)
+#define NOT_INDEXED  0xFF  // Movement index of a car that is not available
+
+
+/* Dispatch objects */
+
+// A car as seen by the dispatch engine
+typedef struct
+{
+    bool registered;                      // Indicates the car was added to the engine
+    bool available;                       // Indicates the car can take hall calls
+    uint8_t group_id;                     // Group the car belongs to
+    uint8_t landing;                      // Landing the car is currently at
+    uint8_t next_landing;                 // Landing the car is moving to (0 if there's none)
+    uint8_t move;                         // Current movement of the car
+    uint8_t indexed_move;                 // Movement index the car is currently stored in
+    uint16_t weight;                      // Current load of the car
+    uint16_t stop_count;                  // Amount of hall calls the car has committed to
+    car_motion_t motion;                  // Speed, acceleration and dwell of the car
+    std::vector<uint32_t> travel_times;   // Time the car takes to go from a stop to a stop some landings away (ms)
+    std::vector<uint32_t> arrivals;       // Estimated arrival at each landing (ms), empty until they're worked out again
+    std::vector<uint8_t> floor_landings;  // Landing of each of the car's floors (index 0 is floor 1)
+    std::vector<uint8_t> landing_floors;  // Floor of the car at each landing (0 if the car doesn't stop there)
+    std::vector<bool> committed;          // Landings the car has committed to stop at
+
+} dispatch_car_t;
+
+
+// Cars of a group indexed by (landing, car id), one index per movement type
+typedef std::set<std::pair<uint8_t, uint16_t> > car_index_t;
+
+typedef struct
+{
+    car_index_t cars[MOVEMENT_CNT];
+    std::vector<uint32_t> travel_times;  // Lowest time a car of the group takes to go some landings away (no car can beat it)
+
+} dispatch_group_t;
+
+
+struct dispatch_engine
+{
+    std::vector<dispatch_car_t> cars;      // Cars indexed by their id
+    std::vector<dispatch_group_t> groups;  // Groups indexed by their id
+};
+
+
+/* Dispatch function prototypes */
+
+static void index_car(dispatch_engine_t * engine, uint16_t car_id);
+static void unindex_car(dispatch_engine_t * engine, uint16_t car_id);
+static dispatch_car_t * get_dispatch_car(dispatch_engine_t * engine, uint16_t car_id);
+static uint8_t get_floor_landing(const dispatch_car_t * car, uint8_t floor);
+static uint32_t find_car_cost(dispatch_car_t * car, uint8_t landing);
+static uint32_t estimate_car_arrival(dispatch_car_t * car, uint8_t landing);
+static void time_car_arrivals(dispatch_car_t * car);
+static uint64_t time_car_pass(dispatch_car_t * car, uint8_t origin, uint8_t move, uint8_t * stop, uint64_t departure);
+static void time_car_travel(dispatch_engine_t * engine, dispatch_car_t * car);
+static void search_car_index(dispatch_engine_t * engine, const dispatch_group_t * group, uint8_t move, uint8_t landing, int32_t * best_car, uint32_t * best_cost);
+
+// Distance between two landings
+#define landing_distance(a, b) (((a) > (b))? (a) - (b): (b) - (a))
+
+// Lowest time a car of a group takes to go some landings away (no car goes further than its landings)
+#define get_group_travel_time(group, distance) (((size_t) (distance) < (group)->travel_times.size())? (group)->travel_times[distance]: UINT32_MAX)
+
+
+/* Public dispatch functions */
+
+// Create an empty dispatch engine
+dispatch_engine_t * create_dispatch_engine(void)
+{
+    return new (std::nothrow) dispatch_engine;
+}
+
+
+// Uninitialize a dispatch engine
+void deinit_dispatch_engine(dispatch_engine_t * engine)
+{
+    delete engine;
+}
+
+
+/**Add a car to the engine
+ *
+ * The landings of the car's floors are given in the car's floor
+ * order. The car can't take hall calls until its state is given
+ * with set_dispatch_car_state.
+ */
+bool add_dispatch_car(dispatch_engine_t * engine, uint16_t car_id, uint8_t group_id, const uint8_t * floor_landings, uint8_t floor_count)
+{
+    if (engine == NULL || floor_count == 0)
+    {
+        return false;
+    }
+
+    if (car_id >= engine->cars.size())
+    {
+        engine->cars.resize(car_id + 1);
+    }
+    if (group_id >= engine->groups.size())
+    {
+        engine->groups.resize(group_id + 1);
+    }
+
+    unindex_car(engine, car_id);
+
+    dispatch_car_t * car = &engine->cars[car_id];
+    uint8_t landing_count = 0;
+    const car_motion_t default_motion = DEFAULT_CAR_MOTION;
+
+    for (uint8_t i = 0; i < floor_count; i++)
+    {
+        landing_count = (floor_landings[i] > landing_count)? floor_landings[i]: landing_count;
+    }
+
+    car->registered = true;
+    car->available = false;
+    car->group_id = group_id;
+    car->landing = floor_landings[0];
+    car->next_landing = 0;
+    car->move = STOP;
+    car->indexed_move = NOT_INDEXED;
+    car->weight = 0;
+    car->stop_count = 0;
+    car->motion = default_motion;
+    car->floor_landings.assign(floor_landings, floor_landings + floor_count);
+    car->landing_floors.assign(landing_count + 1, NULL_FLOOR);
+    car->committed.assign(landing_count + 1, false);
+    car->arrivals.clear();
+
+    for (uint8_t i = 0; i < floor_count; i++)
+    {
+        car->landing_floors[floor_landings[i]] = i + 1;
+    }
+
+    time_car_travel(engine, car);
+
+    return true;
+}
+
+
+/**Update the state of a car
+ *
+ * This takes the values the car reports to the computer (its floor,
+ * the next floor and its movement). Cars that are not available (full,
+ * in an emergency or in maintenance) are taken out of the indexes.
+ */
+void set_dispatch_car_state(dispatch_engine_t * engine, uint16_t car_id, uint8_t floor, uint8_t next_floor, uint8_t move, bool available)
+{
+    dispatch_car_t * car = get_dispatch_car(engine, car_id);
+
+    if (car != NULL)
+    {
+        unindex_car(engine, car_id);
+
+        car->landing = get_floor_landing(car, floor);
+        car->next_landing = (next_floor)? get_floor_landing(car, next_floor): 0;
+        car->arrivals.clear();
+        car->move = (move < MOVEMENT_CNT)? move: (uint8_t) STOP;
+        car->available = available;
+
+        index_car(engine, car_id);
+    }
+}
+
+
+// Update the load of a car
+void set_dispatch_car_load(dispatch_engine_t * engine, uint16_t car_id, uint16_t weight)
+{
+    dispatch_car_t * car = get_dispatch_car(engine, car_id);
+
+    if (car != NULL)
+    {
+        car->weight = weight;
+    }
+}
+
+
+// Give a car its own motion (cars take the default motion of the elevators until then)
+bool set_dispatch_car_motion(dispatch_engine_t * engine, uint16_t car_id, uint16_t speed, uint16_t accel, uint16_t floor_height, uint16_t dwell)
+{
+    dispatch_car_t * car = get_dispatch_car(engine, car_id);
+
+    if (car == NULL || !speed || !accel)
+    {
+        return false;
+    }
+
+    car->motion.speed = speed;
+    car->motion.accel = accel;
+    car->motion.floor_height = floor_height;
+    car->motion.dwell = dwell;
+    car->arrivals.clear();
+    time_car_travel(engine, car);
+
+    return true;
+}
+
+
+// A car reached a floor, so the stop it committed to there was served
+void alert_dispatch_arrival(dispatch_engine_t * engine, uint16_t car_id, uint8_t floor)
+{
+    dispatch_car_t * car = get_dispatch_car(engine, car_id);
+
+    if (car != NULL)
+    {
+        unindex_car(engine, car_id);
+
+        car->landing = get_floor_landing(car, floor);
+        car->arrivals.clear();
+        if (car->committed[car->landing])
+        {
+            car->committed[car->landing] = false;
+            car->stop_count--;
+        }
+
+        if (car->next_landing == car->landing)
+        {
+            car->next_landing = 0;
+            car->move = STOP;
+        }
+
+        index_car(engine, car_id);
+    }
+}
+
+
+// A car left a floor to go to its next floor
+void alert_dispatch_departure(dispatch_engine_t * engine, uint16_t car_id, uint8_t floor)
+{
+    dispatch_car_t * car = get_dispatch_car(engine, car_id);
+
+    if (car != NULL)
+    {
+        unindex_car(engine, car_id);
+
+        car->landing = get_floor_landing(car, floor);
+        car->arrivals.clear();
+        if (car->next_landing && car->next_landing != car->landing)
+        {
+            car->move = (car->next_landing > car->landing)? UP: DOWN;
+        }
+
+        index_car(engine, car_id);
+    }
+}
+
+
+// Estimate the time a car takes to reach a landing (ms)
+uint32_t estimate_dispatch_arrival(dispatch_engine_t * engine, uint16_t car_id, uint8_t landing)
+{
+    dispatch_car_t * car = get_dispatch_car(engine, car_id);
+
+    if (car == NULL || landing >= car->landing_floors.size() || car->landing_floors[landing] == NULL_FLOOR)
+    {
+        return DISPATCH_NO_ARRIVAL;
+    }
+    return estimate_car_arrival(car, landing);
+}
+
+
+/**Find the car that can serve a hall call at the lowest cost
+ *
+ * The indexes are walked outwards from the hall call's landing. The
+ * cost of a car is never lower than the time it takes to cross the
+ * distance to the landing at the top speed of the group's fastest
+ * car, so a walk stops as soon as the distance alone can't beat the
+ * best car found.
+ */
+int32_t find_dispatch_car(dispatch_engine_t * engine, uint8_t group_id, uint8_t landing, uint32_t * cost)
+{
+    int32_t best_car = DISPATCH_NO_CAR;
+    uint32_t best_cost = UINT32_MAX;
+
+    if (engine != NULL && group_id < engine->groups.size())
+    {
+        dispatch_group_t * group = &engine->groups[group_id];
+
+        for (uint8_t move = 0; move < MOVEMENT_CNT; move++)
+        {
+            search_car_index(engine, group, move, landing, &best_car, &best_cost);
+        }
+    }
+
+    if (cost != NULL)
+    {
+        *cost = best_cost;
+    }
+
+    return best_car;
+}
+
+
+// Make a car commit to stop at a landing
+void commit_dispatch_stop(dispatch_engine_t * engine, uint16_t car_id, uint8_t landing)
+{
+    dispatch_car_t * car = get_dispatch_car(engine, car_id);
+
+    if (car != NULL && landing < car->committed.size() && !car->committed[landing])
+    {
+        car->committed[landing] = true;
+        car->stop_count++;
+        car->arrivals.clear();
+    }
+}
+
+
+// Find the best car for a hall call and commit it to the call
+int32_t assign_hall_call(dispatch_engine_t * engine, uint8_t group_id, uint8_t landing)
+{
+    int32_t car_id = find_dispatch_car(engine, group_id, landing, NULL);
+
+    if (car_id != DISPATCH_NO_CAR)
+    {
+        commit_dispatch_stop(engine, car_id, landing);
+    }
+
+    return car_id;
+}
+
+
+/* Private dispatch functions */
+
+// Fetch a registered car from the engine
+static dispatch_car_t * get_dispatch_car(dispatch_engine_t * engine, uint16_t car_id)
+{
+    if (engine != NULL && car_id < engine->cars.size() && engine->cars[car_id].registered)
+    {
+        return &engine->cars[car_id];
+    }
+    return NULL;
+}
+
+
+// Get the landing of a car's floor (cars with an unknown floor are placed at their lowest floor)
+static uint8_t get_floor_landing(const dispatch_car_t * car, uint8_t floor)
+{
+    if (floor == NULL_FLOOR || floor > car->floor_landings.size())
+    {
+        return car->floor_landings[0];
+    }
+    return car->floor_landings[floor - 1];
+}
+
+
+// Place a car in the index of its group that corresponds to its movement
+static void index_car(dispatch_engine_t * engine, uint16_t car_id)
+{
+    dispatch_car_t * car = &engine->cars[car_id];
+
+    if (car->available)
+    {
+        car->indexed_move = car->move;
+        engine->groups[car->group_id].cars[car->move].insert(std::make_pair(car->landing, car_id));
+    }
+}
+
+
+// Take a car out of the indexes of its group
+static void unindex_car(dispatch_engine_t * engine, uint16_t car_id)
+{
+    if (car_id < engine->cars.size())
+    {
+        dispatch_car_t * car = &engine->cars[car_id];
+
+        if (car->registered && car->indexed_move != NOT_INDEXED)
+        {
+            engine->groups[car->group_id].cars[car->indexed_move].erase(std::make_pair(car->landing, car_id));
+            car->indexed_move = NOT_INDEXED;
+        }
+    }
+}
+
+
+// Find the cost for a car to serve a hall call
+static uint32_t find_car_cost(dispatch_car_t * car, uint8_t landing)
+{
+    if (landing >= car->landing_floors.size() || car->landing_floors[landing] == NULL_FLOOR)
+    {
+        return UINT32_MAX;  // The car doesn't stop at this landing
+    }
+
+    uint32_t arrival = estimate_car_arrival(car, landing);
+    uint32_t load_cost = (uint32_t) (car->weight / DISPATCH_LOAD_UNIT) * DISPATCH_LOAD_COST;
+
+    return (arrival < UINT32_MAX - load_cost)? arrival + load_cost: UINT32_MAX;
+}
+
+
+// Estimate the time a car takes to reach a landing (ms), timing all of its landings if it changed since the last estimate
+static uint32_t estimate_car_arrival(dispatch_car_t * car, uint8_t landing)
+{
+    if (car->arrivals.empty())
+    {
+        time_car_arrivals(car);
+    }
+    return car->arrivals[landing];
+}
+
+
+/**Estimate the time a car takes to reach each landing (ms)
+ *
+ * The car ends its run at its next landing, and then it serves the
+ * landings it committed to the same way the elevators pick their next
+ * floors: first the ones in its direction and then the ones behind it,
+ * stopping at each one for its dwell time. An idle car goes straight
+ * towards the landing first. The engine doesn't know how far into its
+ * run a car is, so the run is taken from the landing the car was last
+ * seen at.
+ *
+ * A car changes far less often than it's estimated, so all of its
+ * landings are timed in one sweep and kept until it changes again.
+ */
+static void time_car_arrivals(dispatch_car_t * car)
+{
+    uint8_t stop = car->landing;
+
+    car->arrivals.assign(car->committed.size(), DISPATCH_NO_ARRIVAL);
+
+    if (car->next_landing && car->next_landing != stop)
+    {
+        uint8_t move = (car->next_landing > stop)? UP: DOWN;
+        uint64_t departure = car->travel_times[landing_distance(stop, car->next_landing)];
+
+        stop = car->next_landing;
+        car->arrivals[stop] = departure;
+
+        departure = time_car_pass(car, car->next_landing, move, &stop, departure + car->motion.dwell);
+        time_car_pass(car, car->next_landing, (move == UP)? DOWN: UP, &stop, departure);
+    }
+    else
+    {
+        car->arrivals[stop] = 0;
+        time_car_pass(car, car->landing, UP, &stop, 0);
+
+        stop = car->landing;
+        time_car_pass(car, car->landing, DOWN, &stop, 0);
+    }
+}
+
+
+// Time the landings past an origin in a direction, stopping at the committed ones (the time the car leaves its last stop is given out)
+static uint64_t time_car_pass(dispatch_car_t * car, uint8_t origin, uint8_t move, uint8_t * stop, uint64_t departure)
+{
+    int8_t step = (move == UP)? 1: -1;
+
+    for (uint8_t landing = origin + step; landing > 0 && landing < car->arrivals.size(); landing += step)
+    {
+        uint64_t arrival = departure + car->travel_times[landing_distance(*stop, landing)];
+
+        car->arrivals[landing] = (arrival < DISPATCH_NO_ARRIVAL)? arrival: DISPATCH_NO_ARRIVAL;
+        if (car->committed[landing])
+        {
+            departure = arrival + car->motion.dwell;
+            *stop = landing;
+        }
+    }
+
+    return departure;
+}
+
+
+/**Time the runs of a car from its motion
+ *
+ * A run only depends on the amount of landings it goes through, so the
+ * times are worked out once instead of on every estimate. The group
+ * keeps the lowest time any of its cars takes for each distance, which
+ * bounds the cars worth estimating (a slower car leaves the bound
+ * lower than it could be).
+ */
+static void time_car_travel(dispatch_engine_t * engine, dispatch_car_t * car)
+{
+    dispatch_group_t * group = &engine->groups[car->group_id];
+
+    car->travel_times.resize(car->committed.size());
+    if (group->travel_times.size() < car->travel_times.size())
+    {
+        group->travel_times.resize(car->travel_times.size(), UINT32_MAX);
+    }
+
+    for (size_t distance = 0; distance < car->travel_times.size(); distance++)
+    {
+        unsigned long travel_time = get_travel_time(&car->motion, distance);
+
+        car->travel_times[distance] = (travel_time < UINT32_MAX)? travel_time: UINT32_MAX;
+        if (car->travel_times[distance] < group->travel_times[distance])
+        {
+            group->travel_times[distance] = car->travel_times[distance];
+        }
+    }
+}
+
+
+// Walk an index outwards from a landing while its cars can beat the best cost
+static void search_car_index(dispatch_engine_t * engine, const dispatch_group_t * group, uint8_t move, uint8_t landing, int32_t * best_car, uint32_t * best_cost)
+{
+    const car_index_t * index = &group->cars[move];
+
+    car_index_t::const_iterator split = index->lower_bound(std::make_pair(landing, (uint16_t) 0));
+
+    // Cars at or above the landing
+    for (car_index_t::const_iterator it = split; it != index->end(); ++it)
+    {
+        if (get_group_travel_time(group, landing_distance(it->first, landing)) >= *best_cost)
+        {
+            break;
+        }
+
+        uint32_t cost = find_car_cost(&engine->cars[it->second], landing);
+        if (cost < *best_cost)
+        {
+            *best_cost = cost;
+            *best_car = it->second;
+        }
+    }
+
+    // Cars below the landing
+    for (car_index_t::const_reverse_iterator it(split); it != index->rend(); ++it)
+    {
+        if (get_group_travel_time(group, landing_distance(it->first, landing)) >= *best_cost)
+        {
+            break;
+        }
+
+        uint32_t cost = find_car_cost(&engine->cars[it->second], landing);
+        if (cost < *best_cost)
+        {
+            *best_cost = cost;
+            *best_car = it->second;
+        }
+    }
+}
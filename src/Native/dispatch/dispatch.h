@@ -0,0 +1,69 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <stdint.h>
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Dispatch constants */
+
+#define DISPATCH_NO_CAR     -1          // Returned when no car can take a hall call
+#define DISPATCH_NO_ARRIVAL UINT32_MAX  // Returned when a car can't reach a landing
+
+// Cost function weights (the cost of a car is the time it takes to reach the hall call in ms)
+
+#define DISPATCH_LOAD_COST   1500  // Time added for every DISPATCH_LOAD_UNIT of weight in the car (loaded cars take longer to board)
+#define DISPATCH_LOAD_UNIT   100
+
+
+/**Dispatch engine object
+ *
+ * The engine keeps the cars of each group (building) indexed by
+ * their direction and their landing, so a hall call only looks at
+ * the cars that can possibly beat the best cost found so far.
+ *
+ * Landings are the floors of a group in height order, starting from
+ * 1. Since each car names and numbers its floors on its own, every
+ * car is registered with the landing each of its floors is at.
+ *
+ * The cars are compared by the time they take to reach a hall call,
+ * which the engine estimates with the same motion model the elevators
+ * move with (src/Arduino/elevator/motion.h).
+ */
+typedef struct dispatch_engine dispatch_engine_t;
+
+
+/* Dispatch methods */
+
+dispatch_engine_t * create_dispatch_engine(void);
+void deinit_dispatch_engine(dispatch_engine_t * engine);
+
+bool add_dispatch_car(dispatch_engine_t * engine, uint16_t car_id, uint8_t group_id, const uint8_t * floor_landings, uint8_t floor_count);
+void set_dispatch_car_state(dispatch_engine_t * engine, uint16_t car_id, uint8_t floor, uint8_t next_floor, uint8_t move, bool available);
+void set_dispatch_car_load(dispatch_engine_t * engine, uint16_t car_id, uint16_t weight);
+bool set_dispatch_car_motion(dispatch_engine_t * engine, uint16_t car_id, uint16_t speed, uint16_t accel, uint16_t floor_height, uint16_t dwell);
+
+// Car events
+
+void alert_dispatch_arrival(dispatch_engine_t * engine, uint16_t car_id, uint8_t floor);
+void alert_dispatch_departure(dispatch_engine_t * engine, uint16_t car_id, uint8_t floor);
+
+// Hall call assignment
+
+uint32_t estimate_dispatch_arrival(dispatch_engine_t * engine, uint16_t car_id, uint8_t landing);
+int32_t find_dispatch_car(dispatch_engine_t * engine, uint8_t group_id, uint8_t landing, uint32_t * cost);
+void commit_dispatch_stop(dispatch_engine_t * engine, uint16_t car_id, uint8_t landing);
+int32_t assign_hall_call(dispatch_engine_t * engine, uint8_t group_id, uint8_t landing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
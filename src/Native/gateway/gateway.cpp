@@ -0,0 +1,805 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+#include <new>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <cobs/cobs.h>
+#include <devices.h>
+#include <serial_pkt/serial_pkt.h>
+
+#include "gateway.h"
+#include "capture/capture.h"
+#include "snapshot/snapshot.h"
+#include "telemetry/telemetry.h"
+
+
+/* Gateway constants */
+
+#define NO_FD -1
+#define EPOLL_BATCH_SIZE 64  // Events taken from epoll at once
+
+// Offsets in the payload of an attribute update sent to the computer
+#define ATTR_TRACKER_OFFSET 0
+#define ATTR_DEVICE_OFFSET  1
+#define ATTR_ID_OFFSET      (ATTR_DEVICE_OFFSET + DEVICE_ID_SIZE)
+#define ATTR_TYPE_OFFSET    (ATTR_ID_OFFSET + 1)
+#define ATTR_VALUE_OFFSET   (ATTR_TYPE_OFFSET + 1)
+
+// Kinds of file descriptors watched by the epoll loop
+enum gateway_fd_kind
+{
+    LISTEN_FD,
+    SIGNAL_FD,
+    TTY_FD,
+    TIMER_FD,
+    CLIENT_FD,
+    PENDING_FD,  // Client that hasn't attached to a link yet
+};
+
+
+/* Gateway objects */
+
+// A serial link to an MCU
+typedef struct
+{
+    std::string path;              // Device path of the link
+    int tty_fd;                    // Serial link (NO_FD once the link was closed)
+    int timer_fd;                  // Ticks the client while it has tasks waiting for a reply
+    int client_fd;                 // Client attached to the link (NO_FD if there's none)
+    bool is_little_endian;         // Byte order of the link's MCU (given by its client)
+    serial_pkt_t rx_pkt;           // Frame being built from the incoming bytes
+    std::vector<uint8_t> tx_buf;   // Bytes the link couldn't take yet
+    std::unordered_map<uint32_t, int32_t> snapshot_devices;  // Snapshot record of each device of the link (by tracker and device id)
+
+} gateway_link_t;
+
+
+struct gateway
+{
+    int epoll_fd;
+    int listen_fd;
+    int signal_fd;
+    std::string socket_path;
+    std::vector<gateway_link_t> links;
+    std::vector<int> pending_fds;  // Clients that haven't attached to a link
+    capture_t capture;             // Records the frames of every link (if a capture was requested)
+    snapshot_t snapshot;           // Publishes the attributes of every device (if a snapshot was requested)
+    telemetry_t telemetry;         // Logs every attribute update (if a telemetry log was requested)
+};
+
+
+/* Gateway function prototypes */
+
+static int open_tty(const char * path, unsigned long baudrate);
+static speed_t get_baud_speed(unsigned long baudrate);
+static bool watch_fd(gateway_t * gateway, int fd, uint8_t kind, uint16_t index, uint32_t events);
+static void accept_client(gateway_t * gateway);
+static void attach_client(gateway_t * gateway, int client_fd);
+static void detach_client(gateway_t * gateway, uint16_t link_index);
+static void read_tty(gateway_t * gateway, uint16_t link_index);
+static void flush_tty(gateway_t * gateway, uint16_t link_index);
+static void write_tty(gateway_t * gateway, uint16_t link_index, const uint8_t * bytes, size_t size);
+static void read_timer(gateway_t * gateway, uint16_t link_index);
+static void read_client(gateway_t * gateway, uint16_t link_index);
+static void set_timer(gateway_link_t * link, uint32_t period_ms);
+static bool send_msg(int fd, uint8_t type, const uint8_t * payload, size_t size);
+static void capture_frame(gateway_t * gateway, uint16_t link_index, uint8_t direction, const uint8_t * frame, size_t size);
+static void publish_frame(gateway_t * gateway, uint16_t link_index, const uint8_t * frame, size_t size);
+
+// Pack the kind and the index of a file descriptor in the epoll data
+#define pack_epoll_data(kind, index) (((uint64_t) (kind) << 32) | (index))
+#define get_epoll_kind(data) ((uint8_t) ((data) >> 32))
+#define get_epoll_index(data) ((uint16_t) (data))
+
+// Key of a device in the snapshot records of a link
+#define get_snapshot_key(tracker_id, device_id) (((uint32_t) (tracker_id) << 16) | (device_id))
+
+
+/* Public gateway functions */
+
+/**Create a gateway for a set of serial links
+ *
+ * Every link is opened in raw mode and it's watched by the same epoll
+ * loop as the Unix socket the clients connect to. SIGINT and SIGTERM
+ * are also taken through the loop, so the gateway can clean up after
+ * itself. If a snapshot name is given, the attributes the MCUs report
+ * are published in a shared memory snapshot with room for the given
+ * amount of devices. If a telemetry path is given, every update is
+ * also appended to a telemetry log in segments of the given amount of
+ * events.
+ */
+gateway_t * create_gateway(const char * socket_path, const char * const * tty_paths, uint16_t tty_count, unsigned long baudrate,
+                           const char * capture_path, const char * snapshot_name, uint32_t snapshot_capacity,
+                           const char * telemetry_path, uint32_t telemetry_rows)
+{
+    gateway_t * gateway = new (std::nothrow) gateway_t;
+
+    if (gateway == NULL)
+    {
+        return NULL;
+    }
+
+    gateway->listen_fd = NO_FD;
+    gateway->signal_fd = NO_FD;
+    gateway->socket_path = socket_path;
+    gateway->capture.file = NULL;
+    gateway->snapshot.hdr = NULL;
+    gateway->telemetry.is_open = false;
+    gateway->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (gateway->epoll_fd == NO_FD)
+    {
+        goto failed_gateway;
+    }
+
+    if (capture_path != NULL && !create_capture(&gateway->capture, capture_path))
+    {
+        fprintf(stderr, "Could not create the capture %s: %s\n", capture_path, strerror(errno));
+        goto failed_gateway;
+    }
+
+    if (snapshot_name != NULL && !create_snapshot(&gateway->snapshot, snapshot_name, snapshot_capacity))
+    {
+        fprintf(stderr, "Could not create the snapshot %s: %s\n", snapshot_name, strerror(errno));
+        goto failed_gateway;
+    }
+
+    if (telemetry_path != NULL && !create_telemetry(&gateway->telemetry, telemetry_path, telemetry_rows))
+    {
+        fprintf(stderr, "Could not create the telemetry log %s: %s\n", telemetry_path, strerror(errno));
+        goto failed_gateway;
+    }
+
+    // Mark the links as closed, so a failed setup only closes what was opened
+    gateway->links.resize(tty_count);
+    for (uint16_t i = 0; i < tty_count; i++)
+    {
+        gateway->links[i].tty_fd = NO_FD;
+        gateway->links[i].timer_fd = NO_FD;
+        gateway->links[i].client_fd = NO_FD;
+        gateway->links[i].is_little_endian = true;
+        gateway->links[i].rx_pkt.buf = NULL;
+    }
+
+    // Open the serial links
+    for (uint16_t i = 0; i < tty_count; i++)
+    {
+        gateway_link_t * link = &gateway->links[i];
+
+        link->path = tty_paths[i];
+        link->tty_fd = open_tty(tty_paths[i], baudrate);
+        link->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        link->rx_pkt = init_serial_pkt(MAX_ENCODED_PKT_BUF_SIZE);
+
+        if (link->tty_fd == NO_FD)
+        {
+            fprintf(stderr, "Could not open %s: %s\n", tty_paths[i], strerror(errno));
+            goto failed_gateway;
+        }
+
+        if (link->timer_fd == NO_FD || link->rx_pkt.buf == NULL ||
+            !watch_fd(gateway, link->tty_fd, TTY_FD, i, EPOLLIN) || !watch_fd(gateway, link->timer_fd, TIMER_FD, i, EPOLLIN))
+        {
+            goto failed_gateway;
+        }
+    }
+
+    // Take the termination signals through the loop
+    {
+        sigset_t signals;
+
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigprocmask(SIG_BLOCK, &signals, NULL);
+
+        gateway->signal_fd = signalfd(NO_FD, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (gateway->signal_fd == NO_FD || !watch_fd(gateway, gateway->signal_fd, SIGNAL_FD, 0, EPOLLIN))
+        {
+            goto failed_gateway;
+        }
+    }
+
+    // Listen for clients
+    {
+        struct sockaddr_un addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (gateway->socket_path.size() >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Socket path %s is too long\n", socket_path);
+            goto failed_gateway;
+        }
+        memcpy(addr.sun_path, socket_path, gateway->socket_path.size());
+
+        unlink(socket_path);  // Remove the socket a previous gateway left behind
+        gateway->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (gateway->listen_fd == NO_FD || bind(gateway->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+            listen(gateway->listen_fd, tty_count + 1) || !watch_fd(gateway, gateway->listen_fd, LISTEN_FD, 0, EPOLLIN))
+        {
+            fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+            goto failed_gateway;
+        }
+    }
+
+    return gateway;
+
+    failed_gateway:
+        deinit_gateway(gateway);
+        return NULL;
+}
+
+
+// Uninitialize a gateway
+void deinit_gateway(gateway_t * gateway)
+{
+    if (gateway == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < gateway->links.size(); i++)
+    {
+        gateway_link_t * link = &gateway->links[i];
+
+        if (link->client_fd != NO_FD)
+        {
+            close(link->client_fd);
+        }
+        if (link->timer_fd != NO_FD)
+        {
+            close(link->timer_fd);
+        }
+        if (link->tty_fd != NO_FD)
+        {
+            close(link->tty_fd);
+        }
+        if (link->rx_pkt.buf != NULL)
+        {
+            deinit_serial_pkt(&link->rx_pkt);
+        }
+    }
+
+    for (size_t i = 0; i < gateway->pending_fds.size(); i++)
+    {
+        if (gateway->pending_fds[i] != NO_FD)
+        {
+            close(gateway->pending_fds[i]);
+        }
+    }
+
+    if (gateway->listen_fd != NO_FD)
+    {
+        close(gateway->listen_fd);
+        unlink(gateway->socket_path.c_str());
+    }
+    if (gateway->signal_fd != NO_FD)
+    {
+        close(gateway->signal_fd);
+    }
+    if (gateway->epoll_fd != NO_FD)
+    {
+        close(gateway->epoll_fd);
+    }
+
+    close_capture(&gateway->capture);
+    close_snapshot(&gateway->snapshot);
+    close_telemetry(&gateway->telemetry);
+    delete gateway;
+}
+
+
+/**Run the gateway until it's told to stop
+ *
+ * All the links, timers and clients are served by this loop, so the
+ * gateway only wakes up when one of them has something to do.
+ */
+bool run_gateway(gateway_t * gateway)
+{
+    struct epoll_event events[EPOLL_BATCH_SIZE];
+
+    while (true)
+    {
+        int event_count = epoll_wait(gateway->epoll_fd, events, EPOLL_BATCH_SIZE, -1);
+
+        if (event_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        for (int i = 0; i < event_count; i++)
+        {
+            uint16_t index = get_epoll_index(events[i].data.u64);
+
+            switch (get_epoll_kind(events[i].data.u64))
+            {
+                case LISTEN_FD:
+                    accept_client(gateway);
+                    break;
+
+                case SIGNAL_FD:
+                    return true;
+
+                case TTY_FD:
+                    if (events[i].events & EPOLLOUT)
+                    {
+                        flush_tty(gateway, index);
+                    }
+                    if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                    {
+                        read_tty(gateway, index);
+                    }
+                    break;
+
+                case TIMER_FD:
+                    read_timer(gateway, index);
+                    break;
+
+                case CLIENT_FD:
+                    read_client(gateway, index);
+                    break;
+
+                case PENDING_FD:
+                    attach_client(gateway, gateway->pending_fds[index]);
+                    gateway->pending_fds[index] = NO_FD;
+                    break;
+            }
+        }
+    }
+}
+
+
+/* Private gateway functions */
+
+// Open a serial link in raw mode without blocking
+static int open_tty(const char * path, unsigned long baudrate)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    struct termios attrs;
+
+    if (fd == NO_FD)
+    {
+        return NO_FD;
+    }
+
+    if (tcgetattr(fd, &attrs) == 0)
+    {
+        cfmakeraw(&attrs);
+        attrs.c_cflag |= CLOCAL | CREAD;
+        attrs.c_cc[VMIN] = 1;  // Reads without data fail with EAGAIN instead of returning 0
+        attrs.c_cc[VTIME] = 0;
+        cfsetspeed(&attrs, get_baud_speed(baudrate));
+
+        if (tcsetattr(fd, TCSANOW, &attrs))
+        {
+            close(fd);
+            return NO_FD;
+        }
+    }
+
+    return fd;
+}
+
+
+// Map a baudrate to its termios speed (unknown baudrates use the Arduino's default)
+static speed_t get_baud_speed(unsigned long baudrate)
+{
+    switch (baudrate)
+    {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return B115200;
+    }
+}
+
+
+// Add a file descriptor to the epoll loop
+static bool watch_fd(gateway_t * gateway, int fd, uint8_t kind, uint16_t index, uint32_t events)
+{
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.u64 = pack_epoll_data(kind, index);
+
+    return epoll_ctl(gateway->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+
+// Take the clients that are waiting to connect
+static void accept_client(gateway_t * gateway)
+{
+    int client_fd;
+
+    while ((client_fd = accept4(gateway->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != NO_FD)
+    {
+        // Reuse the slot of a client that already attached or left
+        size_t index = 0;
+        while (index < gateway->pending_fds.size() && gateway->pending_fds[index] != NO_FD)
+        {
+            index++;
+        }
+        if (index == gateway->pending_fds.size())
+        {
+            gateway->pending_fds.push_back(NO_FD);
+        }
+
+        if (index > UINT16_MAX || !watch_fd(gateway, client_fd, PENDING_FD, index, EPOLLIN))
+        {
+            close(client_fd);
+            continue;
+        }
+
+        gateway->pending_fds[index] = client_fd;
+    }
+}
+
+
+/**Attach a client to the link it asks for
+ *
+ * The first message of a client must be an attach message. Clients
+ * that ask for something else, for a link that was closed or for a
+ * link that already has a client, are turned away.
+ */
+static void attach_client(gateway_t * gateway, int client_fd)
+{
+    uint8_t msg[GATEWAY_MAX_MSG_SIZE];
+    ssize_t msg_size = recv(client_fd, msg, sizeof(msg), 0);
+
+    epoll_ctl(gateway->epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
+
+    if (msg_size > 1 && msg[0] == GATEWAY_ATTACH)
+    {
+        std::string path((const char *) &msg[1], msg_size - 1);
+
+        for (uint16_t i = 0; i < gateway->links.size(); i++)
+        {
+            gateway_link_t * link = &gateway->links[i];
+
+            if (link->path == path && link->tty_fd != NO_FD && link->client_fd == NO_FD && watch_fd(gateway, client_fd, CLIENT_FD, i, EPOLLIN))
+            {
+                link->client_fd = client_fd;
+                link->rx_pkt.byte_count = 0;  // Drop the partial frame the link had before the client
+                send_msg(client_fd, GATEWAY_ATTACHED, NULL, 0);
+                return;
+            }
+        }
+    }
+
+    send_msg(client_fd, GATEWAY_ATTACH_FAIL, NULL, 0);
+    close(client_fd);
+}
+
+
+// Free a link from its client
+static void detach_client(gateway_t * gateway, uint16_t link_index)
+{
+    gateway_link_t * link = &gateway->links[link_index];
+
+    epoll_ctl(gateway->epoll_fd, EPOLL_CTL_DEL, link->client_fd, NULL);
+    close(link->client_fd);
+
+    link->client_fd = NO_FD;
+    set_timer(link, 0);
+}
+
+
+/**Read everything a serial link has
+ *
+ * The bytes are framed with the scheduler's packet code. Since the
+ * clients decode and verify the frames themselves, only the frames
+ * that are too short to hold a header are dropped here. The frames
+ * are still published in the snapshot when no client is attached.
+ *
+ * A link that was disconnected is closed for good. Its client is
+ * detached, so the messenger sees its channel close instead of waiting
+ * on a link that will never answer.
+ */
+static void read_tty(gateway_t * gateway, uint16_t link_index)
+{
+    gateway_link_t * link = &gateway->links[link_index];
+    uint8_t bytes[GATEWAY_READ_SIZE];
+    ssize_t byte_count;
+
+    if (link->tty_fd == NO_FD)
+    {
+        return;
+    }
+
+    while ((byte_count = read(link->tty_fd, bytes, sizeof(bytes))) > 0)
+    {
+        for (ssize_t i = 0; i < byte_count; i++)
+        {
+            if (process_incoming_byte(&link->rx_pkt, bytes[i]))
+            {
+                capture_frame(gateway, link_index, CAPTURE_FROM_MCU, link->rx_pkt.buf, link->rx_pkt.byte_count);
+                publish_frame(gateway, link_index, link->rx_pkt.buf, link->rx_pkt.byte_count);
+
+                if (link->client_fd != NO_FD && link->rx_pkt.byte_count >= ENCODED_HDR_SIZE)
+                {
+                    send_msg(link->client_fd, GATEWAY_FRAME, link->rx_pkt.buf, link->rx_pkt.byte_count);
+                }
+                link->rx_pkt.byte_count = 0;
+            }
+        }
+    }
+
+    // Close a link that was disconnected, so the loop doesn't spin on it
+    if (byte_count == 0 || (byte_count < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        fprintf(stderr, "Link %s was closed\n", link->path.c_str());
+        epoll_ctl(gateway->epoll_fd, EPOLL_CTL_DEL, link->tty_fd, NULL);
+        close(link->tty_fd);
+
+        link->tty_fd = NO_FD;
+        link->tx_buf.clear();
+
+        if (link->client_fd != NO_FD)
+        {
+            detach_client(gateway, link_index);
+        }
+    }
+}
+
+
+// Write the bytes a link couldn't take before
+static void flush_tty(gateway_t * gateway, uint16_t link_index)
+{
+    gateway_link_t * link = &gateway->links[link_index];
+
+    if (link->tty_fd == NO_FD)
+    {
+        return;
+    }
+
+    ssize_t written = write(link->tty_fd, link->tx_buf.data(), link->tx_buf.size());
+
+    if (written > 0)
+    {
+        link->tx_buf.erase(link->tx_buf.begin(), link->tx_buf.begin() + written);
+    }
+
+    if (link->tx_buf.empty())
+    {
+        struct epoll_event event;
+
+        event.events = EPOLLIN;
+        event.data.u64 = pack_epoll_data(TTY_FD, link_index);
+        epoll_ctl(gateway->epoll_fd, EPOLL_CTL_MOD, link->tty_fd, &event);
+    }
+}
+
+
+// Write bytes to a link (what it can't take is sent once it's writable, and a closed link takes nothing)
+static void write_tty(gateway_t * gateway, uint16_t link_index, const uint8_t * bytes, size_t size)
+{
+    gateway_link_t * link = &gateway->links[link_index];
+    ssize_t written = 0;
+
+    if (link->tty_fd == NO_FD)
+    {
+        return;
+    }
+
+    if (link->tx_buf.empty())
+    {
+        written = write(link->tty_fd, bytes, size);
+        written = (written < 0)? 0: written;
+    }
+
+    if ((size_t) written < size)
+    {
+        if (link->tx_buf.empty())
+        {
+            struct epoll_event event;
+
+            event.events = EPOLLIN | EPOLLOUT;
+            event.data.u64 = pack_epoll_data(TTY_FD, link_index);
+            epoll_ctl(gateway->epoll_fd, EPOLL_CTL_MOD, link->tty_fd, &event);
+        }
+        link->tx_buf.insert(link->tx_buf.end(), bytes + written, bytes + size);
+    }
+}
+
+
+// Pass the ticks of a link's timer to its client
+static void read_timer(gateway_t * gateway, uint16_t link_index)
+{
+    gateway_link_t * link = &gateway->links[link_index];
+    uint64_t expirations;
+
+    if (read(link->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations) && link->tty_fd != NO_FD && link->client_fd != NO_FD)
+    {
+        send_msg(link->client_fd, GATEWAY_TIMER, NULL, 0);
+    }
+}
+
+
+// Serve the messages of a link's client
+static void read_client(gateway_t * gateway, uint16_t link_index)
+{
+    gateway_link_t * link = &gateway->links[link_index];
+    uint8_t msg[GATEWAY_MAX_MSG_SIZE];
+    ssize_t msg_size;
+
+    // The client might have been detached by an earlier event of the same batch (its link was closed)
+    if (link->client_fd == NO_FD)
+    {
+        return;
+    }
+
+    while ((msg_size = recv(link->client_fd, msg, sizeof(msg), 0)) > 0)
+    {
+        switch (msg[0])
+        {
+            case GATEWAY_FRAME:
+                capture_frame(gateway, link_index, CAPTURE_TO_MCU, &msg[1], (msg_size > 1 && !msg[msg_size - 1])? msg_size - 2: msg_size - 1);
+                write_tty(gateway, link_index, &msg[1], msg_size - 1);
+                break;
+
+            case GATEWAY_SET_TIMER:
+                if (msg_size == 1 + sizeof(uint32_t))
+                {
+                    uint32_t period_ms;
+
+                    memcpy(&period_ms, &msg[1], sizeof(period_ms));
+                    set_timer(link, period_ms);
+                }
+                break;
+
+            case GATEWAY_SET_ENDIAN:
+                if (msg_size == 2)
+                {
+                    link->is_little_endian = msg[1] != 0;
+                }
+                break;
+        }
+    }
+
+    if (msg_size == 0 || (errno != EAGAIN && errno != EINTR))
+    {
+        detach_client(gateway, link_index);
+    }
+}
+
+
+// Make a link's timer tick periodically (a period of 0 stops it)
+static void set_timer(gateway_link_t * link, uint32_t period_ms)
+{
+    struct itimerspec spec;
+
+    spec.it_interval.tv_sec = period_ms / 1000;
+    spec.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+
+    timerfd_settime(link->timer_fd, 0, &spec, NULL);
+}
+
+
+// Send a message to a client
+static bool send_msg(int fd, uint8_t type, const uint8_t * payload, size_t size)
+{
+    uint8_t msg[GATEWAY_MAX_MSG_SIZE];
+
+    if (size + 1 > sizeof(msg))
+    {
+        return false;
+    }
+
+    msg[0] = type;
+    if (size)
+    {
+        memcpy(&msg[1], payload, size);
+    }
+
+    return send(fd, msg, size + 1, MSG_NOSIGNAL) == (ssize_t) (size + 1);
+}
+
+
+// Record a frame of a link with the wall-clock time (if a capture was requested)
+static void capture_frame(gateway_t * gateway, uint16_t link_index, uint8_t direction, const uint8_t * frame, size_t size)
+{
+    struct timespec now;
+
+    if (gateway->capture.file == NULL || !size)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    write_capture_frame(&gateway->capture, (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000, link_index, direction, frame, size);
+}
+
+
+/**Publish the attribute update a link's MCU sent (if a snapshot or a telemetry log was requested)
+ *
+ * Only the attribute updates meant for the computer are published. A
+ * device gets a snapshot record the first time one of its attributes
+ * is heard of, and its updates are dropped once the snapshot is full.
+ * Every update is logged, whether it made it to the snapshot or not.
+ */
+static void publish_frame(gateway_t * gateway, uint16_t link_index, const uint8_t * frame, size_t size)
+{
+    uint8_t pkt[MAX_ENCODED_PKT_BUF_SIZE];
+
+    if ((!snapshot_is_open(&gateway->snapshot) && !telemetry_is_open(&gateway->telemetry)) || size < ENCODED_HDR_SIZE || size > sizeof(pkt))
+    {
+        return;
+    }
+
+    size_t pkt_size = cobs_decode(frame, size, pkt);
+
+    if (pkt_size <= PAYLOAD_OFFSET + ATTR_VALUE_OFFSET || pkt[TASK_ID_OFFSET] != UPDATE_DEVICE_ATTR_COMP || pkt[TASK_TYPE_OFFSET] != EXTERNAL_TASK)
+    {
+        return;
+    }
+
+    gateway_link_t * link = &gateway->links[link_index];
+    const uint8_t * payload = &pkt[PAYLOAD_OFFSET];
+    const uint8_t * id_bytes = &payload[ATTR_DEVICE_OFFSET];
+    uint8_t tracker_id = payload[ATTR_TRACKER_OFFSET];
+    uint16_t device_id = link->is_little_endian? id_bytes[0] | (id_bytes[1] << 8): (id_bytes[0] << 8) | id_bytes[1];
+    size_t value_size = pkt_size - PAYLOAD_OFFSET - ATTR_VALUE_OFFSET;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t time_us = (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+
+    if (telemetry_is_open(&gateway->telemetry) && value_size <= sizeof(uint64_t))
+    {
+        telemetry_event_t event = {time_us, 0, link_index, tracker_id, device_id, payload[ATTR_ID_OFFSET], payload[ATTR_TYPE_OFFSET], (uint8_t) value_size};
+
+        memcpy(&event.value, &payload[ATTR_VALUE_OFFSET], value_size);
+        if (!write_telemetry_event(&gateway->telemetry, &event))
+        {
+            fprintf(stderr, "Could not extend the telemetry log: %s\n", strerror(errno));
+            close_telemetry(&gateway->telemetry);
+        }
+    }
+
+    if (!snapshot_is_open(&gateway->snapshot))
+    {
+        return;
+    }
+
+    // Find the record of the device (or give it one)
+    uint32_t key = get_snapshot_key(tracker_id, device_id);
+    std::unordered_map<uint32_t, int32_t>::iterator record = link->snapshot_devices.find(key);
+
+    if (record == link->snapshot_devices.end())
+    {
+        record = link->snapshot_devices.emplace(key, add_snapshot_device(&gateway->snapshot, link_index, tracker_id, device_id)).first;
+    }
+
+    if (record->second == SNAPSHOT_NO_DEVICE)
+    {
+        return;
+    }
+
+    write_snapshot_attr(&gateway->snapshot, record->second, payload[ATTR_ID_OFFSET], payload[ATTR_TYPE_OFFSET], &payload[ATTR_VALUE_OFFSET],
+                        value_size, time_us);
+}
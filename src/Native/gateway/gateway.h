@@ -0,0 +1,54 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Gateway constants */
+
+#define GATEWAY_MAX_MSG_SIZE 256   // Max size of a message between the gateway and a client
+#define GATEWAY_READ_SIZE    4096  // Bytes read from a serial link at once
+
+/**Gateway message types
+ *
+ * The gateway and its clients talk through a SOCK_SEQPACKET socket,
+ * so every message keeps its boundaries. The first byte of a message
+ * is its type and the rest is its payload.
+ *
+ * A client attaches to a single serial link by its device path. Once
+ * it's attached, the frames of the link and the ticks of its timer
+ * are sent to the client, and the frames of the client are written
+ * to the link.
+ *
+ * The links are taken as little endian until their client gives the
+ * byte order of its MCU, which the device ids it reports are read
+ * with.
+ */
+enum gateway_msg
+{
+    GATEWAY_ATTACH,       // Client -> gateway: attach to a link (payload is the device path)
+    GATEWAY_ATTACHED,     // Gateway -> client: the client was attached to the link
+    GATEWAY_ATTACH_FAIL,  // Gateway -> client: the link is not served or already has a client
+    GATEWAY_FRAME,        // Both ways: a COBS encoded frame (the gateway strips the delimiter)
+    GATEWAY_SET_TIMER,    // Client -> gateway: tick every uint32_t ms (0 stops the timer)
+    GATEWAY_TIMER,        // Gateway -> client: the timer of the link ticked
+    GATEWAY_SET_ENDIAN,   // Client -> gateway: the MCU of the link is little endian if the uint8_t payload isn't 0
+};
+
+
+/* Gateway objects */
+
+typedef struct gateway gateway_t;
+
+
+/* Gateway methods */
+
+gateway_t * create_gateway(const char * socket_path, const char * const * tty_paths, uint16_t tty_count, unsigned long baudrate,
+                           const char * capture_path, const char * snapshot_name, uint32_t snapshot_capacity,
+                           const char * telemetry_path, uint32_t telemetry_rows);
+void deinit_gateway(gateway_t * gateway);
+
+bool run_gateway(gateway_t * gateway);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "gateway.h"
+#include "snapshot/snapshot.h"
+#include "telemetry/telemetry.h"
+
+
+/* Gateway constants */
+
+#define DEFAULT_SOCKET_PATH "/tmp/elevator_gateway.sock"
+#define DEFAULT_BAUDRATE    115200
+#define DEFAULT_SNAPSHOT_CAPACITY 1024  // Devices the snapshot has room for
+
+
+/* Main function */
+
+/**Serve a set of serial links to the computer's platform code
+ *
+ * Every tty given in the command line is served by a single loop, and
+ * the computer attaches a messenger to each of them through the Unix
+ * socket. The frames of every link can be recorded in a capture file,
+ * and the device attributes the MCUs report can be published in a
+ * shared memory snapshot for local readers and logged in a telemetry
+ * log for later analysis.
+ */
+int main(int argc, char * argv[])
+{
+    const char * socket_path = DEFAULT_SOCKET_PATH;
+    unsigned long baudrate = DEFAULT_BAUDRATE;
+    const char * capture_path = NULL;
+    const char * snapshot_name = NULL;
+    uint32_t snapshot_capacity = DEFAULT_SNAPSHOT_CAPACITY;
+    const char * telemetry_path = NULL;
+    uint32_t telemetry_rows = DEFAULT_SEGMENT_ROWS;
+
+    static const struct option long_opts[] = {
+        {"socket", required_argument, NULL, 's'},
+        {"baud",   required_argument, NULL, 'b'},
+        {"capture", required_argument, NULL, 'w'},
+        {"snapshot", optional_argument, NULL, 'm'},
+        {"snapshot-devices", required_argument, NULL, 'n'},
+        {"telemetry", required_argument, NULL, 't'},
+        {"telemetry-rows", required_argument, NULL, 'r'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:b:w:m::n:t:r:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 's': socket_path = optarg; break;
+            case 'b': baudrate = strtoul(optarg, NULL, 10); break;
+            case 'w': capture_path = optarg; break;
+            case 'm': snapshot_name = (optarg != NULL)? optarg: DEFAULT_SNAPSHOT_NAME; break;
+            case 'n': snapshot_capacity = strtoul(optarg, NULL, 10); break;
+            case 't': telemetry_path = optarg; break;
+            case 'r': telemetry_rows = strtoul(optarg, NULL, 10); break;
+            default:
+                optind = argc + 1;  // Show the usage
+                break;
+        }
+    }
+
+    int tty_count = argc - optind;
+    if (tty_count <= 0 || tty_count > UINT16_MAX)
+    {
+        fprintf(stderr, "usage: %s [--socket PATH] [--baud N] [--capture FILE] [--snapshot[=NAME]] [--snapshot-devices N] [--telemetry DIR] [--telemetry-rows N] TTY...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    gateway_t * gateway = create_gateway(socket_path, (const char * const *) &argv[optind], tty_count, baudrate, capture_path, snapshot_name, snapshot_capacity,
+                                         telemetry_path, telemetry_rows);
+    if (gateway == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    bool stopped = run_gateway(gateway);
+    deinit_gateway(gateway);
+
+    return stopped? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "elevator.h"
+#include "simulation.h"
+
+
+/* Batch constants */
+
+#define MS_PER_HOUR 3600000UL
+
+// Default batch parameters
+#define DEFAULT_SEEDS     4
+#define DEFAULT_HOURS     1
+#define DEFAULT_BUILDINGS 1
+#define DEFAULT_CARS      ELEVATOR_COUNT  // Elevators per building
+#define DEFAULT_FLOORS    7
+#define DEFAULT_RATE      60.0  // People per hour in each building
+
+
+/* Batch objects */
+
+// A simulation of the batch (a combination of its parameters)
+typedef struct
+{
+    int profile;                // Traffic profile (-1 if the people come from a scenario)
+    const char * scenario_path;
+    unsigned long seed;         // Seed of the traffic and of the elevators the people call
+    uint16_t cars_per_building;
+    double rate;
+
+} batch_run_t;
+
+
+// Metrics of a simulation
+typedef struct
+{
+    bool is_done;        // The simulation could be set up and ran
+    size_t people;
+    sim_stats_t stats;
+    double wall_time;    // Time the simulation took (s)
+
+} batch_result_t;
+
+
+/**Jobs of a worker
+ *
+ * A worker takes its own jobs from the back of its queue and steals
+ * the jobs of the others from the front, so a worker and its thieves
+ * rarely want the same job and every queue is drained by the end.
+ */
+typedef struct
+{
+    std::mutex lock;
+    std::deque<size_t> jobs;
+
+} batch_queue_t;
+
+
+// Parameters shared by all the simulations of a batch
+typedef struct
+{
+    uint8_t building_count;
+    uint8_t floor_count;
+    unsigned long hours;
+
+} batch_config_t;
+
+
+/* Batch function prototypes */
+
+static void print_usage(const char * prog);
+static void print_results(const std::vector<batch_run_t> & runs, const std::vector<batch_result_t> & results, double wall_time, unsigned thread_count);
+static void run_worker(unsigned worker, std::vector<batch_queue_t> & queues, const batch_config_t * config,
+                       const std::vector<batch_run_t> & runs, std::vector<batch_result_t> & results);
+static bool take_job(unsigned worker, std::vector<batch_queue_t> & queues, size_t * job);
+static batch_result_t run_simulation(const batch_config_t * config, const batch_run_t * run);
+static bool parse_list(const char * arg, std::vector<std::string> & items);
+
+
+/* Main function */
+
+/**Run many elevator simulations in parallel
+ *
+ * Every combination of the traffic profiles (or scenario files), cars,
+ * rates and seeds is a simulation of the batch. The simulations are
+ * spread across a pool of workers that steal from each other once
+ * they run out of their own. The elevator subsystem, the scheduler and
+ * the virtual clock are thread local, so every worker runs its
+ * simulations in isolation and gets the same results a lone run would.
+ * The metrics of every simulation are printed in a single table.
+ */
+int main(int argc, char * argv[])
+{
+    batch_config_t config = {DEFAULT_BUILDINGS, DEFAULT_FLOORS, DEFAULT_HOURS};
+    unsigned long seed_count = DEFAULT_SEEDS;
+    unsigned thread_count = std::thread::hardware_concurrency();
+    std::vector<std::string> profile_names = {"up-peak", "down-peak", "lunch", "interfloor"};
+    std::vector<std::string> car_counts = {std::to_string(DEFAULT_CARS)};
+    std::vector<std::string> rates = {std::to_string(DEFAULT_RATE)};
+    std::vector<std::string> scenario_paths;
+
+    static const struct option long_opts[] = {
+        {"threads",   required_argument, NULL, 'j'},
+        {"seeds",     required_argument, NULL, 's'},
+        {"hours",     required_argument, NULL, 'h'},
+        {"buildings", required_argument, NULL, 'b'},
+        {"floors",    required_argument, NULL, 'f'},
+        {"profiles",  required_argument, NULL, 'p'},
+        {"cars",      required_argument, NULL, 'c'},
+        {"rates",     required_argument, NULL, 'r'},
+        {"scenario",  required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:s:h:b:f:p:c:r:n:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'j': thread_count = strtoul(optarg, NULL, 10); break;
+            case 's': seed_count = strtoul(optarg, NULL, 10); break;
+            case 'h': config.hours = strtoul(optarg, NULL, 10); break;
+            case 'b': config.building_count = (uint8_t) strtoul(optarg, NULL, 10); break;
+            case 'f': config.floor_count = (uint8_t) strtoul(optarg, NULL, 10); break;
+            case 'p': parse_list(optarg, profile_names); break;
+            case 'c': parse_list(optarg, car_counts); break;
+            case 'r': parse_list(optarg, rates); break;
+            case 'n': scenario_paths.push_back(optarg); break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc || !seed_count || !config.building_count || config.floor_count < 2 || config.hours * MS_PER_HOUR > UINT32_MAX)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Make a simulation of every combination (the scenarios take the place of the profiles)
+    std::vector<batch_run_t> runs;
+
+    for (size_t i = 0; i < (scenario_paths.empty()? profile_names.size(): scenario_paths.size()); i++)
+    {
+        int profile = scenario_paths.empty()? find_traffic_profile(profile_names[i].c_str()): -1;
+
+        if (scenario_paths.empty() && profile < 0)
+        {
+            fprintf(stderr, "Unknown traffic profile %s\n", profile_names[i].c_str());
+            return EXIT_FAILURE;
+        }
+
+        for (size_t j = 0; j < car_counts.size(); j++)
+        {
+            unsigned long cars_per_building = strtoul(car_counts[j].c_str(), NULL, 10);
+
+            for (size_t k = 0; k < rates.size(); k++)
+            {
+                double rate = strtod(rates[k].c_str(), NULL);
+
+                if (!cars_per_building || cars_per_building * config.building_count > UINT16_MAX || rate <= 0)
+                {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+
+                for (unsigned long seed = 1; seed <= seed_count; seed++)
+                {
+                    batch_run_t run = {profile, scenario_paths.empty()? NULL: scenario_paths[i].c_str(), seed, (uint16_t) cars_per_building, rate};
+                    runs.push_back(run);
+                }
+            }
+        }
+    }
+
+    if (!thread_count)
+    {
+        thread_count = 1;
+    }
+    if (thread_count > runs.size())
+    {
+        thread_count = runs.size();
+    }
+
+    // Deal the simulations to the workers, so each of them starts with its own share
+    std::vector<batch_queue_t> queues(thread_count);
+    std::vector<batch_result_t> results(runs.size());
+
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        queues[i % thread_count].jobs.push_back(i);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+
+    for (unsigned i = 0; i < thread_count; i++)
+    {
+        workers.emplace_back(run_worker, i, std::ref(queues), &config, std::cref(runs), std::ref(results));
+    }
+    for (unsigned i = 0; i < thread_count; i++)
+    {
+        workers[i].join();
+    }
+
+    std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start;
+
+    print_results(runs, results, wall_time.count(), thread_count);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Private batch functions */
+
+static void print_usage(const char * prog)
+{
+    fprintf(stderr, "usage: %s [--threads N] [--seeds N] [--hours N] [--buildings N] [--floors N] [--profiles LIST | --scenario FILE...]\n"
+                    "       [--cars LIST] [--rates LIST]\n", prog);
+}
+
+
+// Print a row for every simulation of the batch and the merged metrics
+static void print_results(const std::vector<batch_run_t> & runs, const std::vector<batch_result_t> & results, double wall_time, unsigned thread_count)
+{
+    static const char * const profile_names[TRAFFIC_PROFILE_COUNT] = {"up-peak", "down-peak", "lunch", "interfloor"};
+    sim_stats_t total;
+    size_t failed = 0;
+
+    memset(&total, 0, sizeof(total));
+
+    printf("%-12s %5s %8s %5s %7s %7s %7s %10s %9s %8s %9s %8s\n",
+           "traffic", "cars", "rate", "seed", "people", "served", "boarded", "mean_wait", "max_wait", "dropped", "tx_frames", "wall_ms");
+
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        const batch_run_t & run = runs[i];
+        const batch_result_t & result = results[i];
+        const char * traffic = (run.profile >= 0)? profile_names[run.profile]: run.scenario_path;
+
+        if (!result.is_done)
+        {
+            printf("%-12s %5u %8.1f %5lu failed\n", traffic, run.cars_per_building, run.rate, run.seed);
+            failed++;
+            continue;
+        }
+
+        const sim_stats_t & stats = result.stats;
+
+        printf("%-12s %5u %8.1f %5lu %7zu %7lu %7lu %10.1f %9lu %8lu %9lu %8.2f\n",
+               traffic, run.cars_per_building, run.rate, run.seed, result.people, stats.served, stats.boarded,
+               stats.served? (double) stats.total_wait / stats.served: 0.0, stats.max_wait, stats.dropped, stats.tx_frames, result.wall_time * 1000);
+
+        total.requests += stats.requests;
+        total.dropped += stats.dropped;
+        total.served += stats.served;
+        total.boarded += stats.boarded;
+        total.total_wait += stats.total_wait;
+        total.max_wait = (stats.max_wait > total.max_wait)? stats.max_wait: total.max_wait;
+        total.tx_frames += stats.tx_frames;
+        total.queue_peak = (stats.queue_peak > total.queue_peak)? stats.queue_peak: total.queue_peak;
+        total.refused += stats.refused;
+    }
+
+    printf("\n");
+    printf("simulations:   %zu (%zu failed)\n", runs.size(), failed);
+    printf("threads:       %u\n", thread_count);
+    printf("served:        %lu\n", total.served);
+    printf("mean wait:     %.1f ms\n", total.served? (double) total.total_wait / total.served: 0.0);
+    printf("max wait:      %lu ms\n", total.max_wait);
+    printf("tx frames:     %lu\n", total.tx_frames);
+    printf("queue peak:    %lu/%d\n", total.queue_peak, QUEUE_SIZE);
+    printf("refused tasks: %lu\n", total.refused);
+    printf("wall time:     %.3f s\n", wall_time);
+    printf("throughput:    %.1f simulations/s\n", wall_time > 0? runs.size() / wall_time: 0.0);
+}
+
+
+// Run simulations until there are none left to take
+static void run_worker(unsigned worker, std::vector<batch_queue_t> & queues, const batch_config_t * config,
+                       const std::vector<batch_run_t> & runs, std::vector<batch_result_t> & results)
+{
+    size_t job;
+
+    while (take_job(worker, queues, &job))
+    {
+        results[job] = run_simulation(config, &runs[job]);
+    }
+}
+
+
+/**Take the next simulation of a worker
+ *
+ * The worker's own queue is tried first, and then the queues of the
+ * other workers in turn. The simulations are all queued up front, so
+ * a worker that finds every queue empty is done.
+ */
+static bool take_job(unsigned worker, std::vector<batch_queue_t> & queues, size_t * job)
+{
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        batch_queue_t & queue = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+
+        if (queue.jobs.empty())
+        {
+            continue;
+        }
+
+        if (!i)
+        {
+            *job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            *job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+// Run a simulation of the batch on the worker's own elevator subsystem
+static batch_result_t run_simulation(const batch_config_t * config, const batch_run_t * run)
+{
+    batch_result_t result;
+    std::vector<traffic_person_t> people;
+    traffic_config_t traffic = {(uint8_t) run->profile, config->building_count, config->floor_count, run->rate, run->seed};
+    uint32_t duration = config->hours * MS_PER_HOUR;
+
+    memset(&result, 0, sizeof(result));
+
+    if (run->scenario_path != NULL)
+    {
+        if (!read_scenario(run->scenario_path, &traffic, &duration, people) || !traffic.building_count ||
+            traffic.building_count * run->cars_per_building > UINT16_MAX)
+        {
+            return result;
+        }
+    }
+    else if (!generate_traffic(&traffic, duration, people))
+    {
+        return result;
+    }
+
+    std::vector<uint16_t> building_cars(traffic.building_count, run->cars_per_building);
+    sim_config_t sim_config = {building_cars.data(), traffic.building_count, traffic.floor_count, ELEVATOR_CAPACITY, ELEVATOR_MAX_WEIGHT, NULL};
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (!init_simulation(&sim_config))
+    {
+        return result;
+    }
+
+    run_sim_people(people.data(), people.size(), run->cars_per_building, run->seed);
+    run_simulation_until(duration);
+
+    std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start;
+
+    result.is_done = true;
+    result.people = people.size();
+    result.stats = *get_sim_stats();
+    result.wall_time = wall_time.count();
+
+    deinit_simulation();
+
+    return result;
+}
+
+
+// Split a comma separated list (the defaults are replaced)
+static bool parse_list(const char * arg, std::vector<std::string> & items)
+{
+    std::string list = arg;
+    size_t start = 0;
+
+    items.clear();
+
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = list.size();
+        }
+
+        if (end > start)
+        {
+            items.push_back(list.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+
+    return !items.empty();
+}
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "elevator.h"
+#include "simulation.h"
+
+
+/* Simulator constants */
+
+#define MS_PER_HOUR 3600000UL
+
+// Default scenario parameters
+#define DEFAULT_SEED      1
+#define DEFAULT_HOURS     1
+#define DEFAULT_BUILDINGS 1
+#define DEFAULT_CARS      ELEVATOR_COUNT  // Elevators per building
+#define DEFAULT_FLOORS    7
+#define DEFAULT_RATE      60.0  // Requests per hour
+#define DEFAULT_BURST     1     // Floors requested at each arrival
+
+
+/* Simulator function prototypes */
+
+static void print_usage(const char * prog);
+static void print_stats(const sim_stats_t * stats, double wall_time);
+
+
+/* Main function */
+
+/**Run an elevator scenario against the virtual clock
+ *
+ * Requests arrive to random elevators and floors, and the time
+ * between them is exponentially distributed. An arrival can request
+ * a burst of floors from the same elevator (like a crowd boarding in
+ * the lobby), which are sent one by one or in a batched task. Since
+ * the clock only jumps between the events, hours of the scenario are
+ * ran in a fraction of a second.
+ *
+ * With a traffic profile, the requests are made by people instead,
+ * who call an elevator of their building, board it and request their
+ * destination. The people can be saved to a scenario file (without
+ * running them) and a scenario file can be ran in place of a profile,
+ * which takes the buildings, floors and time span of the scenario.
+ */
+int main(int argc, char * argv[])
+{
+    unsigned long seed = DEFAULT_SEED;
+    unsigned long hours = DEFAULT_HOURS;
+    double rate = DEFAULT_RATE;
+    unsigned long cars_per_building = DEFAULT_CARS;
+    unsigned long burst = DEFAULT_BURST;
+    bool is_batched = false;
+    int profile = -1;
+    const char * scenario_path = NULL;
+    const char * output_path = NULL;
+    sim_config_t config = {NULL, DEFAULT_BUILDINGS, DEFAULT_FLOORS, ELEVATOR_CAPACITY, ELEVATOR_MAX_WEIGHT, NULL};
+
+    static const struct option long_opts[] = {
+        {"seed",   required_argument, NULL, 's'},
+        {"hours",  required_argument, NULL, 'h'},
+        {"buildings", required_argument, NULL, 'b'},
+        {"cars",   required_argument, NULL, 'c'},
+        {"floors", required_argument, NULL, 'f'},
+        {"rate",   required_argument, NULL, 'r'},
+        {"capture", required_argument, NULL, 'w'},
+        {"burst",  required_argument, NULL, 'u'},
+        {"batch",  no_argument,       NULL, 'a'},
+        {"profile", required_argument, NULL, 'p'},
+        {"scenario", required_argument, NULL, 'n'},
+        {"save-scenario", required_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:h:b:c:f:r:w:u:ap:n:o:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            case 'h': hours = strtoul(optarg, NULL, 10); break;
+            case 'b': config.building_count = (uint8_t) strtoul(optarg, NULL, 10); break;
+            case 'c': cars_per_building = strtoul(optarg, NULL, 10); break;
+            case 'f': config.floor_count = (uint8_t) strtoul(optarg, NULL, 10); break;
+            case 'r': rate = strtod(optarg, NULL); break;
+            case 'w': config.capture_path = optarg; break;
+            case 'u': burst = strtoul(optarg, NULL, 10); break;
+            case 'a': is_batched = true; break;
+            case 'p':
+                profile = find_traffic_profile(optarg);
+                if (profile < 0)
+                {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n': scenario_path = optarg; break;
+            case 'o': output_path = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    // Every building gets the same amount of elevators (the car indices must fit in 16 bits)
+    if (!config.building_count || !cars_per_building || config.building_count * cars_per_building > UINT16_MAX || !config.floor_count || rate <= 0 || !burst || burst > UINT8_MAX)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Take the people of the scenario (or generate them with the profile)
+    std::vector<traffic_person_t> people;
+    unsigned long end_time = hours * MS_PER_HOUR;
+
+    if (scenario_path != NULL)
+    {
+        traffic_config_t traffic;
+        uint32_t duration;
+
+        if (!read_scenario(scenario_path, &traffic, &duration, people) || !traffic.building_count || traffic.building_count * cars_per_building > UINT16_MAX)
+        {
+            fprintf(stderr, "Could not read the scenario %s\n", scenario_path);
+            return EXIT_FAILURE;
+        }
+
+        config.building_count = traffic.building_count;
+        config.floor_count = traffic.floor_count;
+        end_time = duration;
+    }
+    else if (profile >= 0)
+    {
+        traffic_config_t traffic = {(uint8_t) profile, config.building_count, config.floor_count, rate, seed};
+
+        if (end_time > UINT32_MAX || !generate_traffic(&traffic, end_time, people))
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (output_path != NULL)
+        {
+            if (!write_scenario(output_path, &traffic, end_time, people))
+            {
+                fprintf(stderr, "Could not write the scenario %s\n", output_path);
+                return EXIT_FAILURE;
+            }
+
+            printf("people:        %zu\n", people.size());
+            return EXIT_SUCCESS;
+        }
+    }
+
+    std::vector<uint16_t> building_cars(config.building_count, (uint16_t) cars_per_building);
+    config.building_cars = building_cars.data();
+
+    if (!init_simulation(&config))
+    {
+        fprintf(stderr, "Could not initialize the simulation\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(seed);
+    std::exponential_distribution<double> arrivals(rate / MS_PER_HOUR);
+    std::uniform_int_distribution<int> cars(0, get_elevator_count() - 1);
+    std::uniform_int_distribution<int> floors(1, config.floor_count);
+
+    double next_arrival = (scenario_path != NULL || profile >= 0)? end_time: arrivals(rng);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    run_sim_people(people.data(), people.size(), cars_per_building, seed);
+
+    while (next_arrival < end_time)
+    {
+        run_simulation_until((unsigned long) next_arrival);
+
+        std::vector<uint8_t> requested_floors(burst);
+
+        for (unsigned long i = 0; i < burst; i++)
+        {
+            requested_floors[i] = floors(rng);
+        }
+
+        uint16_t car_index = cars(rng);
+
+        if (is_batched)
+        {
+            request_sim_elevator_floors(car_index, requested_floors.data(), requested_floors.size());
+        }
+        else
+        {
+            for (unsigned long i = 0; i < burst; i++)
+            {
+                request_sim_elevator(car_index, requested_floors[i]);
+            }
+        }
+
+        next_arrival += arrivals(rng);
+    }
+    run_simulation_until(end_time);
+
+    std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start;
+
+    print_stats(get_sim_stats(), wall_time.count());
+    deinit_simulation();
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Private simulator functions */
+
+static void print_usage(const char * prog)
+{
+    fprintf(stderr, "usage: %s [--seed N] [--hours N] [--buildings N] [--cars PER_BUILDING] [--floors N] [--rate REQ_PER_HOUR] [--burst FLOORS] [--batch] [--capture FILE]\n"
+                    "       [--profile up-peak|down-peak|lunch|interfloor [--save-scenario FILE]] [--scenario FILE]\n", prog);
+}
+
+
+static void print_stats(const sim_stats_t * stats, double wall_time)
+{
+    printf("virtual time:  %lu ms\n", get_sim_time());
+    printf("wall time:     %.3f s\n", wall_time);
+    printf("requests:      %lu\n", stats->requests);
+    printf("dropped:       %lu\n", stats->dropped);
+    printf("served:        %lu\n", stats->served);
+    printf("mean wait:     %.1f ms\n", stats->served? (double) stats->total_wait / stats->served: 0.0);
+    printf("max wait:      %lu ms\n", stats->max_wait);
+    printf("boarded:       %lu\n", stats->boarded);
+    printf("tx frames:     %lu\n", stats->tx_frames);
+    printf("steps:         %lu\n", stats->steps);
+    printf("queue peak:    %lu/%d\n", stats->queue_peak, QUEUE_SIZE);
+    printf("refused tasks: %lu\n", stats->refused);
+}
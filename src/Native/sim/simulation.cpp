@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+#include <utility>
+
+#include <devices.h>
+#include <scheduler.h>
+#include <cobs/cobs.h>
+#include <serial_pkt/serial_pkt.h>
+
+#include "elevator.h"
+#include "simulation.h"
+#include "capture/capture.h"
+
+
+/* Simulation objects */
+
+// A person that boards an elevator and requests another floor
+typedef struct
+{
+    uint8_t destination;  // Floor requested after boarding (NULL_FLOOR if there's no person)
+    uint8_t temp;
+    uint8_t weight;
+
+} sim_person_t;
+
+
+// A request that hasn't been served by an elevator yet
+typedef struct
+{
+    uint8_t floor;            // Requested floor
+    unsigned long req_time;   // Time in which the floor was requested
+    sim_person_t person;      // Person that made the request
+
+} pending_request_t;
+
+
+/* Simulation variables */
+
+static THREAD_LOCAL unsigned long sim_time;  // Virtual clock shared by the scheduler and the elevators
+static THREAD_LOCAL sim_stats_t sim_stats;
+static THREAD_LOCAL serial_pkt_t sim_tx_pkt;  // Packet used to build the frames for the elevator subsystem
+static THREAD_LOCAL capture_t sim_capture;    // Records the frames of the link (if a capture was requested)
+static THREAD_LOCAL std::vector<std::pair<uint8_t, uint8_t> > sim_acks;  // Task ids and sequences to acknowledge once the scheduler is done sending
+static THREAD_LOCAL std::vector<std::vector<pending_request_t> > sim_requests;  // Pending requests for each elevator
+static THREAD_LOCAL std::vector<std::pair<uint16_t, sim_person_t> > sim_boardings;  // People whose elevator reached their floor
+static THREAD_LOCAL std::vector<const char *> sim_floor_names;
+static THREAD_LOCAL std::vector<std::vector<char> > sim_floor_name_bufs;
+
+
+/* Simulation function prototypes */
+
+static void step_elevators(void);
+static void update_requests(void);
+static void board_people(void);
+static unsigned long sim_clock(void);
+static void sim_tx_cb(uint8_t * pkt, uint8_t pkt_size);
+static void capture_sim_frame(bool is_tx, const uint8_t * frame, uint8_t frame_size);
+static uint8_t sim_rx_cb(uint8_t id, task_t task, uint8_t * pkt);
+static void send_sim_task(uint8_t id, uint8_t type, uint8_t * payload, uint8_t payload_size);
+
+
+/* Public simulation functions */
+
+/**Initialize the simulation
+ *
+ * The elevator subsystem is set up in the same way the Arduino does
+ * it, but with the virtual clock and the stub transport. After that,
+ * the computer's setup completion is sent, so the elevators start
+ * running.
+ */
+bool init_simulation(const sim_config_t * config)
+{
+    sim_time = 0;
+    memset(&sim_stats, 0, sizeof(sim_stats));
+
+    if (!init_task_scheduler(sim_rx_cb, sim_tx_cb, sim_clock))
+    {
+        return false;
+    }
+
+    sim_tx_pkt = init_serial_pkt(MAX_ENCODED_PKT_BUF_SIZE);
+
+    sim_capture.file = NULL;
+    if (config->capture_path != NULL)
+    {
+        if (!create_capture(&sim_capture, config->capture_path))
+        {
+            deinit_simulation();
+            return false;
+        }
+        set_capture_callback(capture_sim_frame);
+    }
+
+    init_device_trackers(1);
+    register_platform("elevator_system");
+    init_building_elevators(config->building_cars, config->building_count, sim_clock);
+
+    if (sim_tx_pkt.buf == NULL || !device_initialized(ELEVATOR_TRACKER))
+    {
+        deinit_simulation();
+        return false;
+    }
+
+    sim_requests.assign(get_elevator_count(), std::vector<pending_request_t>());
+
+    // Name the floors by their number
+    sim_floor_names.resize(config->floor_count);
+    sim_floor_name_bufs.assign(config->floor_count, std::vector<char>(4));
+    for (uint8_t i = 0; i < config->floor_count; i++)
+    {
+        snprintf(sim_floor_name_bufs[i].data(), 4, "%u", i + 1);
+        sim_floor_names[i] = sim_floor_name_bufs[i].data();
+    }
+
+    for (uint16_t i = 0; i < get_elevator_count(); i++)
+    {
+        set_elevator_attrs(i, sim_floor_names.data(), config->floor_count, ELEVATOR_MAX_TEMP, ELEVATOR_MIN_TEMP, config->capacity, config->max_weight);
+    }
+
+    alert_setup_completion();
+    send_sim_task(COMP_SETUP_COMPLETE, EXTERNAL_TASK, NULL, 0);
+
+    return true;
+}
+
+
+// Uninitialize the simulation
+void deinit_simulation(void)
+{
+    set_capture_callback(NULL);
+    close_capture(&sim_capture);
+
+    deinit_devices();
+    deinit_task_scheduler();
+    deinit_serial_pkt(&sim_tx_pkt);
+
+    sim_acks.clear();
+    sim_requests.clear();
+    sim_boardings.clear();
+}
+
+
+// Get the current virtual time
+unsigned long get_sim_time(void)
+{
+    return sim_time;
+}
+
+
+// Get the metrics gathered so far
+const sim_stats_t * get_sim_stats(void)
+{
+    queue_usage_t usage = get_queue_usage();
+
+    sim_stats.queue_peak = usage.high_water;
+    sim_stats.refused = usage.refused;
+
+    return &sim_stats;
+}
+
+
+/**Run the simulation until a given time
+ *
+ * Instead of advancing the clock in fixed steps, the clock jumps
+ * straight to the next time in which an elevator has something to
+ * do. At each of these times, the elevators are ran until none of
+ * them can make progress right away.
+ */
+void run_simulation_until(unsigned long end_time)
+{
+    while (sim_time < end_time)
+    {
+        unsigned long next_deadline = sim_time;
+
+        for (uint8_t i = 0; i < SIM_MAX_STEPS_PER_EVENT && next_deadline <= sim_time; i++)
+        {
+            step_elevators();
+            next_deadline = get_next_elevator_deadline();
+        }
+
+        // Move the clock forward even if an elevator keeps asking to run
+        if (next_deadline <= sim_time)
+        {
+            next_deadline = sim_time + 1;
+        }
+
+        sim_time = (next_deadline < end_time)? next_deadline: end_time;
+    }
+
+    step_elevators();
+}
+
+
+// Request an elevator to go to a floor (as the elevator manager does)
+void request_sim_elevator(uint16_t car_index, uint8_t floor)
+{
+    elevator_t * car = get_elevator(car_index);
+
+    if (car == NULL)
+    {
+        return;
+    }
+
+    uint8_t pkt[CAR_PAYLOAD_OFFSET + 1];
+
+    pack_device_id(&pkt[CAR_INDEX_OFFSET], car_index);
+    pkt[CAR_PAYLOAD_OFFSET] = floor;
+
+    send_sim_task(REQUEST_ELEVATOR, EXTERNAL_TASK, pkt, sizeof(pkt));
+    sim_stats.requests++;
+
+    if (floor && floor <= car->limits.floor && floor_was_requested(car, floor))
+    {
+        pending_request_t request = {floor, sim_time, {NULL_FLOOR, 0, 0}};
+        sim_requests[car_index].push_back(request);
+    }
+    else
+    {
+        sim_stats.dropped++;
+    }
+}
+
+
+/**Request an elevator to go to many floors with batched tasks
+ *
+ * The floors are split by the range of floors a batch covers, so a
+ * batch is sent for each range that has requested floors.
+ */
+void request_sim_elevator_floors(uint16_t car_index, const uint8_t * floors, uint8_t floor_count)
+{
+    elevator_t * car = get_elevator(car_index);
+
+    if (car == NULL)
+    {
+        return;
+    }
+
+    const size_t batch_count = (UINT8_MAX + FLOOR_BATCH_FLOORS - 1) / FLOOR_BATCH_FLOORS;
+    uint8_t batches[batch_count][FLOOR_BATCH_SIZE] = {};
+    bool is_batched[batch_count] = {};
+
+    for (uint8_t i = 0; i < floor_count; i++)
+    {
+        if (floors[i])
+        {
+            uint8_t offset = (floors[i] - 1) % FLOOR_BATCH_FLOORS;
+            size_t batch = (floors[i] - 1) / FLOOR_BATCH_FLOORS;
+
+            batches[batch][offset / 8] |= 1 << (offset % 8);
+            is_batched[batch] = true;
+        }
+    }
+
+    for (size_t i = 0; i < batch_count; i++)
+    {
+        if (is_batched[i])
+        {
+            uint8_t pkt[CAR_PAYLOAD_OFFSET + 1 + FLOOR_BATCH_SIZE];
+
+            pack_device_id(&pkt[CAR_INDEX_OFFSET], car_index);
+            pkt[CAR_PAYLOAD_OFFSET] = i * FLOOR_BATCH_FLOORS + 1;
+            memcpy(&pkt[CAR_PAYLOAD_OFFSET + 1], batches[i], FLOOR_BATCH_SIZE);
+
+            send_sim_task(REQUEST_ELEVATOR_FLOORS, EXTERNAL_TASK, pkt, sizeof(pkt));
+        }
+    }
+
+    for (uint8_t i = 0; i < floor_count; i++)
+    {
+        sim_stats.requests++;
+
+        if (floors[i] && floors[i] <= car->limits.floor && floor_was_requested(car, floors[i]))
+        {
+            pending_request_t request = {floors[i], sim_time, {NULL_FLOOR, 0, 0}};
+            sim_requests[car_index].push_back(request);
+        }
+        else
+        {
+            sim_stats.dropped++;
+        }
+    }
+}
+
+
+// Make a person enter an elevator at its current floor
+void enter_sim_elevator(uint16_t car_index, uint8_t temp, uint8_t weight)
+{
+    uint8_t pkt[CAR_PAYLOAD_OFFSET + 2];
+
+    pack_device_id(&pkt[CAR_INDEX_OFFSET], car_index);
+    pkt[CAR_PAYLOAD_OFFSET] = temp;
+    pkt[CAR_PAYLOAD_OFFSET + 1] = weight;
+
+    send_sim_task(ENTER_ELEVATOR, EXTERNAL_TASK, pkt, sizeof(pkt));
+}
+
+
+/**Make a person call an elevator and ride it to another floor
+ *
+ * The person enters the elevator (with the temp and weight payload of
+ * enter_elevator) once the elevator reaches the floor of the call, and
+ * then requests its destination. A person that calls an elevator that
+ * is already stopped at its floor boards it right away.
+ */
+void add_sim_person(uint16_t car_index, uint8_t origin, uint8_t destination, uint8_t temp, uint8_t weight)
+{
+    elevator_t * car = get_elevator(car_index);
+
+    if (car == NULL)
+    {
+        return;
+    }
+
+    sim_person_t person = {destination, temp, weight};
+    size_t request_count = sim_requests[car_index].size();
+
+    request_sim_elevator(car_index, origin);
+
+    if (sim_requests[car_index].size() > request_count)
+    {
+        sim_requests[car_index].back().person = person;
+    }
+    else if (get_elevator_fields()->floor[car_index] == origin && get_elevator_behavior_state(car_index) != MOVING)
+    {
+        sim_boardings.push_back(std::make_pair(car_index, person));
+        board_people();
+    }
+}
+
+
+// Make people call the elevators of their buildings as they arrive (a random elevator is called for each person)
+void run_sim_people(const traffic_person_t * people, size_t person_count, uint16_t cars_per_building, unsigned long seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> cars(0, cars_per_building - 1);
+
+    for (size_t i = 0; i < person_count; i++)
+    {
+        run_simulation_until(people[i].time);
+        add_sim_person(people[i].building * cars_per_building + cars(rng), people[i].origin, people[i].destination, people[i].temp, people[i].weight);
+    }
+}
+
+
+/* Private simulation functions */
+
+// The virtual clock given to the scheduler and the elevators
+static unsigned long sim_clock(void)
+{
+    return sim_time;
+}
+
+
+/**Run the elevator subsystem once
+ *
+ * This mirrors the Arduino loop, but the acknowledgements of the
+ * computer are given right after the scheduler sends its tasks.
+ */
+static void step_elevators(void)
+{
+    for (uint8_t i = 0; i < SIM_MAX_STEPS_PER_EVENT; i++)
+    {
+        unsigned long tx_frames = sim_stats.tx_frames;
+
+        send_task();
+
+        // Acknowledge the tasks outside of the tx callback, so the scheduler is not reentered
+        std::vector<std::pair<uint8_t, uint8_t> > acks;
+        acks.swap(sim_acks);
+        for (size_t j = 0; j < acks.size(); j++)
+        {
+            uint8_t pkt[] = {acks[j].first, 0, acks[j].second};
+            send_sim_task(ALERT_SYSTEM, INTERNAL_TASK, pkt, sizeof(pkt));
+        }
+
+        if (tx_frames == sim_stats.tx_frames && acks.empty())
+        {
+            break;
+        }
+    }
+
+    run_elevators();
+    update_requests();
+    board_people();
+    sim_stats.steps++;
+}
+
+
+// Mark the requests of the floors the elevators have reached as served
+static void update_requests(void)
+{
+    for (uint16_t i = 0; i < sim_requests.size(); i++)
+    {
+        std::vector<pending_request_t> & requests = sim_requests[i];
+        elevator_t * car = get_elevator(i);
+
+        for (size_t j = 0; j < requests.size();)
+        {
+            if (floor_was_requested(car, requests[j].floor))
+            {
+                j++;
+                continue;
+            }
+
+            unsigned long wait = sim_time - requests[j].req_time;
+
+            sim_stats.served++;
+            sim_stats.total_wait += wait;
+            sim_stats.max_wait = (wait > sim_stats.max_wait)? wait: sim_stats.max_wait;
+
+            if (requests[j].person.destination != NULL_FLOOR)
+            {
+                sim_boardings.push_back(std::make_pair(i, requests[j].person));
+            }
+
+            requests[j] = requests.back();
+            requests.pop_back();
+        }
+    }
+}
+
+
+// Make the people whose elevator reached their floor board it (outside of the request updates, since they add requests)
+static void board_people(void)
+{
+    std::vector<std::pair<uint16_t, sim_person_t> > boardings;
+    boardings.swap(sim_boardings);
+
+    for (size_t i = 0; i < boardings.size(); i++)
+    {
+        uint16_t car_index = boardings[i].first;
+        const sim_person_t & person = boardings[i].second;
+
+        enter_sim_elevator(car_index, person.temp, person.weight);
+        request_sim_elevator(car_index, person.destination);
+        sim_stats.boarded++;
+    }
+}
+
+
+/**Stub transport for the frames sent by the elevator subsystem
+ *
+ * Every external task is acknowledged like the computer does it,
+ * so the normal tasks leave the scheduler's queue.
+ */
+static void sim_tx_cb(uint8_t * pkt, uint8_t pkt_size)
+{
+    uint8_t decoded_pkt[MAX_DECODED_PKT_BUF_SIZE];
+
+    sim_stats.tx_frames++;
+
+    if (pkt_size > 1 && cobs_decode(pkt, pkt_size - 1, decoded_pkt) >= DECODED_HDR_SIZE)
+    {
+        if (decoded_pkt[TASK_TYPE_OFFSET] == EXTERNAL_TASK)
+        {
+            sim_acks.push_back(std::make_pair(decoded_pkt[TASK_ID_OFFSET], decoded_pkt[SEQ_OFFSET]));
+        }
+    }
+}
+
+
+// Record a frame of the link at the virtual time
+static void capture_sim_frame(bool is_tx, const uint8_t * frame, uint8_t frame_size)
+{
+    write_capture_frame(&sim_capture, (uint64_t) sim_time * 1000, 0, is_tx? CAPTURE_FROM_MCU: CAPTURE_TO_MCU, frame, frame_size);
+}
+
+
+// Run the tasks the same way the Arduino's serial rx callback does
+static uint8_t sim_rx_cb(uint8_t id, task_t task, uint8_t * pkt)
+{
+    switch (id)
+    {
+        // Elevator tasks
+        case ENTER_ELEVATOR:
+        case REQUEST_ELEVATOR:
+        case REQUEST_ELEVATOR_FLOORS:
+        {
+            uint16_t car_index = unpack_device_id(&pkt[CAR_INDEX_OFFSET]);
+
+            if (car_index < get_elevator_count())
+            {
+                ((elevator_task_t) task)(car_index, &pkt[CAR_PAYLOAD_OFFSET]);
+                return 0;
+            }
+            return INVALID_CAR_INDEX;
+        }
+    }
+
+    ((set_dev_attr_cb) task)(pkt);
+    return 0;
+}
+
+
+// Pass a task to the elevator subsystem as if the computer sent it
+static void send_sim_task(uint8_t id, uint8_t type, uint8_t * payload, uint8_t payload_size)
+{
+    if (process_outgoing_pkt(&sim_tx_pkt, id, type, payload, payload_size))
+    {
+        for (size_t i = 0; i < sim_tx_pkt.byte_count; i++)
+        {
+            build_rx_task_pkt(sim_tx_pkt.buf[i]);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "traffic.h"
+
+
+/* Simulation constants */
+
+#define SIM_MAX_STEPS_PER_EVENT 8  // Max times the elevators are ran at the same virtual time
+
+
+/* Simulation objects */
+
+// Parameters of the simulated buildings
+typedef struct
+{
+    const uint16_t * building_cars;  // Amount of elevators in each building
+    uint8_t building_count;          // Amount of buildings
+    uint8_t floor_count;             // Amount of floors each elevator serves
+    uint8_t capacity;                // Max amount of riders per elevator
+    uint16_t max_weight;             // Max weight per elevator
+    const char * capture_path;       // Capture file for the frames of the link (NULL to not record them)
+
+} sim_config_t;
+
+
+// Metrics gathered while running a simulation
+typedef struct
+{
+    unsigned long requests;     // Requests given to the elevators
+    unsigned long dropped;      // Requests the elevators could not take
+    unsigned long served;       // Requests that were served
+    unsigned long total_wait;   // Sum of the wait times of the served requests (ms)
+    unsigned long max_wait;     // Longest wait time of a served request (ms)
+    unsigned long boarded;      // People that boarded the elevator they called
+    unsigned long tx_frames;    // Frames sent by the elevator subsystem
+    unsigned long steps;        // Times the elevator subsystem was ran
+    unsigned long queue_peak;   // Most tasks the scheduler of the elevator subsystem had queued at once
+    unsigned long refused;      // Tasks the scheduler refused because its queues were full
+
+} sim_stats_t;
+
+
+/* Simulation methods */
+
+bool init_simulation(const sim_config_t * config);
+void deinit_simulation(void);
+
+unsigned long get_sim_time(void);
+const sim_stats_t * get_sim_stats(void);
+
+void run_simulation_until(unsigned long end_time);
+void request_sim_elevator(uint16_t car_index, uint8_t floor);
+void request_sim_elevator_floors(uint16_t car_index, const uint8_t * floors, uint8_t floor_count);
+void enter_sim_elevator(uint16_t car_index, uint8_t temp, uint8_t weight);
+void add_sim_person(uint16_t car_index, uint8_t origin, uint8_t destination, uint8_t temp, uint8_t weight);
+void run_sim_people(const traffic_person_t * people, size_t person_count, uint16_t cars_per_building, unsigned long seed);
+
+#endif
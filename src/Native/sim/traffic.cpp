@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+#include "traffic.h"
+
+
+/* Traffic constants */
+
+#define MS_PER_HOUR 3600000.0
+
+// Shares of the trips of each profile (incoming, outgoing and interfloor), in the order of traffic_profile
+static const double profile_shares[TRAFFIC_PROFILE_COUNT][3] = {
+    {0.85, 0.05, 0.10},  // Up-peak
+    {0.05, 0.85, 0.10},  // Down-peak
+    {0.45, 0.45, 0.10},  // Lunch
+    {0.0, 0.0, 1.0}      // Interfloor (the lobby is like any other floor)
+};
+
+static const char * const profile_names[TRAFFIC_PROFILE_COUNT] = {"up-peak", "down-peak", "lunch", "interfloor"};
+
+
+/* Traffic function prototypes */
+
+static std::vector<std::vector<double> > get_trip_weights(uint8_t profile, uint8_t floor_count);
+
+
+/* Public traffic functions */
+
+/**Generate the people that arrive to the buildings in a time span
+ *
+ * Each floor of a building is a Poisson source with the rate of the
+ * trips that start there, and the destination of a person is drawn
+ * from the trips of its floor. The people of every floor are merged in
+ * time order. The same configuration always gives the same people with
+ * the same standard library, and a scenario file keeps them for any
+ * other build.
+ */
+bool generate_traffic(const traffic_config_t * config, uint32_t duration, std::vector<traffic_person_t> & people)
+{
+    if (config->profile >= TRAFFIC_PROFILE_COUNT || config->floor_count < 2 || config->rate <= 0)
+    {
+        return false;
+    }
+
+    std::vector<std::vector<double> > weights = get_trip_weights(config->profile, config->floor_count);
+    std::mt19937 rng(config->seed);
+    std::uniform_int_distribution<int> temps(0, MAX_PERSON_TEMP);
+    std::uniform_int_distribution<int> person_weights(MIN_PERSON_WEIGHT, MAX_PERSON_WEIGHT);
+
+    people.clear();
+
+    for (uint16_t building = 0; building < config->building_count; building++)
+    {
+        for (uint16_t origin = 1; origin <= config->floor_count; origin++)
+        {
+            const std::vector<double> & trips = weights[origin - 1];
+            double floor_rate = config->rate * std::accumulate(trips.begin(), trips.end(), 0.0);
+
+            if (floor_rate <= 0)
+            {
+                continue;
+            }
+
+            std::exponential_distribution<double> arrivals(floor_rate / MS_PER_HOUR);
+            std::discrete_distribution<int> destinations(trips.begin(), trips.end());
+
+            for (double time = arrivals(rng); time < duration; time += arrivals(rng))
+            {
+                traffic_person_t person;
+
+                person.time = (uint32_t) time;
+                person.building = building;
+                person.origin = origin;
+                person.destination = destinations(rng) + 1;
+                person.temp = temps(rng);
+                person.weight = person_weights(rng);
+
+                people.push_back(person);
+            }
+        }
+    }
+
+    std::stable_sort(people.begin(), people.end(), [](const traffic_person_t & a, const traffic_person_t & b) { return a.time < b.time; });
+    return true;
+}
+
+
+// Write the people of a scenario to a file (an existing file is replaced)
+bool write_scenario(const char * path, const traffic_config_t * config, uint32_t duration, const std::vector<traffic_person_t> & people)
+{
+    traffic_hdr_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TRAFFIC_MAGIC;
+    hdr.version = TRAFFIC_VERSION;
+    hdr.profile = config->profile;
+    hdr.building_count = config->building_count;
+    hdr.floor_count = config->floor_count;
+    hdr.seed = config->seed;
+    hdr.duration = duration;
+    hdr.person_count = people.size();
+    hdr.rate = config->rate;
+
+    FILE * file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool is_written = fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+                      fwrite(people.data(), sizeof(traffic_person_t), people.size(), file) == people.size();
+
+    return !fclose(file) && is_written;
+}
+
+
+// Read the people of a scenario file (only scenarios with the layout of this build are taken)
+bool read_scenario(const char * path, traffic_config_t * config, uint32_t * duration, std::vector<traffic_person_t> & people)
+{
+    traffic_hdr_t hdr;
+
+    FILE * file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, file) != 1 || hdr.magic != TRAFFIC_MAGIC || hdr.version != TRAFFIC_VERSION)
+    {
+        fclose(file);
+        return false;
+    }
+
+    people.resize(hdr.person_count);
+    bool is_read = fread(people.data(), sizeof(traffic_person_t), people.size(), file) == people.size();
+    fclose(file);
+
+    config->profile = hdr.profile;
+    config->building_count = hdr.building_count;
+    config->floor_count = hdr.floor_count;
+    config->seed = hdr.seed;
+    config->rate = hdr.rate;
+    *duration = hdr.duration;
+
+    return is_read;
+}
+
+
+// Find a traffic profile by its name (-1 is given out if there's none)
+int find_traffic_profile(const char * name)
+{
+    for (int profile = 0; profile < TRAFFIC_PROFILE_COUNT; profile++)
+    {
+        if (!strcmp(name, profile_names[profile]))
+        {
+            return profile;
+        }
+    }
+
+    return -1;
+}
+
+
+/* Private traffic functions */
+
+/**Get the share of the people that go between each pair of floors
+ *
+ * The shares of a profile are spread evenly over its trips. A share
+ * with no trips (e.g., interfloor trips in a building with only one
+ * floor above the lobby) is left out, and the rest are scaled up so
+ * the shares of all the trips still add up to one.
+ */
+static std::vector<std::vector<double> > get_trip_weights(uint8_t profile, uint8_t floor_count)
+{
+    std::vector<std::vector<double> > weights(floor_count, std::vector<double>(floor_count, 0.0));
+    const double * shares = profile_shares[profile];
+    uint8_t upper_floors = floor_count - 1;
+    double total = 0;
+
+    for (uint16_t origin = 1; origin <= floor_count; origin++)
+    {
+        for (uint16_t destination = 1; destination <= floor_count; destination++)
+        {
+            double weight = 0;
+
+            if (origin == destination)
+            {
+                continue;
+            }
+            else if (profile == INTERFLOOR)
+            {
+                weight = 1.0 / (floor_count * upper_floors);
+            }
+            else if (origin == LOBBY_FLOOR)
+            {
+                weight = shares[0] / upper_floors;
+            }
+            else if (destination == LOBBY_FLOOR)
+            {
+                weight = shares[1] / upper_floors;
+            }
+            else
+            {
+                weight = shares[2] / (upper_floors * (upper_floors - 1));
+            }
+
+            weights[origin - 1][destination - 1] = weight;
+            total += weight;
+        }
+    }
+
+    for (uint8_t i = 0; i < floor_count; i++)
+    {
+        for (uint8_t j = 0; j < floor_count; j++)
+        {
+            weights[i][j] /= total;
+        }
+    }
+
+    return weights;
+}
@@ -0,0 +1,97 @@
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vector>
+
+
+/* Traffic constants */
+
+#define TRAFFIC_MAGIC   0x52544C45  // "ELTR" in little endian
+#define TRAFFIC_VERSION 1
+#define LOBBY_FLOOR     1           // Floor most of the people enter and leave the building through
+
+// Payload of a person boarding an elevator (same ranges as the computer's enter command)
+#define MIN_PERSON_WEIGHT 115
+#define MAX_PERSON_WEIGHT 230
+#define MAX_PERSON_TEMP   2  // Temperature increase a person brings into a car
+
+/**Traffic profiles
+ *
+ * Every profile is a mix of trips between the floors of a building:
+ * incoming trips from the lobby, outgoing trips to the lobby and
+ * interfloor trips between the other floors. The people arrive to
+ * each floor at their own Poisson rate, which is the share of the
+ * building's rate that starts there.
+ */
+enum traffic_profile
+{
+    UP_PEAK,     // Morning: most people come in through the lobby
+    DOWN_PEAK,   // Evening: most people head out to the lobby
+    LUNCH,       // People come and go through the lobby in both directions
+    INTERFLOOR,  // Trips are spread evenly over every pair of floors
+    TRAFFIC_PROFILE_COUNT
+};
+
+
+/* Traffic objects */
+
+// Parameters of the generated traffic
+typedef struct
+{
+    uint8_t profile;         // Mix of trips (traffic_profile)
+    uint8_t building_count;
+    uint8_t floor_count;     // Floors of every building
+    double rate;             // People per hour in each building
+    unsigned long seed;
+
+} traffic_config_t;
+
+
+// A person that calls an elevator from a floor and rides it to another one
+typedef struct
+{
+    uint32_t time;         // Time the person reaches the origin floor (ms)
+    uint8_t building;
+    uint8_t origin;        // Floor of the hall call
+    uint8_t destination;   // Floor requested after boarding
+    uint8_t temp;          // Payload of the boarding (as enter_elevator takes it)
+    uint8_t weight;
+
+} __attribute__((packed)) traffic_person_t;
+
+
+/**Scenario file layout
+ *
+ * A scenario is the header below followed by the people of the
+ * scenario in time order, as traffic_person_t records (9 bytes each,
+ * little endian). The header keeps the configuration the people were
+ * generated with, so a scenario can be told apart from another.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint8_t profile;
+    uint8_t building_count;
+    uint8_t floor_count;
+    uint8_t reserved[3];
+    uint32_t seed;
+    uint32_t duration;      // Time the people arrive in (ms)
+    uint32_t person_count;
+    double rate;
+
+} __attribute__((packed)) traffic_hdr_t;
+
+
+/* Traffic methods */
+
+bool generate_traffic(const traffic_config_t * config, uint32_t duration, std::vector<traffic_person_t> & people);
+bool write_scenario(const char * path, const traffic_config_t * config, uint32_t duration, const std::vector<traffic_person_t> & people);
+bool read_scenario(const char * path, traffic_config_t * config, uint32_t * duration, std::vector<traffic_person_t> & people);
+
+int find_traffic_profile(const char * name);
+
+#endif
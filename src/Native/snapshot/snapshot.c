@@ -0,0 +1,267 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+
+/* Private snapshot constants */
+
+#define STATE_WORD_CNT (sizeof(snapshot_state_t) / sizeof(uint64_t))
+
+_Static_assert(sizeof(snapshot_state_t) % sizeof(uint64_t) == 0, "The state of a device must be made of whole words");
+
+
+/* Private snapshot macros */
+
+#define get_snapshot_devices(hdr) ((snapshot_device_t *) ((hdr) + 1))
+#define get_snapshot_size(capacity) (sizeof(snapshot_hdr_t) + (size_t) (capacity) * sizeof(snapshot_device_t))
+
+// Words of a state (the state is only touched through atomic word accesses while it's shared)
+#define get_state_words(state) ((uint64_t *) (state))
+
+#define load_relaxed(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define store_relaxed(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+
+
+/* Public snapshot functions */
+
+/**Create a snapshot with room for a number of devices
+ *
+ * A snapshot a previous writer left behind with the same name is
+ * replaced. The object is zero filled by ftruncate, so every record
+ * starts with an even sequence.
+ */
+bool create_snapshot(snapshot_t * snapshot, const char * name, uint32_t capacity)
+{
+    size_t size = get_snapshot_size(capacity);
+
+    snapshot->hdr = NULL;
+    snapshot->is_owner = false;
+
+    if (strlen(name) >= sizeof(snapshot->name))
+    {
+        return false;
+    }
+
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    void * region = (ftruncate(fd, size) == 0)? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0): MAP_FAILED;
+    close(fd);
+
+    if (region == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return false;
+    }
+
+    snapshot->hdr = region;
+    snapshot->size = size;
+    snapshot->is_owner = true;
+    strcpy(snapshot->name, name);
+
+    snapshot->hdr->version = SNAPSHOT_VERSION;
+    snapshot->hdr->attr_cnt = SNAPSHOT_ATTR_CNT;
+    snapshot->hdr->device_size = sizeof(snapshot_device_t);
+    snapshot->hdr->capacity = capacity;
+    __atomic_store_n(&snapshot->hdr->magic, SNAPSHOT_MAGIC, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+
+// Add a device to a snapshot (SNAPSHOT_NO_DEVICE is returned if the snapshot is full)
+int32_t add_snapshot_device(snapshot_t * snapshot, uint16_t link, uint8_t tracker_id, uint16_t device_id)
+{
+    snapshot_hdr_t * hdr = snapshot->hdr;
+    uint32_t index = hdr->device_cnt;  // Only the writer changes the count
+
+    if (index >= hdr->capacity)
+    {
+        return SNAPSHOT_NO_DEVICE;
+    }
+
+    snapshot_device_t * device = &get_snapshot_devices(hdr)[index];
+
+    device->link = link;
+    device->tracker_id = tracker_id;
+    device->device_id = device_id;
+    memset(device->state.types, SNAPSHOT_NO_ATTR, sizeof(device->state.types));
+
+    __atomic_store_n(&hdr->device_cnt, index + 1, __ATOMIC_RELEASE);  // Publish the record once it's in place
+
+    return index;
+}
+
+
+/**Publish the value of a device attribute
+ *
+ * The sequence is made odd before the state is touched and even once
+ * it's done, so a reader that overlaps the update sees the sequence
+ * change and takes the state again.
+ */
+void write_snapshot_attr(snapshot_t * snapshot, uint32_t index, uint8_t attr_id, uint8_t type, const uint8_t * value, uint8_t size, uint64_t time_us)
+{
+    snapshot_device_t * device = &get_snapshot_devices(snapshot->hdr)[index];
+    uint64_t raw_value = 0;
+
+    if (attr_id >= SNAPSHOT_ATTR_CNT || size > SNAPSHOT_MAX_VALUE_SIZE)
+    {
+        return;
+    }
+
+    memcpy(&raw_value, value, size);
+
+    // Take the sizes and types in the words they share with the other attributes
+    snapshot_state_t state;
+    uint64_t * state_words = get_state_words(&state);
+    uint64_t * shared_words = get_state_words(&device->state);
+
+    for (size_t i = 0; i < STATE_WORD_CNT; i++)
+    {
+        state_words[i] = load_relaxed(&shared_words[i]);
+    }
+
+    state.updated_us = time_us;
+    state.values[attr_id] = raw_value;
+    state.types[attr_id] = type;
+    state.sizes[attr_id] = size;
+
+    uint32_t seq = load_relaxed(&device->seq);
+
+    store_relaxed(&device->seq, seq + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);  // The odd sequence is seen before any of the new state
+
+    for (size_t i = 0; i < STATE_WORD_CNT; i++)
+    {
+        store_relaxed(&shared_words[i], state_words[i]);
+    }
+
+    __atomic_store_n(&device->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+// Map a snapshot read-only
+bool open_snapshot(snapshot_t * snapshot, const char * name)
+{
+    struct stat attrs;
+
+    snapshot->hdr = NULL;
+    snapshot->is_owner = false;
+
+    if (strlen(name) >= sizeof(snapshot->name))
+    {
+        return false;
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    void * region = (fstat(fd, &attrs) == 0 && (size_t) attrs.st_size >= sizeof(snapshot_hdr_t))?
+        mmap(NULL, attrs.st_size, PROT_READ, MAP_SHARED, fd, 0): MAP_FAILED;
+    close(fd);
+
+    if (region == MAP_FAILED)
+    {
+        return false;
+    }
+
+    snapshot->hdr = region;
+    snapshot->size = attrs.st_size;
+    strcpy(snapshot->name, name);
+
+    // Only take snapshots with the layout of this build
+    snapshot_hdr_t * hdr = snapshot->hdr;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SNAPSHOT_MAGIC || hdr->version != SNAPSHOT_VERSION ||
+        hdr->attr_cnt != SNAPSHOT_ATTR_CNT || hdr->device_size != sizeof(snapshot_device_t) || get_snapshot_size(hdr->capacity) > snapshot->size)
+    {
+        close_snapshot(snapshot);
+        return false;
+    }
+
+    return true;
+}
+
+
+// Get the amount of devices that can be read from a snapshot
+uint32_t get_snapshot_device_count(const snapshot_t * snapshot)
+{
+    return __atomic_load_n(&snapshot->hdr->device_cnt, __ATOMIC_ACQUIRE);
+}
+
+
+/**Take a consistent copy of a device
+ *
+ * The read doesn't take locks or make syscalls. It only fails if the
+ * index is out of range or if the writer kept the record busy for
+ * SNAPSHOT_MAX_RETRIES reads (e.g., it died in the middle of an update).
+ */
+bool read_snapshot_device(const snapshot_t * snapshot, uint32_t index, snapshot_device_t * device)
+{
+    if (index >= get_snapshot_device_count(snapshot))
+    {
+        return false;
+    }
+
+    snapshot_device_t * shared_device = &get_snapshot_devices(snapshot->hdr)[index];
+    uint64_t * shared_words = get_state_words(&shared_device->state);
+    uint64_t * state_words = get_state_words(&device->state);
+
+    for (uint16_t retries = 0; retries < SNAPSHOT_MAX_RETRIES; retries++)
+    {
+        uint32_t seq = __atomic_load_n(&shared_device->seq, __ATOMIC_ACQUIRE);
+
+        if (seq & 1)  // The writer is in the middle of an update
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < STATE_WORD_CNT; i++)
+        {
+            state_words[i] = load_relaxed(&shared_words[i]);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);  // The state is taken before the sequence is checked again
+
+        if (load_relaxed(&shared_device->seq) == seq)
+        {
+            device->seq = seq;
+            device->link = shared_device->link;
+            device->tracker_id = shared_device->tracker_id;
+            device->device_id = shared_device->device_id;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Unmap a snapshot (the writer also removes it)
+void close_snapshot(snapshot_t * snapshot)
+{
+    if (snapshot->hdr == NULL)
+    {
+        return;
+    }
+
+    munmap(snapshot->hdr, snapshot->size);
+    if (snapshot->is_owner)
+    {
+        shm_unlink(snapshot->name);
+    }
+
+    snapshot->hdr = NULL;
+    snapshot->is_owner = false;
+}
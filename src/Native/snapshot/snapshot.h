@@ -0,0 +1,117 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Snapshot constants */
+
+#define SNAPSHOT_MAGIC          0x50414E53  // "SNAP" in little endian
+#define SNAPSHOT_VERSION        1
+#define SNAPSHOT_ATTR_CNT       16          // Attribute slots of a device (attribute ids above this are not published)
+#define SNAPSHOT_MAX_VALUE_SIZE 8           // Max size of a published attribute value
+#define SNAPSHOT_MAX_NAME_SIZE  256         // Max size of a shared memory object name (with its terminator)
+#define SNAPSHOT_MAX_RETRIES    1024        // Reads of a device before giving up on a writer that never finishes
+#define SNAPSHOT_NO_ATTR        0xFF        // Type of an attribute that wasn't published yet
+#define SNAPSHOT_NO_DEVICE      -1          // Returned when a device can't be added to a snapshot
+
+#define DEFAULT_SNAPSHOT_NAME "/elevator_snapshot"
+
+
+/**Snapshot layout
+ *
+ * A snapshot is a POSIX shared memory object with a header followed
+ * by an array of device records. The gateway is the only writer, and
+ * any number of processes can map the object read-only.
+ *
+ * Devices are appended as they are first heard of, and the count in
+ * the header is only raised once a record's identity is in place, so
+ * the link, tracker and device id of a record never change after it
+ * is counted. The state of a record is guarded by a seqlock: the
+ * writer makes the sequence odd while it updates the state, and a
+ * reader retries until it copies the state between two reads of the
+ * same even sequence.
+ */
+
+// Mutable part of a device record (copied a word at a time, so its size is a multiple of 8)
+typedef struct
+{
+    uint64_t updated_us;                              // Wall-clock time of the last update (us)
+    uint64_t values[SNAPSHOT_ATTR_CNT];               // Raw bytes of each value as the MCU sent them (zero padded)
+    uint8_t types[SNAPSHOT_ATTR_CNT];                 // Attribute type of each value (SNAPSHOT_NO_ATTR if unset)
+    uint8_t sizes[SNAPSHOT_ATTR_CNT];                 // Size of each value
+
+} snapshot_state_t;
+
+
+// A device in the snapshot (records are kept in separate cache lines)
+typedef struct
+{
+    uint32_t seq;        // Seqlock sequence of the state (odd while it's being written)
+    uint16_t link;       // Link of the MCU that has the device
+    uint16_t device_id;  // Id of the device in its MCU
+    uint8_t tracker_id;  // Tracker of the device in its MCU
+    uint8_t reserved[7];
+    snapshot_state_t state;
+
+} __attribute__((aligned(64))) snapshot_device_t;
+
+
+// Header at the start of the shared memory object
+typedef struct
+{
+    uint32_t magic;        // Set last, so readers don't take a snapshot that is being set up
+    uint16_t version;
+    uint16_t attr_cnt;
+    uint32_t device_size;  // Size of a device record, so readers can check the layout
+    uint32_t capacity;     // Device records in the object
+    uint32_t device_cnt;   // Device records in use
+
+} __attribute__((aligned(64))) snapshot_hdr_t;
+
+
+/* Snapshot objects */
+
+// A mapped snapshot
+typedef struct
+{
+    snapshot_hdr_t * hdr;
+    size_t size;
+    bool is_owner;                       // The snapshot was created by this process (it's removed when it's closed)
+    char name[SNAPSHOT_MAX_NAME_SIZE];
+
+} snapshot_t;
+
+
+/* Snapshot methods */
+
+// Writer methods
+
+bool create_snapshot(snapshot_t * snapshot, const char * name, uint32_t capacity);
+int32_t add_snapshot_device(snapshot_t * snapshot, uint16_t link, uint8_t tracker_id, uint16_t device_id);
+void write_snapshot_attr(snapshot_t * snapshot, uint32_t index, uint8_t attr_id, uint8_t type, const uint8_t * value, uint8_t size, uint64_t time_us);
+
+// Reader methods
+
+bool open_snapshot(snapshot_t * snapshot, const char * name);
+uint32_t get_snapshot_device_count(const snapshot_t * snapshot);
+bool read_snapshot_device(const snapshot_t * snapshot, uint32_t index, snapshot_device_t * device);
+
+void close_snapshot(snapshot_t * snapshot);
+
+#define snapshot_is_open(snapshot) ((snapshot)->hdr != NULL)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
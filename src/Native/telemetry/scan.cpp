@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include "telemetry.h"
+
+
+/* Scan constants */
+
+#define DEFAULT_LINK    0
+#define DEFAULT_TRACKER 0  // Tracker of the elevators
+
+
+/* Scan function prototypes */
+
+static void print_usage(const char * prog);
+static bool print_event(const telemetry_event_t * event, void * _);
+
+
+/* Main function */
+
+/**Print the attribute updates of a device in a telemetry log
+ *
+ * The updates in the time range [--from, --to) are printed one per line
+ * with their time (us), attribute id, attribute type and raw value
+ * (as an integer of its size). The range takes the whole log
+ * by default.
+ */
+int main(int argc, char * argv[])
+{
+    unsigned long link = DEFAULT_LINK;
+    unsigned long tracker_id = DEFAULT_TRACKER;
+    long device_id = -1;
+    uint64_t start_us = 0;
+    uint64_t end_us = UINT64_MAX;
+
+    static const struct option long_opts[] = {
+        {"link",    required_argument, NULL, 'l'},
+        {"tracker", required_argument, NULL, 't'},
+        {"device",  required_argument, NULL, 'd'},
+        {"from",    required_argument, NULL, 'f'},
+        {"to",      required_argument, NULL, 'u'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:t:d:f:u:", long_opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': link = strtoul(optarg, NULL, 10); break;
+            case 't': tracker_id = strtoul(optarg, NULL, 10); break;
+            case 'd': device_id = strtol(optarg, NULL, 10); break;
+            case 'f': start_us = strtoull(optarg, NULL, 10); break;
+            case 'u': end_us = strtoull(optarg, NULL, 10); break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || link > UINT16_MAX || tracker_id > UINT8_MAX || device_id < 0 || device_id > UINT16_MAX)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    telemetry_t telemetry;
+    if (!open_telemetry(&telemetry, argv[optind]))
+    {
+        fprintf(stderr, "Could not read the telemetry log %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t event_count = scan_telemetry(&telemetry, link, tracker_id, device_id, start_us, end_us, print_event, NULL);
+    fprintf(stderr, "%" PRIu64 " events in %u segments\n", event_count, telemetry.segment_count);
+
+    close_telemetry(&telemetry);
+    return EXIT_SUCCESS;
+}
+
+
+/* Scan functions */
+
+static void print_usage(const char * prog)
+{
+    fprintf(stderr, "usage: %s [--link N] [--tracker N] --device N [--from US] [--to US] DIR\n", prog);
+}
+
+
+static bool print_event(const telemetry_event_t * event, void * _)
+{
+    printf("%" PRIu64 " %u %c 0x%0*" PRIx64 "\n", event->time_us, event->attr_id, event->attr_type, 2 * event->size, event->value);
+    return true;
+}
@@ -0,0 +1,576 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <devices.h>
+
+#include "telemetry.h"
+
+
+/* Private telemetry constants */
+
+#define SEGMENT_SUFFIX     ".tlm"
+#define SEGMENT_NAME_SIZE  32  // Max size of the name of a segment file (with its terminator)
+#define NO_SEGMENT_NUM     UINT32_MAX
+
+
+/* Private telemetry function prototypes */
+
+static bool start_segment(telemetry_t * telemetry);
+static void close_segment(telemetry_segment_t * segment);
+static bool map_segment(telemetry_t * telemetry, uint32_t segment_num, telemetry_segment_t * segment);
+static bool get_segment_path(const telemetry_t * telemetry, uint32_t segment_num, char * path, size_t size);
+static uint32_t find_segment_nums(const char * path, uint32_t ** segment_nums);
+static int compare_segment_nums(const void * num_a, const void * num_b);
+static bool get_attr_number(uint8_t attr_type, uint64_t value, uint8_t size, int64_t * number);
+static uint32_t find_first_row(const telemetry_hdr_t * hdr, uint32_t row_count, uint64_t time_us);
+
+
+/* Private telemetry macros */
+
+#define get_segment_size(rows) (sizeof(telemetry_hdr_t) + (size_t) (rows) * (3 * sizeof(uint64_t) + 3 * sizeof(uint8_t)))
+
+// Columns of a segment
+#define get_time_column(hdr)   ((uint64_t *) ((hdr) + 1))
+#define get_value_column(hdr)  (get_time_column(hdr) + (hdr)->rows)
+#define get_device_column(hdr) (get_value_column(hdr) + (hdr)->rows)
+#define get_id_column(hdr)     ((uint8_t *) (get_device_column(hdr) + (hdr)->rows))
+#define get_type_column(hdr)   (get_id_column(hdr) + (hdr)->rows)
+#define get_size_column(hdr)   (get_type_column(hdr) + (hdr)->rows)
+
+#define load_relaxed(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define store_relaxed(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+
+
+/* Public telemetry functions */
+
+/**Create a telemetry log in a directory
+ *
+ * The directory is made if it's not there. The segments a previous
+ * writer left in it are kept, and the new events go to a segment
+ * after the last of them, so a log can span many runs of the gateway.
+ */
+bool create_telemetry(telemetry_t * telemetry, const char * path, uint32_t rows)
+{
+    uint32_t * segment_nums;
+
+    telemetry->is_open = false;
+    telemetry->is_writer = true;
+    telemetry->current.hdr = NULL;
+    telemetry->segments = NULL;
+    telemetry->segment_count = 0;
+
+    if (strlen(path) >= sizeof(telemetry->path) || !rows)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (mkdir(path, 0755) && errno != EEXIST)
+    {
+        return false;
+    }
+
+    strcpy(telemetry->path, path);
+    telemetry->rows = rows;
+
+    uint32_t segment_count = find_segment_nums(path, &segment_nums);
+    if (segment_count == NO_SEGMENT_NUM)
+    {
+        return false;
+    }
+
+    telemetry->next_num = segment_count? segment_nums[segment_count - 1] + 1: 0;
+    free(segment_nums);
+
+    if (!start_segment(telemetry))
+    {
+        return false;
+    }
+
+    telemetry->is_open = true;
+    return true;
+}
+
+
+/**Append an event to a telemetry log
+ *
+ * The event is written to the columns and the indexes of the current
+ * segment before it's counted. A new segment is started when the
+ * current one is full.
+ */
+bool write_telemetry_event(telemetry_t * telemetry, const telemetry_event_t * event)
+{
+    telemetry_hdr_t * hdr = telemetry->current.hdr;
+
+    if (hdr->row_count == hdr->rows)
+    {
+        close_segment(&telemetry->current);
+        if (!start_segment(telemetry))
+        {
+            return false;
+        }
+        hdr = telemetry->current.hdr;
+    }
+
+    uint32_t row = hdr->row_count;  // Only the writer changes the count
+    uint64_t device = get_telemetry_device(event->link, event->tracker_id, event->device_id);
+
+    get_time_column(hdr)[row] = event->time_us;
+    get_value_column(hdr)[row] = event->value;
+    get_device_column(hdr)[row] = device;
+    get_id_column(hdr)[row] = event->attr_id;
+    get_type_column(hdr)[row] = event->attr_type;
+    get_size_column(hdr)[row] = event->size;
+
+    // Widen the indexes to the event
+    if (!row)
+    {
+        store_relaxed(&hdr->min_time_us, event->time_us);
+        store_relaxed(&hdr->max_time_us, event->time_us);
+        store_relaxed(&hdr->min_device, device);
+        store_relaxed(&hdr->max_device, device);
+    }
+    else
+    {
+        if (event->time_us < hdr->max_time_us)
+        {
+            store_relaxed(&hdr->is_sorted, 0);
+        }
+        if (event->time_us < hdr->min_time_us)
+        {
+            store_relaxed(&hdr->min_time_us, event->time_us);
+        }
+        if (event->time_us > hdr->max_time_us)
+        {
+            store_relaxed(&hdr->max_time_us, event->time_us);
+        }
+        if (device < hdr->min_device)
+        {
+            store_relaxed(&hdr->min_device, device);
+        }
+        if (device > hdr->max_device)
+        {
+            store_relaxed(&hdr->max_device, device);
+        }
+    }
+
+    int64_t number;
+    if (event->attr_id < TELEMETRY_ATTR_CNT && get_attr_number(event->attr_type, event->value, event->size, &number))
+    {
+        telemetry_range_t * range = &hdr->values[event->attr_id];
+
+        if (!range->count || number < range->min)
+        {
+            store_relaxed(&range->min, number);
+        }
+        if (!range->count || number > range->max)
+        {
+            store_relaxed(&range->max, number);
+        }
+        store_relaxed(&range->count, range->count + 1);
+    }
+
+    __atomic_store_n(&hdr->row_count, row + 1, __ATOMIC_RELEASE);  // Publish the event once it's in place
+
+    return true;
+}
+
+
+/**Map the segments of a telemetry log read-only
+ *
+ * The log can still be written while it's open. The events the writer
+ * adds to the mapped segments are seen right away, and the segments it
+ * starts afterwards are taken by refreshing the log.
+ */
+bool open_telemetry(telemetry_t * telemetry, const char * path)
+{
+    telemetry->is_open = false;
+    telemetry->is_writer = false;
+    telemetry->current.hdr = NULL;
+    telemetry->segments = NULL;
+    telemetry->segment_count = 0;
+    telemetry->next_num = 0;
+
+    if (strlen(path) >= sizeof(telemetry->path))
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    strcpy(telemetry->path, path);
+    telemetry->is_open = true;
+
+    if (!refresh_telemetry(telemetry))
+    {
+        close_telemetry(telemetry);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**Map the segments that were started since the log was last refreshed
+ *
+ * A segment that is still being set up by the writer is left for the
+ * next refresh, along with the ones after it, so the segments of a
+ * reader are always in order.
+ */
+bool refresh_telemetry(telemetry_t * telemetry)
+{
+    uint32_t * segment_nums;
+    uint32_t segment_count = find_segment_nums(telemetry->path, &segment_nums);
+
+    if (segment_count == NO_SEGMENT_NUM)
+    {
+        return false;
+    }
+
+    telemetry_segment_t * segments = realloc(telemetry->segments, (telemetry->segment_count + segment_count + 1) * sizeof(telemetry_segment_t));
+    if (segments == NULL)
+    {
+        free(segment_nums);
+        return false;
+    }
+    telemetry->segments = segments;
+
+    for (uint32_t i = 0; i < segment_count; i++)
+    {
+        if (segment_nums[i] < telemetry->next_num)
+        {
+            continue;
+        }
+
+        if (!map_segment(telemetry, segment_nums[i], &segments[telemetry->segment_count]))
+        {
+            break;
+        }
+
+        telemetry->segment_count++;
+        telemetry->next_num = segment_nums[i] + 1;
+    }
+
+    free(segment_nums);
+    return true;
+}
+
+
+/**Scan the events of a device in a time range [start_us, end_us)
+ *
+ * The segments whose indexes don't take in the device or the range are
+ * skipped as a whole. The rows of a segment in time order are found by
+ * a binary search of its time column, and the device column is only
+ * compared as integers, so the scan doesn't parse anything. The amount
+ * of events that were passed to the callback is given out.
+ */
+uint64_t scan_telemetry(const telemetry_t * telemetry, uint16_t link, uint8_t tracker_id, uint16_t device_id,
+                        uint64_t start_us, uint64_t end_us, telemetry_scan_cb scan_cb, void * data)
+{
+    uint64_t device = get_telemetry_device(link, tracker_id, device_id);
+    uint64_t event_count = 0;
+    telemetry_event_t event = {.link = link, .tracker_id = tracker_id, .device_id = device_id};
+
+    for (uint32_t i = 0; i < telemetry->segment_count; i++)
+    {
+        const telemetry_hdr_t * hdr = telemetry->segments[i].hdr;
+        uint32_t row_count = __atomic_load_n(&hdr->row_count, __ATOMIC_ACQUIRE);
+
+        if (!row_count || load_relaxed(&hdr->max_time_us) < start_us || load_relaxed(&hdr->min_time_us) >= end_us ||
+            device < load_relaxed(&hdr->min_device) || device > load_relaxed(&hdr->max_device))
+        {
+            continue;
+        }
+
+        const uint64_t * times = get_time_column(hdr);
+        const uint64_t * devices = get_device_column(hdr);
+        bool is_sorted = load_relaxed(&hdr->is_sorted);
+
+        for (uint32_t row = is_sorted? find_first_row(hdr, row_count, start_us): 0; row < row_count; row++)
+        {
+            if (times[row] >= end_us && is_sorted)
+            {
+                break;
+            }
+
+            if (devices[row] != device || times[row] < start_us || times[row] >= end_us)
+            {
+                continue;
+            }
+
+            event.time_us = times[row];
+            event.value = get_value_column(hdr)[row];
+            event.attr_id = get_id_column(hdr)[row];
+            event.attr_type = get_type_column(hdr)[row];
+            event.size = get_size_column(hdr)[row];
+            event_count++;
+
+            if (!scan_cb(&event, data))
+            {
+                return event_count;
+            }
+        }
+    }
+
+    return event_count;
+}
+
+
+// Unmap the segments of a telemetry log
+void close_telemetry(telemetry_t * telemetry)
+{
+    if (!telemetry->is_open)
+    {
+        return;
+    }
+
+    close_segment(&telemetry->current);
+
+    for (uint32_t i = 0; i < telemetry->segment_count; i++)
+    {
+        close_segment(&telemetry->segments[i]);
+    }
+
+    free(telemetry->segments);
+    telemetry->segments = NULL;
+    telemetry->segment_count = 0;
+    telemetry->is_open = false;
+}
+
+
+/* Private telemetry functions */
+
+/**Start the next segment of a log
+ *
+ * The file is sized for all of its rows up front, so readers can map
+ * it as a whole while it's filled. It's zero filled by ftruncate, and
+ * the magic number is set last, so readers don't take a segment that
+ * is being set up.
+ */
+static bool start_segment(telemetry_t * telemetry)
+{
+    char path[TELEMETRY_MAX_PATH_SIZE + SEGMENT_NAME_SIZE];
+    size_t size = get_segment_size(telemetry->rows);
+
+    if (!get_segment_path(telemetry, telemetry->next_num, path, sizeof(path)))
+    {
+        return false;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    void * region = (ftruncate(fd, size) == 0)? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0): MAP_FAILED;
+    close(fd);
+
+    if (region == MAP_FAILED)
+    {
+        unlink(path);
+        return false;
+    }
+
+    telemetry_hdr_t * hdr = region;
+
+    hdr->version = TELEMETRY_VERSION;
+    hdr->attr_cnt = TELEMETRY_ATTR_CNT;
+    hdr->rows = telemetry->rows;
+    hdr->segment_num = telemetry->next_num;
+    hdr->is_sorted = 1;
+    __atomic_store_n(&hdr->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+
+    telemetry->current.hdr = hdr;
+    telemetry->current.size = size;
+    telemetry->next_num++;
+
+    return true;
+}
+
+
+static void close_segment(telemetry_segment_t * segment)
+{
+    if (segment->hdr != NULL)
+    {
+        munmap(segment->hdr, segment->size);
+        segment->hdr = NULL;
+    }
+}
+
+
+// Map a segment read-only (only segments with the layout of this build are taken)
+static bool map_segment(telemetry_t * telemetry, uint32_t segment_num, telemetry_segment_t * segment)
+{
+    char path[TELEMETRY_MAX_PATH_SIZE + SEGMENT_NAME_SIZE];
+    struct stat attrs;
+
+    if (!get_segment_path(telemetry, segment_num, path, sizeof(path)))
+    {
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    void * region = (fstat(fd, &attrs) == 0 && (size_t) attrs.st_size >= sizeof(telemetry_hdr_t))?
+        mmap(NULL, attrs.st_size, PROT_READ, MAP_SHARED, fd, 0): MAP_FAILED;
+    close(fd);
+
+    if (region == MAP_FAILED)
+    {
+        return false;
+    }
+
+    segment->hdr = region;
+    segment->size = attrs.st_size;
+
+    telemetry_hdr_t * hdr = segment->hdr;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC || hdr->version != TELEMETRY_VERSION ||
+        hdr->attr_cnt != TELEMETRY_ATTR_CNT || get_segment_size(hdr->rows) > segment->size)
+    {
+        close_segment(segment);
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool get_segment_path(const telemetry_t * telemetry, uint32_t segment_num, char * path, size_t size)
+{
+    int length = snprintf(path, size, "%s/%06u" SEGMENT_SUFFIX, telemetry->path, segment_num);
+    return length > 0 && (size_t) length < size;
+}
+
+
+/**Find the numbers of the segments in a log directory
+ *
+ * The numbers are given out in order in an array that must be freed.
+ * NO_SEGMENT_NUM is given out if the directory can't be read.
+ */
+static uint32_t find_segment_nums(const char * path, uint32_t ** segment_nums)
+{
+    uint32_t segment_count = 0;
+    uint32_t capacity = 0;
+    struct dirent * entry;
+
+    *segment_nums = NULL;
+
+    DIR * dir = opendir(path);
+    if (dir == NULL)
+    {
+        return NO_SEGMENT_NUM;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char * suffix;
+        unsigned long segment_num = strtoul(entry->d_name, &suffix, 10);
+
+        if (suffix == entry->d_name || strcmp(suffix, SEGMENT_SUFFIX) || segment_num >= NO_SEGMENT_NUM)
+        {
+            continue;
+        }
+
+        if (segment_count == capacity)
+        {
+            capacity = capacity? 2 * capacity: 16;
+
+            uint32_t * nums = realloc(*segment_nums, capacity * sizeof(uint32_t));
+            if (nums == NULL)
+            {
+                free(*segment_nums);
+                *segment_nums = NULL;
+                closedir(dir);
+                return NO_SEGMENT_NUM;
+            }
+            *segment_nums = nums;
+        }
+
+        (*segment_nums)[segment_count++] = segment_num;
+    }
+
+    closedir(dir);
+    qsort(*segment_nums, segment_count, sizeof(uint32_t), compare_segment_nums);
+
+    return segment_count;
+}
+
+
+static int compare_segment_nums(const void * num_a, const void * num_b)
+{
+    uint32_t a = *(const uint32_t *) num_a;
+    uint32_t b = *(const uint32_t *) num_b;
+
+    return (a > b) - (a < b);
+}
+
+
+// Take the value of an integer attribute (floats are not taken)
+static bool get_attr_number(uint8_t attr_type, uint64_t value, uint8_t size, int64_t * number)
+{
+    if (!size || size > sizeof(uint64_t))
+    {
+        return false;
+    }
+
+    switch (attr_type)
+    {
+        case ATTR_INT8_T:
+        case ATTR_INT16_T:
+        case ATTR_INT32_T:
+        case ATTR_INT64_T:
+        case ATTR_SSIZE_T:
+        {
+            uint8_t shift = 64 - 8 * size;
+            *number = (int64_t) (value << shift) >> shift;  // Sign extend the value from its size
+            return true;
+        }
+        case ATTR_UINT8_T:
+        case ATTR_UINT16_T:
+        case ATTR_UINT32_T:
+        case ATTR_UINT64_T:
+        case ATTR_SIZE_T:
+        case ATTR_BOOL:
+        case ATTR_CHAR:
+            *number = value;
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+// Find the first row of a segment in time order that is at or after a time
+static uint32_t find_first_row(const telemetry_hdr_t * hdr, uint32_t row_count, uint64_t time_us)
+{
+    const uint64_t * times = get_time_column(hdr);
+    uint32_t low = 0;
+    uint32_t high = row_count;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (times[middle] < time_us)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
@@ -0,0 +1,154 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Telemetry constants */
+
+#define TELEMETRY_MAGIC         0x4D4C4554  // "TELM" in little endian
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_ATTR_CNT      16          // Attributes with a value index in a segment (attribute ids above this are still logged)
+#define TELEMETRY_MAX_PATH_SIZE 256         // Max size of the path of a log directory (with its terminator)
+
+#define DEFAULT_SEGMENT_ROWS 65536  // Events a segment has room for
+
+
+/**Telemetry layout
+ *
+ * A telemetry log is a directory of segment files, which are named
+ * after their number (e.g., 000042.tlm). Every segment has room for
+ * the same amount of events, and the writer starts the next segment
+ * once the current one is full, so old segments can be removed or
+ * archived by their number.
+ *
+ * A segment is mapped as a whole. It starts with a header, which has
+ * the min/max indexes of the segment, followed by a column for each
+ * field of the events:
+ *
+ *   time_us:   uint64_t[rows]
+ *   value:     uint64_t[rows] (raw bytes as the MCU sent them, zero padded)
+ *   device:    uint64_t[rows] (key of the link, tracker and device id)
+ *   attr_id:   uint8_t[rows]
+ *   attr_type: uint8_t[rows]
+ *   size:      uint8_t[rows]
+ *
+ * The writer is the only one that touches a segment. An event is
+ * written to every column and to the indexes before the row count is
+ * raised, so a reader only takes the rows below the count it loaded,
+ * and the indexes it loads afterwards cover all of them.
+ */
+
+// Range of the integer values of an attribute in a segment
+typedef struct
+{
+    int64_t min;
+    int64_t max;
+    uint32_t count;  // Values in the range (0 if the attribute isn't in the segment)
+    uint32_t reserved;
+
+} telemetry_range_t;
+
+
+// Header at the start of a segment
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t attr_cnt;
+    uint32_t rows;                                   // Events the segment has room for
+    uint32_t row_count;                              // Events in the segment
+    uint32_t segment_num;
+    uint8_t is_sorted;                               // The events are in time order (the wall clock never went back)
+    uint8_t reserved[3];
+
+    // Segment index
+    uint64_t min_time_us;
+    uint64_t max_time_us;
+    uint64_t min_device;
+    uint64_t max_device;
+    telemetry_range_t values[TELEMETRY_ATTR_CNT];    // Integer values of each attribute (floats aren't indexed)
+
+} __attribute__((aligned(64))) telemetry_hdr_t;
+
+
+/* Telemetry objects */
+
+// An event of the log
+typedef struct
+{
+    uint64_t time_us;  // Wall-clock time of the update (us)
+    uint64_t value;    // Raw bytes of the value (zero padded)
+    uint16_t link;     // Link of the MCU that has the device
+    uint8_t tracker_id;
+    uint16_t device_id;
+    uint8_t attr_id;
+    uint8_t attr_type;
+    uint8_t size;      // Size of the value
+
+} telemetry_event_t;
+
+
+// A mapped segment
+typedef struct
+{
+    telemetry_hdr_t * hdr;
+    size_t size;
+
+} telemetry_segment_t;
+
+
+// A telemetry log that is being written or read
+typedef struct
+{
+    char path[TELEMETRY_MAX_PATH_SIZE];
+    uint32_t rows;                     // Events of a new segment
+    uint32_t next_num;                 // Number of the next segment
+    bool is_open;
+    bool is_writer;
+    telemetry_segment_t current;       // Segment the writer is filling
+    telemetry_segment_t * segments;    // Segments of a reader, in order
+    uint32_t segment_count;
+
+} telemetry_t;
+
+
+// Called for every event of a scan (the scan stops if it returns false)
+typedef bool (*telemetry_scan_cb)(const telemetry_event_t * event, void * data);
+
+
+/* Telemetry methods */
+
+// Writer methods
+
+bool create_telemetry(telemetry_t * telemetry, const char * path, uint32_t rows);
+bool write_telemetry_event(telemetry_t * telemetry, const telemetry_event_t * event);
+
+// Reader methods
+
+bool open_telemetry(telemetry_t * telemetry, const char * path);
+bool refresh_telemetry(telemetry_t * telemetry);
+uint64_t scan_telemetry(const telemetry_t * telemetry, uint16_t link, uint8_t tracker_id, uint16_t device_id,
+                        uint64_t start_us, uint64_t end_us, telemetry_scan_cb scan_cb, void * data);
+
+void close_telemetry(telemetry_t * telemetry);
+
+#define telemetry_is_open(telemetry) ((telemetry)->is_open)
+
+// Key of a device in the device column (the link, tracker and device id of an event, in that order)
+#define get_telemetry_device(link, tracker_id, device_id) (((uint64_t) (link) << 24) | ((uint64_t) (tracker_id) << 16) | (device_id))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,9 @@ _DEV_INFO = {  # A dict to map specific devices to its info (baudrate, endiannes
 
 _TASK_COUNT = 10  # Available tasks to be scheduled for the schedulers
 
+_GATEWAY_SOCKET_ENV = "ELEVATOR_GATEWAY_SOCKET"  # Environment variable with the socket of the native gateway
+_VIRTUAL_MCUS_ENV = "ELEVATOR_VIRTUAL_MCUS"  # Environment variable with the ports of the Linux firmware builds (os.pathsep separated)
+
 
 # Configuraion functions
 
@@ -66,12 +69,31 @@ def import_platform(platform_name):
 
 
 def setup_mcu_channels():
-    """Find devices conneceted to ports and create messengers to interact with them"""
-
-    mcu_list = list_ports.comports()
-    for mcu in mcu_list:
-        dev_info = _get_dev_info(mcu.name)
-        messengers.SerialMessenger(mcu.device, dev_info[0], _TASK_COUNT, dev_info[1])
+    """Find devices conneceted to ports and create messengers to interact with them
+
+    If the native gateway is running (its socket is given through the
+    gateway environment variable), the messengers talk to the MCUs
+    through it. Otherwise, each messenger opens its own serial port.
+
+    Pseudo-terminals are not listed as serial ports, so the ports of
+    the firmware's Linux builds (src/Native/arduino) are given through
+    the virtual MCUs environment variable instead.
+    """
+
+    gateway_socket = os.environ.get(_GATEWAY_SOCKET_ENV)
+    virtual_mcus = os.environ.get(_VIRTUAL_MCUS_ENV)
+
+    if virtual_mcus is not None:
+        mcu_ports = [(os.path.basename(port), port) for port in virtual_mcus.split(os.pathsep) if port]
+    else:
+        mcu_ports = [(mcu.name, mcu.device) for mcu in list_ports.comports()]
+
+    for port_name, port in mcu_ports:
+        dev_info = _get_dev_info(port_name)
+        if gateway_socket is not None:
+            messengers.GatewayMessenger(gateway_socket, port, _TASK_COUNT, dev_info[1])
+        else:
+            messengers.SerialMessenger(port, dev_info[0], _TASK_COUNT, dev_info[1])
 
 
 def _get_dev_info(port_name):
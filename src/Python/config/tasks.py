@@ -59,13 +59,15 @@ def register_tracker(_, pkt):
 def register_device(thread_id, pkt):
     """Register an instance of the device using info of the mcu with a given name"""
 
-    # Get pkt info
+    # Get pkt info (the first device id and the device count of the group are device ids)
     tracker_id = pkt[0]
-    device_count = pkt[1]
+    group_id = pkt[1]
+    first_device_id = devices.unpack_device_id(thread_id, pkt[2:])
+    device_count = devices.unpack_device_id(thread_id, pkt[2 + devices.DEVICE_ID_SIZE:])
 
     tracker = devices.DeviceTracker.get_tracker(tracker_id=tracker_id)
     if tracker is not None:
-        tracker.add_devices(device_count, thread_id)
+        tracker.add_devices(device_count, thread_id, group_id, first_device_id)
 
 
 def register_tester(_, pkt):
@@ -106,10 +108,11 @@ def update_device_attr_comp(thread_id, pkt):
 
     # Get pkt info
     tracker_id = pkt[0]
-    device_id = pkt[1]
-    attr_id = pkt[2]
-    attr_type = str(pkt[3:4])
-    value_pkt = pkt[4:]
+    device_id = devices.unpack_device_id(thread_id, pkt[1:])
+    attr_offset = 1 + devices.DEVICE_ID_SIZE
+    attr_id = pkt[attr_offset]
+    attr_type = str(pkt[attr_offset + 1:attr_offset + 2])
+    value_pkt = pkt[attr_offset + 2:]
 
     devices.DeviceTracker.update_device_attr_comp(tracker_id, attr_id, device_id, thread_id,
                                                 attr_type, value_pkt)
@@ -59,6 +59,13 @@ def elevator_statuses():
         print("\n")
 
 
+def resync():
+    """Request a snapshot of every elevator to refresh their states"""
+
+    manager.request_elevator_snapshots()
+    print("A snapshot of the elevators has been requested.")
+
+
 # Helpers for the elevator cli commands
 
 def _generate_person_pkt(elevator):
@@ -67,4 +74,4 @@ def _generate_person_pkt(elevator):
     weight = random.randint(115, 230)  # Possible weight range
     temperature = random.randint(0, 2)  # Possible temperature differential
 
-    return struct.pack("BBB", elevator.device_id, temperature, weight)
+    return devices.pack_device_id(elevator.thread_id, elevator.device_id) + struct.pack("BB", temperature, weight)
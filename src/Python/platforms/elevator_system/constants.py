@@ -2,13 +2,14 @@
 
 NULL_FLOOR = 0  # Floor that represents an invalid floor to go to
 ELEVATOR_TRACKER = 0  # Tracker id for the elevator devices
+ELEVATOR_CAPACITY = 10  # Max amount of people in an elevator (its capacity attribute is the amount of people in it)
 SET_TASKS = {
     "light_state": "uint8_t",
     "door_state": "uint8_t",
     "current_floor": "uint8_t",
     "temperature": "uint8_t",
     "weight": "uint16_t",
-    "maintenance_state": "uint8_t"
+    "maintanence_state": "uint8_t"  # Spelled like the attribute the MCUs register
 }
 
 # Tasks ids for the elevator system
@@ -20,3 +21,22 @@ REMOVE_CAR_FROM_FLOOR = 3
 ALERT_PERSON_REMOVAL = 4
 ENTER_ELEVATOR = 5
 REQUEST_ELEVATOR = 6
+REQUEST_ELEVATOR_FLOORS = 7
+REQUEST_ELEVATOR_SNAPSHOT = 8
+PASS_ELEVATOR_SNAPSHOT = 9
+
+FLOOR_BATCH_SIZE = 8  # Bytes of the floor bitmap of a batched request
+FLOOR_BATCH_FLOORS = FLOOR_BATCH_SIZE * 8  # Floors a batched request covers from its first floor
+
+# States of the elevator behaviors
+
+IDLE = 0
+START = 1
+MOVING = 2
+EMERGENCY = 3
+MAINTENANCE = 4
+
+# Layout of a car snapshot (each car of a snapshot is passed in its own packet)
+
+SNAPSHOT_LAST_CAR = 0x01  # Flag of the last car of a snapshot
+SNAPSHOT_FORMAT = "BBBBBHBBBBBBB"  # Fields after the device id, from the number of the snapshot to the max amount of people in the car
@@ -0,0 +1,207 @@
+
+import os
+import ctypes
+
+from . import constants
+from ...tools import devices
+
+
+DISPATCH_NO_CAR = -1  # Returned by the engine when no car can take a hall call
+DISPATCH_NO_ARRIVAL = 0xFFFFFFFF  # Returned by the engine when a car can't reach a landing
+DISPATCH_LIB_ENV = "ELEVATOR_DISPATCH_LIB"  # Environment variable to override the library's location
+_DEFAULT_DISPATCH_LIB = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                     "..", "..", "..", "Native", "build", "libelevator_dispatch.so")
+
+
+def load_dispatch_lib():
+    """Load the native dispatch library (None is returned if it's not available)"""
+
+    try:
+        lib = ctypes.CDLL(os.environ.get(DISPATCH_LIB_ENV, _DEFAULT_DISPATCH_LIB))
+    except OSError:
+        return None
+
+    lib.create_dispatch_engine.restype = ctypes.c_void_p
+    lib.create_dispatch_engine.argtypes = []
+    lib.deinit_dispatch_engine.restype = None
+    lib.deinit_dispatch_engine.argtypes = [ctypes.c_void_p]
+    lib.add_dispatch_car.restype = ctypes.c_bool
+    lib.add_dispatch_car.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint8,
+                                     ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint8]
+    lib.set_dispatch_car_state.restype = None
+    lib.set_dispatch_car_state.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint8,
+                                           ctypes.c_uint8, ctypes.c_uint8, ctypes.c_bool]
+    lib.set_dispatch_car_load.restype = None
+    lib.set_dispatch_car_load.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint16]
+    lib.set_dispatch_car_motion.restype = ctypes.c_bool
+    lib.set_dispatch_car_motion.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint16,
+                                            ctypes.c_uint16, ctypes.c_uint16, ctypes.c_uint16]
+    lib.alert_dispatch_arrival.restype = None
+    lib.alert_dispatch_arrival.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint8]
+    lib.alert_dispatch_departure.restype = None
+    lib.alert_dispatch_departure.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint8]
+    lib.find_dispatch_car.restype = ctypes.c_int32
+    lib.find_dispatch_car.argtypes = [ctypes.c_void_p, ctypes.c_uint8, ctypes.c_uint8,
+                                      ctypes.POINTER(ctypes.c_uint32)]
+    lib.commit_dispatch_stop.restype = None
+    lib.commit_dispatch_stop.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint8]
+    lib.estimate_dispatch_arrival.restype = ctypes.c_uint32
+    lib.estimate_dispatch_arrival.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint8]
+
+    return lib
+
+
+class DispatchEngine:
+    """Python side of the native dispatch engine
+
+    The elevators of each group (an mcu's building) share a set of
+    landings. Since every elevator names and numbers its floors on its
+    own, the landings of a group are taken from the elevator with the
+    most floors, and the floor names no other elevator has are placed
+    on top of them.
+    """
+
+    def __init__(self, lib):
+
+        self._lib = lib
+        self._engine = lib.create_dispatch_engine()
+        self._group_ids = {}  # Map an (thread id, mcu group id) pair to an engine group id
+        self._landings = []  # Map a floor name to a landing for each engine group
+        self._cars = {}  # Map a car id in the engine to its device
+
+    @classmethod
+    def create(cls):
+        """Create a dispatch engine if the native library is available"""
+
+        lib = load_dispatch_lib()
+        if lib is None:
+            return None
+
+        engine = cls(lib)
+        if not engine._engine:
+            return None
+        return engine
+
+    def close(self):
+        """Free the native engine"""
+
+        if self._engine:
+            self._lib.deinit_dispatch_engine(self._engine)
+            self._engine = None
+
+    def add_elevators(self, elevators):
+        """Register the elevators in the engine by their group
+
+        Elevators that haven't passed all their floor names are left
+        out of the engine.
+        """
+
+        groups = {}
+        for elevator in elevators:
+            if elevator.floors and sorted(elevator.floors.values()) == list(range(1, len(elevator.floors) + 1)):
+                groups.setdefault((elevator.thread_id, elevator.group_id), []).append(elevator)
+
+        for group_key, group_elevators in groups.items():
+            group_id = self._group_ids[group_key] = len(self._landings)
+            landings = self._make_landings(group_elevators)
+            self._landings.append(landings)
+
+            for elevator in group_elevators:
+                car_id = self._get_car_id(elevator)
+                floor_landings = [0] * len(elevator.floors)
+                for floor_name, floor_num in elevator.floors.items():
+                    floor_landings[floor_num - 1] = landings[floor_name]
+
+                floor_landings = (ctypes.c_uint8 * len(floor_landings))(*floor_landings)
+                if self._lib.add_dispatch_car(self._engine, car_id, group_id, floor_landings, len(floor_landings)):
+                    self._cars[car_id] = elevator
+                    self.update_elevator(elevator)
+
+    def update_elevator(self, elevator):
+        """Pass the state of an elevator to the engine"""
+
+        car_id = self._get_car_id(elevator)
+        if car_id in self._cars:
+            has_room = elevator.capacity is not None and elevator.capacity < constants.ELEVATOR_CAPACITY
+            available = has_room and not (elevator.maintanence_state or elevator.emergency_state)
+            self._lib.set_dispatch_car_state(self._engine, car_id, elevator.current_floor or constants.NULL_FLOOR,
+                                             elevator.next_floor or constants.NULL_FLOOR, elevator.movement or 0,
+                                             available)
+            self._lib.set_dispatch_car_load(self._engine, car_id, elevator.weight or 0)
+
+    def set_elevator_motion(self, elevator, speed, accel, floor_height, dwell):
+        """Give an elevator its own motion (mm/s, mm/s^2, mm and ms)"""
+
+        car_id = self._get_car_id(elevator)
+        if car_id in self._cars:
+            return self._lib.set_dispatch_car_motion(self._engine, car_id, speed, accel, floor_height, dwell)
+        return False
+
+    def estimate_arrival(self, elevator, floor_name):
+        """Estimate the time an elevator takes to reach one of its floors (None if it can't)"""
+
+        car_id = self._get_car_id(elevator)
+        if car_id in self._cars and floor_name in elevator.floors:
+            landings = self._landings[self._group_ids[(elevator.thread_id, elevator.group_id)]]
+            arrival = self._lib.estimate_dispatch_arrival(self._engine, car_id, landings[floor_name])
+            if arrival != DISPATCH_NO_ARRIVAL:
+                return arrival
+        return None
+
+    def arrived(self, elevator, floor_name):
+        """An elevator reached one of its floors"""
+
+        car_id = self._get_car_id(elevator)
+        if car_id in self._cars and floor_name in elevator.floors:
+            self._lib.alert_dispatch_arrival(self._engine, car_id, elevator.floors[floor_name])
+
+    def departed(self, elevator, floor_name):
+        """An elevator left one of its floors"""
+
+        car_id = self._get_car_id(elevator)
+        if car_id in self._cars and floor_name in elevator.floors:
+            self._lib.alert_dispatch_departure(self._engine, car_id, elevator.floors[floor_name])
+
+    def find_elevator(self, floor_name):
+        """Assign a hall call to the group's elevator with the lowest cost
+
+        A floor name can be in more than one group, so the cheapest car
+        of all the groups that have the floor is the one that is used.
+        """
+
+        chosen_car = DISPATCH_NO_CAR
+        chosen_landing = None
+        chosen_cost = None
+
+        cost = ctypes.c_uint32()
+        for group_id, landings in enumerate(self._landings):
+            landing = landings.get(floor_name)
+            if landing is not None:
+                car_id = self._lib.find_dispatch_car(self._engine, group_id, landing, ctypes.byref(cost))
+                if car_id != DISPATCH_NO_CAR and (chosen_cost is None or cost.value < chosen_cost):
+                    chosen_car, chosen_landing, chosen_cost = car_id, landing, cost.value
+
+        if chosen_car == DISPATCH_NO_CAR:
+            return None
+
+        self._lib.commit_dispatch_stop(self._engine, chosen_car, chosen_landing)
+        return self._cars[chosen_car]
+
+    @staticmethod
+    def _get_car_id(elevator):
+        """Elevators use their computer id in the engine"""
+
+        tracker = devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER)
+        return tracker.get_cu_id(device_name=elevator.name)
+
+    @staticmethod
+    def _make_landings(elevators):
+        """Map the floor names of a group of elevators to its landings"""
+
+        base_elevator = max(elevators, key=lambda elevator: len(elevator.floors))
+        floor_names = sorted(base_elevator.floors, key=base_elevator.floors.get)
+        for elevator in elevators:
+            floor_names.extend(sorted((name for name in elevator.floors if name not in floor_names),
+                                      key=elevator.floors.get))
+
+        return dict((floor_name, landing) for landing, floor_name in enumerate(floor_names, 1))
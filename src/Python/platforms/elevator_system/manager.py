@@ -1,55 +1,146 @@
 import threading
 
-from . import constants
+from . import constants, dispatch
 from ...tools import devices, testers
 
 
+# Manager constants
+
+_RETRY_TIMEOUT = 0.1  # Time to wait before retrying the requests that couldn't be assigned (in seconds)
+
+
 # Manager variables
 
 _positions = {}  # Current positions for the elevators
 _requests = set()  # Storage for requests
 _manager_thread = None  # Thread that runs the elevator manager
+_dispatch_engine = None  # Native dispatch engine (None if the library is not available)
+_closing = False  # Indicates the manager thread must stop
 
 _MANAGER_LOCK = threading.Lock()
+_MANAGER_CONDITION = threading.Condition(_MANAGER_LOCK)  # Wakes the manager when there's something to do
 
 
 def add_elevator_to_floor(elevator, floor_name):
     """Add an elevator to the elevator positioning listing"""
 
-    if floor_name in _positions:
-        _positions[floor_name].add(elevator)
+    with _MANAGER_CONDITION:
+        if floor_name in _positions:
+            _positions[floor_name].add(elevator)
+
+        if _dispatch_engine is not None:
+            _dispatch_engine.arrived(elevator, floor_name)
+            _dispatch_engine.update_elevator(elevator)
+
+        _MANAGER_CONDITION.notify()
+
+
+def apply_elevator_snapshot(snapshot):
+    """Replace the states of the elevators with the ones of a snapshot
+
+    All the elevators are updated under the lock, so the manager never
+    assigns a request with a mix of the old and the new states. A car
+    that isn't moving is at its floor, so the floor listing is rebuilt
+    from the snapshot instead of the arrivals and departures.
+    """
+
+    with _MANAGER_CONDITION:
+        for elevator, fields in snapshot.items():
+            (state, current_floor, temperature, weight, light_state, door_state, movement,
+             next_floor, maintanence_state, occupancy, _) = fields
+
+            elevator.current_floor = current_floor
+            elevator.temperature = temperature
+            elevator.weight = weight
+            elevator.light_state = light_state
+            elevator.door_state = door_state
+            elevator.movement = movement
+            elevator.next_floor = next_floor
+            elevator.maintanence_state = maintanence_state
+            elevator.emergency_state = int(state == constants.EMERGENCY)
+            elevator.capacity = occupancy
+
+            floor_name = None
+            if state != constants.MOVING:
+                for name, floor_num in elevator.floors.items():
+                    if floor_num == current_floor:
+                        floor_name = name
+                        break
+
+            for name, elevators in _positions.items():
+                if name != floor_name and elevator in elevators:
+                    elevators.discard(elevator)
+                    if _dispatch_engine is not None:
+                        _dispatch_engine.departed(elevator, name)
+
+            if floor_name in _positions and elevator not in _positions[floor_name]:
+                _positions[floor_name].add(elevator)
+                if _dispatch_engine is not None:
+                    _dispatch_engine.arrived(elevator, floor_name)
+
+            if _dispatch_engine is not None:
+                _dispatch_engine.update_elevator(elevator)
+
+        _MANAGER_CONDITION.notify()
 
 
 def close():
     """Close manager thread"""
 
+    global _closing
+
+    with _MANAGER_CONDITION:
+        _closing = True
+        _MANAGER_CONDITION.notify()
+
     if _manager_thread is not None:
         _manager_thread.join()
 
+    if _dispatch_engine is not None:
+        _dispatch_engine.close()
+
 
 def remove_elevator_from_floor(elevator, floor_name):
     """Remove an elevator from the given floor"""
 
-    elevators = _positions.get(floor_name)
-    if elevators is not None and elevator in elevators:
-        _positions[floor_name].pop(elevator)
+    with _MANAGER_CONDITION:
+        elevators = _positions.get(floor_name)
+        if elevators is not None:
+            elevators.discard(elevator)
+
+        if _dispatch_engine is not None:
+            _dispatch_engine.departed(elevator, floor_name)
+            _dispatch_engine.update_elevator(elevator)
 
 
 def get_all_elevator_floors():
-    """Create a registry of all the floors available in the system"""
+    """Create a registry of all the floors available in the system
+
+    The elevators are also passed to the dispatch engine here, since
+    this is the point in which all of them have their floors.
+    """
 
-    global _positions
+    global _positions, _dispatch_engine
+
+    elevators = devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER).devices.values()
 
     all_floors = set()
-    for elevator in devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER).devices.values():
+    for elevator in elevators:
         all_floors = all_floors.union(set(elevator.floors))
 
-    _positions = dict.fromkeys(all_floors, set())
+    _positions = dict((floor, set()) for floor in all_floors)
+
+    _dispatch_engine = dispatch.DispatchEngine.create()
+    if _dispatch_engine is not None:
+        _dispatch_engine.add_elevators(elevators)
+    else:
+        print("The dispatch library is not available, so the elevators are assigned by the manager")
 
 
 def get_elevator_in_floor(floor):
-    if len(_positions[floor]) != 0:
-        return _positions[floor].pop()
+    with _MANAGER_LOCK:
+        if len(_positions[floor]) != 0:
+            return _positions[floor].pop()
     return None
 
 
@@ -62,39 +153,106 @@ def get_floors():
 def mutate_requests(floor, add_floor=True):
     """Add or remove requests from the request pool"""
 
-    _MANAGER_LOCK.acquire()
+    with _MANAGER_CONDITION:
+        if add_floor:
+            _requests.add(floor)
+            _MANAGER_CONDITION.notify()
+        else:
+            _requests.discard(floor)
 
-    if add_floor:
-        _requests.add(floor)
-    else:
-        _requests.remove(floor)
 
-    _MANAGER_LOCK.release()
+def request_elevator_snapshots():
+    """Ask every MCU for a snapshot of its elevators"""
+
+    request_snapshot = testers.Tester.get_tester("request_snapshot")
+
+    mcu_elevators = {}
+    for elevator in devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER).devices.values():
+        mcu_elevators.setdefault(elevator.thread_id, elevator)
+
+    for elevator in mcu_elevators.values():
+        request_snapshot(elevator, bytearray())
 
 
 def start():
-    global _manager_thread
+    global _manager_thread, _closing
 
+    _closing = False
     _manager_thread = threading.Thread(target=run)
     _manager_thread.start()
 
 
 def run():
-    """Main function that reads the requests of the system"""
+    """Main function that reads the requests of the system
+
+    The manager sleeps until a request is made or an elevator reaches
+    a floor. Requests that can't be assigned yet are retried after a
+    short timeout, since the states of the elevators are updated on
+    their own.
+    """
 
     while True:
 
-        for request_floor in _requests.copy():
-            elevator = _find_elevator(request_floor)
-            if elevator is not None:
-                request_elevator = testers.Tester.get_tester("request_elevator")
-                request_elevator(elevator, bytearray([elevator.device_id, elevator.floors[request_floor]]))
-                mutate_requests(request_floor, False)
+        with _MANAGER_CONDITION:
+            while not _requests and not _closing:
+                _MANAGER_CONDITION.wait()
+
+            if _closing:
+                return
+
+            assignments = []
+            for request_floor in _requests.copy():
+                elevator = _find_elevator(request_floor)
+                if elevator is not None:
+                    assignments.append((elevator, request_floor))
+                    _requests.discard(request_floor)
+
+        # Send the requests outside of the lock, so the tasks of the elevators are not held back
+        elevator_floors = {}
+        for elevator, request_floor in assignments:
+            elevator_floors.setdefault(elevator, []).append(elevator.floors[request_floor])
+
+        for elevator, floors in elevator_floors.items():
+            _request_elevator_floors(elevator, floors)
+
+        with _MANAGER_CONDITION:
+            if _requests and not _closing:
+                _MANAGER_CONDITION.wait(_RETRY_TIMEOUT)
+
+
+def _request_elevator_floors(elevator, floors):
+    """Send the floors requested from an elevator
+
+    A single floor is sent on its own, and many floors are sent in
+    batches of a floor bitmap, so a burst of requests only takes a
+    task (and its reply) for each range of floors a batch covers.
+    """
+
+    device_id = devices.pack_device_id(elevator.thread_id, elevator.device_id)
+
+    if len(floors) == 1:
+        request_elevator = testers.Tester.get_tester("request_elevator")
+        request_elevator(elevator, device_id + bytearray(floors))
+        return
+
+    batches = {}
+    for floor in floors:
+        batch = batches.setdefault((floor - 1) // constants.FLOOR_BATCH_FLOORS, bytearray(constants.FLOOR_BATCH_SIZE))
+        offset = (floor - 1) % constants.FLOOR_BATCH_FLOORS
+        batch[offset // 8] |= 1 << (offset % 8)
+
+    request_floors = testers.Tester.get_tester("request_floors")
+    for batch_index, batch in sorted(batches.items()):
+        first_floor = batch_index * constants.FLOOR_BATCH_FLOORS + 1
+        request_floors(elevator, device_id + bytearray([first_floor]) + batch)
 
 
 def _find_elevator(request_floor):
     """Find an elevator that can be called to current location"""
 
+    if _dispatch_engine is not None:
+        return _dispatch_engine.find_elevator(request_floor)
+
     chosen_elevator = None
     chosen_floor_distance = None
 
@@ -122,4 +280,5 @@ def _valid_elevator(elevator, request_floor):
                            or \
                            (elevator.current_floor < elevator.next_floor and request_floor_num < elevator.next_floor)
 
-    return elevator.capacity and not (elevator.maintanence_state or elevator.emergency_state) and in_elevator_path
+    has_room = elevator.capacity is not None and elevator.capacity < constants.ELEVATOR_CAPACITY
+    return has_room and not (elevator.maintanence_state or elevator.emergency_state) and in_elevator_path
@@ -1,3 +1,5 @@
+import struct
+
 from ...config import teardown, tasks
 from ...tools import cli, messengers, devices
 from . import manager, commands, constants, tests
@@ -5,7 +7,8 @@ from .tasks import (pass_elevator_floor_name,
                     alert_floor_arrival,
                     alert_person_removal,
                     alert_person_addition,
-                    remove_elevator_from_floor)
+                    remove_elevator_from_floor,
+                    pass_elevator_snapshot)
 
 
 # Command display conditions
@@ -26,18 +29,22 @@ def _in_system_page():
 cli.Command("request", commands.request, _in_elevator_page)
 cli.Command("enter", commands.enter, _in_elevator_page)
 cli.Command("display_stats", commands.elevator_statuses, _in_system_page)
+cli.Command("resync", commands.resync, _in_system_page)
 
 # Register tasks
 messengers.SerialMessenger.register_task_to_all_mcus(
     constants.PASS_ELEVATOR_FLOOR_NAME, -1, pass_elevator_floor_name)
 messengers.SerialMessenger.register_task_to_all_mcus(
-    constants.ALERT_FLOOR_ARRIVAL, 2, alert_floor_arrival)
+    constants.ALERT_FLOOR_ARRIVAL, devices.DEVICE_ID_SIZE + 1, alert_floor_arrival)
+messengers.SerialMessenger.register_task_to_all_mcus(
+    constants.ALERT_PERSON_ADDITION, devices.DEVICE_ID_SIZE + 1, alert_person_addition)
 messengers.SerialMessenger.register_task_to_all_mcus(
-    constants.ALERT_PERSON_ADDITION, 2, alert_person_addition)
+    constants.REMOVE_CAR_FROM_FLOOR, devices.DEVICE_ID_SIZE + 1, remove_elevator_from_floor)
 messengers.SerialMessenger.register_task_to_all_mcus(
-    constants.REMOVE_CAR_FROM_FLOOR, 2, remove_elevator_from_floor)
+    constants.ALERT_PERSON_REMOVAL, devices.DEVICE_ID_SIZE + 2, alert_person_removal)
 messengers.SerialMessenger.register_task_to_all_mcus(
-    constants.ALERT_PERSON_REMOVAL, 2, alert_person_removal)
+    constants.PASS_ELEVATOR_SNAPSHOT, devices.DEVICE_ID_SIZE + struct.calcsize("<" + constants.SNAPSHOT_FORMAT),
+    pass_elevator_snapshot)
 
 print messengers.SerialMessenger._messengers
 
@@ -48,6 +55,7 @@ while not tasks.is_mcu_setup_complete():
 # Register tests
 elevator_tracker = devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER)
 elevator_tracker.register_test(tests.manual_set)
+elevator_tracker.register_test(tests.check_attr_updates)
 
 # Setup the manager
 manager.get_all_elevator_floors()
@@ -1,17 +1,24 @@
 from __future__ import print_function
 
-from ...tools import devices
+import struct
+
+from ...tools import devices, scheduler
 from . import constants, manager
 
 
+# Task variables
+
+_snapshots = {}  # Cars of the snapshots that are being passed by each MCU
+
+
 # Elevator tasks
 
 def pass_elevator_floor_name(thread_id, pkt):
     """Add a floor name to an elevator's listing"""
 
-    device_id = pkt[0]
-    floor_id = pkt[1]
-    floor_name = str(pkt[2:])
+    device_id = devices.unpack_device_id(thread_id, pkt)
+    floor_id = pkt[devices.DEVICE_ID_SIZE]
+    floor_name = str(pkt[devices.DEVICE_ID_SIZE + 1:])
     elevator_tracker = devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER)
     elevator = elevator_tracker.get_device((thread_id, device_id))
 
@@ -47,11 +54,39 @@ def alert_person_addition(thread_id, pkt):
 
 
 def alert_person_removal(thread_id, pkt):
-    """Alert that a person is entering the elevator"""
+    """Alert that people are exiting the elevator"""
 
     _, elevator_num, floor_name = _proc_elevator_pkt(thread_id, pkt)
+    rider_count = pkt[devices.DEVICE_ID_SIZE + 1]
+
+    print("{} people have exited elevator {} in floor {}".format(rider_count, floor_name, elevator_num))
+
+
+def pass_elevator_snapshot(thread_id, pkt):
+    """Gather the cars of an elevator snapshot
+
+    The cars are applied together once the last one arrives, so the
+    manager never sees part of a snapshot. A car of a newer snapshot
+    drops the cars of an older one that didn't finish.
+    """
+
+    device_id = devices.unpack_device_id(thread_id, pkt)
+    current_scheduler = scheduler.Scheduler.get_scheduler(thread_id)
+    endian_format = current_scheduler.printer.endianness_format if current_scheduler is not None else '<'
+    fields = struct.unpack(endian_format + constants.SNAPSHOT_FORMAT, bytes(pkt[devices.DEVICE_ID_SIZE:]))
+    snapshot_num, flags = fields[:2]
+
+    snapshot = _snapshots.get(thread_id)
+    if snapshot is None or snapshot[0] != snapshot_num:
+        snapshot = _snapshots[thread_id] = (snapshot_num, {})
+
+    elevator_tracker = devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER)
+    snapshot[1][elevator_tracker.get_device((thread_id, device_id))] = fields[2:]
 
-    print("A person has exited elevator {} in floor {}".format(floor_name, elevator_num))
+    if flags & constants.SNAPSHOT_LAST_CAR:
+        del _snapshots[thread_id]
+        manager.apply_elevator_snapshot(snapshot[1])
+        print("Resynced {} elevators".format(len(snapshot[1])))
 
 
 # Task helpers
@@ -59,8 +94,8 @@ def alert_person_removal(thread_id, pkt):
 def _proc_elevator_pkt(thread_id, pkt):
     """Process the incoming elevator packet"""
 
-    device_id = pkt[0]
-    floor_id = pkt[1]
+    device_id = devices.unpack_device_id(thread_id, pkt)
+    floor_id = pkt[devices.DEVICE_ID_SIZE]
     elevator_tracker = devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER)
     elevator = elevator_tracker.get_device((thread_id, device_id))
 
@@ -1,6 +1,7 @@
 from __future__ import print_function
 
 import sys
+import time
 
 from . import constants
 from ...config import tasks
@@ -41,3 +42,42 @@ def manual_set():
         tasks.update_device_attr_mcu(constants.ELEVATOR_TRACKER, elevator_name, attr_name, attr_type, value)
     else:
         print("Not all the inputs where valid")
+
+
+ATTR_CHECK_TIMEOUT = 2  # Time the MCU has to report back an attribute that was set (in seconds)
+ATTR_CHECK_VALUES = {  # Values an attribute is set to (the first one that differs from the current value is used)
+    "light_state": (0, 1),
+    "door_state": (0, 1),
+    "current_floor": (1, 2),
+    "temperature": (25, 26),
+    "weight": (100, 200),
+    "maintanence_state": (0, 1)
+}
+
+
+def check_attr_updates():
+    """Set every attribute of an elevator in its MCU and check that the MCU reports it back"""
+
+    elevator_tracker = devices.DeviceTracker.get_tracker(constants.ELEVATOR_TRACKER)
+    elevator_names = [elevator.name for elevator in elevator_tracker.devices.values()]
+    print("Here are the following elevators that can be checked: " + ", ".join(elevator_names))
+    elevator_name = user_input("Which elevator do you want to check? ")
+
+    elevator = elevator_tracker.get_device(device_name=elevator_name)
+    if elevator is None:
+        print("Elevator '{}' was not found".format(elevator_name))
+        return
+
+    for attr_name, attr_type in sorted(constants.SET_TASKS.items()):
+        current_value = getattr(elevator, attr_name, None)
+        value = next(value for value in ATTR_CHECK_VALUES[attr_name] if value != current_value)
+
+        tasks.update_device_attr_mcu(constants.ELEVATOR_TRACKER, elevator_name, attr_name, attr_type, value)
+
+        # The MCU reports the attribute back once it's set
+        deadline = time.time() + ATTR_CHECK_TIMEOUT
+        while getattr(elevator, attr_name, None) != value and time.time() < deadline:
+            time.sleep(.05)
+
+        read_value = getattr(elevator, attr_name, None)
+        print("{}: set {}, read back {} ({})".format(attr_name, value, read_value, "ok" if read_value == value else "FAILED"))
@@ -5,6 +5,30 @@ import struct
 from . import cli, scheduler
 
 
+DEVICE_ID_FORMAT = 'H'  # Format character of a device id (device ids are 16 bits wide)
+DEVICE_ID_SIZE = struct.calcsize(DEVICE_ID_FORMAT)
+
+
+def pack_device_id(thread_id, device_id):
+    """Pack a device id with the endianness of the MCU that has the device"""
+
+    return struct.pack(_get_device_id_format(thread_id), device_id)
+
+
+def unpack_device_id(thread_id, pkt):
+    """Unpack a device id from the start of a packet sent by an MCU"""
+
+    return struct.unpack(_get_device_id_format(thread_id), bytes(pkt[:DEVICE_ID_SIZE]))[0]
+
+
+def _get_device_id_format(thread_id):
+    """Get the format of a device id for an MCU"""
+
+    current_scheduler = scheduler.Scheduler.get_scheduler(thread_id)
+    endian_format = current_scheduler.printer.endianness_format if current_scheduler is not None else '<'
+    return endian_format + DEVICE_ID_FORMAT
+
+
 class Device:
     """Data class to store information about individual devices on the MCUs."""
 
@@ -13,6 +37,7 @@ class Device:
         self.name = None  # Name of the device
         self.thread_id = None  # Thread id where device can be found
         self.device_id = None  # Id it has in the mcu
+        self.group_id = None  # Group (e.g., building) it belongs to in the mcu
 
 
 class DeviceTracker:
@@ -58,10 +83,14 @@ class DeviceTracker:
         self._attr_id_to_attr_name = {}
         self._attr_name_to_attr_id = {}
 
-    def add_devices(self, device_count, thread_id):
-        """Add a device to the device tracker"""
+    def add_devices(self, device_count, thread_id, group_id=0, first_device_id=0):
+        """Add a group of devices to the device tracker
 
-        for device_id in range(device_count):
+        The devices of a group take consecutive ids in the mcu, starting
+        from the given first device id.
+        """
+
+        for device_id in range(first_device_id, first_device_id + device_count):
 
             # Create device instance and set up base attributes
             self.device_count += 1
@@ -71,6 +100,7 @@ class DeviceTracker:
             # Setup device attributes
             device.name = device_name
             device.device_id = device_id
+            device.group_id = group_id
             device.thread_id = thread_id
             for attr in self.device_attrs:
                 setattr(device, attr, None)
@@ -101,15 +131,19 @@ class DeviceTracker:
 
         return cls._VALID_ATTR_TYPES.get(attr_type)
 
-    def get_device(self, mcu_info=None, device_name=None):
-        """Get a device instance by using its registered name or an mcu key"""
+    def get_cu_id(self, mcu_info=None, device_name=None):
+        """Get the computer unique id of a device by using its registered name or an mcu key"""
 
-        # Find the computer unique id if it wasn't given
-        cu_id = None
         if mcu_info is not None:
-            cu_id = self._mcu_info_to_cu_id.get(mcu_info)
+            return self._mcu_info_to_cu_id.get(mcu_info)
         elif device_name is not None:
-            cu_id = self._device_name_to_cu_id.get(device_name)
+            return self._device_name_to_cu_id.get(device_name)
+        return None
+
+    def get_device(self, mcu_info=None, device_name=None):
+        """Get a device instance by using its registered name or an mcu key"""
+
+        cu_id = self.get_cu_id(mcu_info, device_name)
 
         # Pass device instance if available
         if cu_id is not None:
@@ -166,11 +200,12 @@ class DeviceTracker:
 
         # Retrieve the tracker
         tracker_id = cls._tracker_name_to_tracker_id.get(tracker_name)
-        tracker = cls._trackers[tracker_id]
+        tracker = cls._trackers.get(tracker_id)
+        device = tracker.get_device(device_name=device_name) if tracker is not None else None
 
-        if tracker is not None:
+        if device is not None:
             # Fetch relevant information to update the attribute in MCU
-            thread_id, device_id = tracker._device_name_to_cu_id[device_name]
+            thread_id, device_id = device.thread_id, device.device_id
             current_scheduler = scheduler.Scheduler.get_scheduler(thread_id)
 
             # Fetch format characters to packetize value
@@ -179,10 +214,10 @@ class DeviceTracker:
             attr_type_format = tracker._VALID_ATTR_TYPES.get(attr_type)
 
             # Build packet if valid information was gathered
-            if not (attr_id is None and attr_type_format is None):
-                pkt_format = endian_format + "BBB" + attr_type_format
+            if attr_id is not None and attr_type_format is not None:
+                pkt_format = endian_format + "B" + DEVICE_ID_FORMAT + "B" + attr_type_format
                 pkt = struct.pack(pkt_format, tracker_id, device_id, attr_id, value)
-                return scheduler, pkt
+                return current_scheduler, pkt
 
     @classmethod
     def was_tracker_created(cls, tracker_name):
@@ -11,7 +11,10 @@ line interface that is integrated in the testbed.
 """
 
 import abc
+import errno
 import serial
+import socket
+import struct
 import threading
 
 from . import scheduler
@@ -22,6 +25,19 @@ NORMAL = 0
 PRIORITY = 1
 FAST = 2
 
+# Gateway message types (these must match the ones in src/Native/gateway/gateway.h)
+
+GATEWAY_ATTACH = 0
+GATEWAY_ATTACHED = 1
+GATEWAY_ATTACH_FAIL = 2
+GATEWAY_FRAME = 3
+GATEWAY_SET_TIMER = 4
+GATEWAY_TIMER = 5
+GATEWAY_SET_ENDIAN = 6
+
+GATEWAY_MAX_MSG_SIZE = 256  # Max size of a message between the gateway and a messenger
+GATEWAY_TICK_PERIOD = 50  # Time between the gateway ticks while a scheduler has pending tasks (in ms)
+
 
 class BaseMessenger:
     """Helper object that listens and writes to the MCUs
@@ -38,13 +54,13 @@ class BaseMessenger:
 
     _messengers = {}
     _main_scheduler = None
-    _send_lock = threading.Lock()
-    _schedule_lock = threading.Lock()
-    _rx_lock = threading.Lock()
+    _rx_lock = threading.Lock()  # The tasks share the device trackers, so they're ran one at a time
 
     def __init__(self, task_count, is_little_endian=False, no_internal_set_up=False):
 
         self._is_active = True  # Flag to keep running messenger thread
+        self._send_lock = threading.Lock()  # Each scheduler is only shared with the threads using this messenger
+        self._schedule_lock = threading.Lock()
         self._set_scheduler(task_count, is_little_endian, no_internal_set_up)
         self.thread = threading.Thread(target=self._scheduler_loop)
 
@@ -61,9 +77,9 @@ class BaseMessenger:
     def _scheduler_loop(self):
         """Listens for incoming bytes and send bytes to the schedulers
 
-        Using the "build_incoming_pkt" method provided by the
-        scheduler object, you must override this method with
-        a way to read the incoming bytes from an MCU.
+        Using the "build_incoming_bytes" (or "build_incoming_pkt")
+        method provided by the scheduler object, you must override
+        this method with a way to read the incoming bytes from an MCU.
         """
 
     @abc.abstractmethod
@@ -76,15 +92,23 @@ class BaseMessenger:
 
     @classmethod
     def close_messengers(cls):
-        """Close the threads used for the messengers"""
+        """Close the threads and channels used for the messengers"""
 
         # Deactivate all the messengers before closing threads
         for messenger in cls._messengers.values():
             messenger._is_active = False
+            messenger._stop_channel()
 
         # Close all the threads
         for messenger in cls._messengers.values():
             messenger.thread.join()
+            messenger._close_channel()
+
+    def _stop_channel(self):
+        """Wake up a messenger thread that is waiting on its channel (if it can wait)"""
+
+    def _close_channel(self):
+        """Close the channel of a messenger after its thread is done"""
 
     def schedule_task(self, task_id, pkt, priority_type):
         """Schedule a task to an mcu
@@ -190,22 +214,19 @@ class SerialMessenger(BaseMessenger, object):
         self.serial_ch = serial.Serial(port=port, baudrate=baudrate)
         super(SerialMessenger, self).__init__(task_count, is_little_endian, no_internal_set_up)
 
-    @classmethod
-    def close_messengers(cls):
-        """Closes all the serial communication channels and threads with the MCUs connected to the computer"""
-
-        for messenger in cls._messengers.values():
-            messenger.thread.join()
-            messenger.serial_ch.close()
-
     def _scheduler_loop(self):
         """Listens and writes bytes to the schedulers through a serial channel"""
 
         while self._is_active:
             self.send_task()
             if self.serial_ch.in_waiting:
-                byte = self.serial_ch.read()
-                self.scheduler.build_incoming_pkt(byte)
+                data = self.serial_ch.read(self.serial_ch.in_waiting)
+                self.scheduler.build_incoming_bytes(data)
+
+    def _close_channel(self):
+        """Closes the serial channel of the messenger"""
+
+        self.serial_ch.close()
 
     def _tx_scheduler_cb(self, pkt):
         """Writes the outgoing bytes from a scheduler through a serial channel"""
@@ -219,3 +240,110 @@ class SerialMessenger(BaseMessenger, object):
                     break
             except serial.SerialTimeoutException:
                 break
+
+
+class GatewayMessenger(BaseMessenger, object):
+    """Helper object that talks to an MCU through the native gateway
+
+    The gateway (src/Native/gateway) serves the serial links of all the
+    MCUs in a single loop. Each messenger attaches to one of the links
+    through the gateway's Unix socket, and its thread sleeps until the
+    gateway passes it a frame or a timer tick. The gateway only ticks
+    while the scheduler has tasks waiting to be sent or acknowledged.
+    """
+
+    def __init__(self, socket_path, port, task_count, is_little_endian=False, no_internal_set_up=False):
+
+        self.port = port
+        self._tick_period = 0  # Tick period the gateway was last given for this link
+
+        self.gateway_ch = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        self.gateway_ch.connect(socket_path)
+        self.gateway_ch.send(bytes(bytearray([GATEWAY_ATTACH]) + bytearray(port, "ascii")))
+
+        reply = bytearray(self.gateway_ch.recv(GATEWAY_MAX_MSG_SIZE))
+        if reply[:1] != bytearray([GATEWAY_ATTACHED]):
+            self.gateway_ch.close()
+            raise IOError("The gateway does not serve port '{}'".format(port))
+
+        super(GatewayMessenger, self).__init__(task_count, is_little_endian, no_internal_set_up)
+
+    def _set_scheduler(self, task_count, is_little_endian, no_internal_set_up):
+        """Helper method to setup a messenger's scheduler
+
+        The gateway reads the device ids of the link with the same byte
+        order the device trackers use, so it's given to the gateway
+        before the link's frames are handled.
+        """
+
+        super(GatewayMessenger, self)._set_scheduler(task_count, is_little_endian, no_internal_set_up)
+        self._send_gateway_msg(GATEWAY_SET_ENDIAN, bytearray([self.scheduler.printer.is_little_endian]))
+
+    def schedule_task(self, task_id, pkt, priority_type):
+        """Schedule a task to an mcu and send it right away
+
+        The messenger thread is asleep while the scheduler is idle, so
+        the task is sent here instead of waiting for the next tick.
+        """
+
+        super(GatewayMessenger, self).schedule_task(task_id, pkt, priority_type)
+        self.send_task()
+
+    def send_task(self):
+        """Send a task to an mcu and keep the gateway ticking while there are pending tasks"""
+
+        self._send_lock.acquire()
+
+        self.scheduler.send_task()
+
+        tick_period = GATEWAY_TICK_PERIOD if self.scheduler.has_pending_tasks() else 0
+        if tick_period != self._tick_period:
+            self._tick_period = tick_period
+            self._send_gateway_msg(GATEWAY_SET_TIMER, struct.pack("=I", tick_period))
+
+        self._send_lock.release()
+
+    def _scheduler_loop(self):
+        """Waits for the frames and ticks of the gateway"""
+
+        while self._is_active:
+            self.send_task()
+
+            try:
+                msg = bytearray(self.gateway_ch.recv(GATEWAY_MAX_MSG_SIZE))
+            except socket.error as error:
+                if error.errno == errno.EINTR:
+                    continue
+                break
+
+            if not msg:  # The gateway closed the channel
+                break
+
+            if msg[0] == GATEWAY_FRAME:
+                self.scheduler.build_incoming_bytes(msg[1:] + bytearray(1))  # Put back the COBS delimiter
+
+    def _stop_channel(self):
+        """Wakes up the messenger thread by shutting down the gateway channel"""
+
+        try:
+            self.gateway_ch.shutdown(socket.SHUT_RDWR)
+        except socket.error:
+            pass
+
+    def _close_channel(self):
+        """Closes the gateway channel of the messenger"""
+
+        self.gateway_ch.close()
+
+    def _send_gateway_msg(self, msg_type, payload):
+        """Send a message to the gateway"""
+
+        try:
+            self.gateway_ch.send(bytes(bytearray([msg_type]) + bytearray(payload)))
+        except socket.error:
+            pass
+
+    def _tx_scheduler_cb(self, pkt):
+        """Writes the outgoing bytes from a scheduler through the gateway"""
+
+        self._send_gateway_msg(GATEWAY_FRAME, pkt)
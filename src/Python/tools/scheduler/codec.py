@@ -0,0 +1,67 @@
+"""
+This module binds the COBS codec of the C scheduler, so the packets
+are encoded and decoded with the same code the MCUs use.
+
+Only the codec is native. The packet checks, the queues and the task
+table stay in the Python Scheduler: the C scheduler keeps its state per
+thread, while the messengers schedule tasks from any thread, and it
+leaves out the printer tasks the MCUs send to the computer.
+
+A packet is at most a few dozen bytes, so most of the time of a call
+goes to ctypes itself. The buffers are passed as strings, since that's
+cheaper than mapping the bytearrays into ctypes arrays. A ctypes call
+also costs more than the deque operations of the Python queues, so
+binding the queues wouldn't make the host any faster.
+"""
+
+import os
+import ctypes
+
+
+CODEC_LIB_ENV = "SCHEDULER_CODEC_LIB"  # Environment variable to override the library's location
+_DEFAULT_CODEC_LIB = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                  "..", "..", "..", "Native", "build", "libscheduler_codec.so")
+
+
+def _load_codec_lib():
+    """Load the native codec library (None is returned if it's not available)"""
+
+    try:
+        lib = ctypes.CDLL(os.environ.get(CODEC_LIB_ENV, _DEFAULT_CODEC_LIB))
+    except OSError:
+        return None
+
+    for function in (lib.cobs_encode, lib.cobs_decode):
+        function.restype = ctypes.c_size_t
+        function.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
+
+    return lib
+
+
+_lib = _load_codec_lib()
+
+
+def is_native():
+    """Check if the native codec is available"""
+
+    return _lib is not None
+
+
+def encode(pkt):
+    """COBS encode a packet and add the COBS delimiter"""
+
+    encoded_pkt = ctypes.create_string_buffer(len(pkt) + len(pkt) // 254 + 2)  # Worst case COBS overhead plus the delimiter
+    length = _lib.cobs_encode(bytes(pkt), len(pkt), encoded_pkt)
+
+    return bytearray(encoded_pkt.raw[:length])
+
+
+def decode(pkt):
+    """COBS decode a packet (None is returned if the packet is not valid)"""
+
+    decoded_pkt = ctypes.create_string_buffer(len(pkt))
+    length = _lib.cobs_decode(bytes(pkt), len(pkt), decoded_pkt)
+
+    if not length:
+        return None
+    return bytearray(decoded_pkt.raw[:length])
@@ -5,12 +5,29 @@
 SHORT_TIMER = .350  # Allowed time for the first reply time range
 LONG_TIMER = .5  # Allowed time for the second reply time range
 
+# Flow control constants
+CREDIT_PROBE_TIMER = LONG_TIMER  # Time to wait before sending a task to a system that has no credit left
+
+# Sequencing constants
+SEQ_WINDOW_SIZE = 4  # Amount of completed task sequences remembered to detect retransmissions
+SEQ_WINDOW_TIMER = 5 * (SHORT_TIMER + LONG_TIMER)  # Time a completed sequence is remembered (5 is the queue size of the MCUs)
+
+# Debugging constants
+DEBUG_PKTS = False  # Print every packet that goes through the schedulers
+
 # Immutable scheduler constants
 
 # Task types
 INTERNAL_TASK = 0
 EXTERNAL_TASK = 1
 
+# Credit value used until the other system advertises its available queue space
+UNKNOWN_CREDIT = 255
+
+# Sequence of the tasks that are not waiting for a reply (they are never retransmitted, so they are not tracked)
+NO_SEQ = 0
+MAX_SEQ = 255
+
 # Task priority types
 NORMAL_TASK = 0
 PRIORITY_TASK = 1
@@ -41,8 +58,8 @@ INCORRECT_PAYLOAD_SIZE = 3
 MAX_PAYLOAD_SIZE = 25
 
 # Immutable packet constant
-ENCODED_HDR_SIZE = 5
-DECODED_HDR_SIZE = 4
+ENCODED_HDR_SIZE = 7
+DECODED_HDR_SIZE = 6
 MAX_ALLOWED_PKT_SIZE = 255
 MAX_DECODED_PKT_BUF_SIZE = DECODED_HDR_SIZE + MAX_PAYLOAD_SIZE
 MAX_ENCODED_PKT_BUF_SIZE = ENCODED_HDR_SIZE + MAX_PAYLOAD_SIZE + 1
@@ -51,4 +68,6 @@ MAX_ENCODED_PKT_BUF_SIZE = ENCODED_HDR_SIZE + MAX_PAYLOAD_SIZE + 1
 CRC16_OFFSET = 0
 TASK_ID_OFFSET = 2
 TASK_TYPE_OFFSET = 3
-PAYLOAD_OFFSET = 4
+CREDIT_OFFSET = 4
+SEQ_OFFSET = 5
+PAYLOAD_OFFSET = 6
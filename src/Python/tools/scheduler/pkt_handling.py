@@ -6,6 +6,7 @@ from __future__ import print_function
 
 import struct
 
+from . import codec
 from . import constants
 
 
@@ -14,6 +15,7 @@ class SchedulerPacket:
     def __init__(self):
 
         self.buf = bytearray()
+        self.credit = None  # Queue space advertised in the last verified incoming packet
 
     def process_incoming_byte(self, byte):
         """Process incoming information byte-by-byte"""
@@ -30,6 +32,20 @@ class SchedulerPacket:
 
         return False
 
+    def process_incoming_bytes(self, data):
+        """Process a chunk of incoming bytes that has no COBS delimiter
+
+        This does the same as passing the bytes to process_incoming_byte
+        one by one, including the reset of the buffer when the max
+        allowed size is reached.
+        """
+
+        self.buf += data
+
+        overflow = len(self.buf) - 1
+        if overflow >= constants.MAX_ENCODED_PKT_BUF_SIZE:
+            self.buf = self.buf[overflow - overflow % constants.MAX_ENCODED_PKT_BUF_SIZE:]
+
     def process_incoming_pkt(self, task_table):
         """Process a completed rx task packet
 
@@ -41,6 +57,8 @@ class SchedulerPacket:
            to see if the packet is valid or not.
         """
 
+        self.credit = None
+
         # Check for minimum header length
         if len(self.buf) < constants.ENCODED_HDR_SIZE:
             print("PKT RX PROC ERROR: Packet is shorter than minimum header size")
@@ -51,12 +69,13 @@ class SchedulerPacket:
             print("PKT RX PROC ERROR: Error in decoding incoming packet")
             return
 
-        print('\n')
-        print("Processed incoming pkt")
-        print(self.buf)
-        print("task id {}".format(self.buf[constants.TASK_ID_OFFSET]))
-        print("task type {}".format(self.buf[constants.TASK_TYPE_OFFSET]))
-        print(':'.join(hex(char) for char in self.buf) + '\n')
+        if constants.DEBUG_PKTS:
+            print('\n')
+            print("Processed incoming pkt")
+            print(self.buf)
+            print("task id {}".format(self.buf[constants.TASK_ID_OFFSET]))
+            print("task type {}".format(self.buf[constants.TASK_TYPE_OFFSET]))
+            print(':'.join(hex(char) for char in self.buf) + '\n')
 
         # crc16 verification to validate decoded packet
         # Read the two crc16 bytes assuming little-endianess
@@ -67,6 +86,8 @@ class SchedulerPacket:
             print("PKT RX PROC ERROR: crc16 fail")
             return
 
+        self.credit = self.buf[constants.CREDIT_OFFSET]
+
         # Check if the requested task type is internal
         if self.buf[constants.TASK_TYPE_OFFSET] == constants.INTERNAL_TASK:
             return
@@ -82,7 +103,7 @@ class SchedulerPacket:
         # the current packet
         if entry.size > 0:
             if len(self.buf) != entry.size + constants.DECODED_HDR_SIZE:
-                print()
+                print("PKT RX PROC ERROR: Task {} has an incorrect payload size".format(entry.id))
                 return
 
         return entry
@@ -93,41 +114,60 @@ class SchedulerPacket:
         if len(payload_pkt) + constants.DECODED_HDR_SIZE > constants.MAX_DECODED_PKT_BUF_SIZE:
             return False
 
-        # Create the decoded packet to be sent and then encode
+        # Create the decoded packet to be sent (it's encoded once it's stamped)
         self.buf = bytearray(constants.PAYLOAD_OFFSET)
 
         self.buf[constants.TASK_ID_OFFSET] = task_id
         self.buf[constants.TASK_TYPE_OFFSET] = task_type
+        self.buf[constants.CREDIT_OFFSET] = constants.UNKNOWN_CREDIT  # Stamped right before it's sent
+        self.buf[constants.SEQ_OFFSET] = constants.NO_SEQ  # Stamped right before it's sent
         self.buf += bytearray(payload_pkt)
 
         # TODO: Put crc16 stuff here for the input buffer (for now I'm just entering 0)
         self.buf[constants.CRC16_OFFSET: constants.CRC16_OFFSET + 2] = bytearray([0, 0])
 
-        print('\n')
-        print("Processed outgoing pkt")
-        print(self.buf)
-        print(':'.join(hex(char) for char in self.buf) + '\n')
-
-        self._encode()
+        if constants.DEBUG_PKTS:
+            print('\n')
+            print("Processed outgoing pkt")
+            print(self.buf)
+            print(':'.join(hex(char) for char in self.buf) + '\n')
 
         return True
 
-    def _encode(self):
+    def encode(self, credit, seq):
+        """Stamp an outgoing packet and get its COBS encoded frame
+
+        The credit and the sequence are only known when the packet is
+        about to be sent, so the packet is held decoded and it's only
+        encoded then.
+        """
+
+        self.buf[constants.CREDIT_OFFSET] = credit
+        self.buf[constants.SEQ_OFFSET] = seq
+
+        return self._encode(self.buf)
+
+    @staticmethod
+    def _encode(pkt):
         """COBS encode a packet and add COBS delimeter.
 
-        Based on C library function made by Jacques Fortier.
+        Based on C library function made by Jacques Fortier. The C
+        function itself is used when the native codec is available.
         """
 
+        if codec.is_native():
+            return codec.encode(pkt)
+
         code = 1  # Encoded byte in the output (indicates where the next 0 is)
         code_index = 0  # Index where the last zero was found
         read_index = 0  # Index for byte to read in input
         write_index = 1  # Index for byte to write in output
-        length = len(self.buf)
+        length = len(pkt)
         encoded_pkt = bytearray(constants.MAX_ENCODED_PKT_BUF_SIZE)
 
         while read_index < length:
 
-            byte = self.buf[read_index]
+            byte = pkt[read_index]
             read_index += 1
 
             # If byte is not 0, pass to output
@@ -147,7 +187,7 @@ class SchedulerPacket:
         encoded_pkt[code_index] = code  # Place the location of the COBS delimiter byte
         write_index += 1
 
-        self.buf = encoded_pkt[:write_index]
+        return encoded_pkt[:write_index]
 
     def _decode(self):
         """COBS decode a packet.
@@ -155,9 +195,15 @@ class SchedulerPacket:
         Returns True if the decoding was successful. Otherwise,
         it'll return False.
 
-        Based on C library function made by Jacques Fortier.
+        Based on C library function made by Jacques Fortier. The C
+        function itself is used when the native codec is available.
         """
 
+        if codec.is_native():
+            decoded_pkt = codec.decode(self.buf)
+            self.buf = decoded_pkt if decoded_pkt is not None else bytearray()
+            return decoded_pkt is not None
+
         read_index = 0
         write_index = 0
         length = len(self.buf)
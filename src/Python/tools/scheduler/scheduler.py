@@ -14,7 +14,7 @@ class _TaskQueueEntry(object):
     the scheduling queues.
     """
 
-    __slots__ = ("id", "pkt", "rescheduled")
+    __slots__ = ("id", "type", "pkt", "rescheduled", "seq")
 
     def __init__(self):
 
@@ -157,7 +157,7 @@ class _SchedulingLists:
 
     def pop_task(self, is_priority):
 
-        if self.queues_are_empty():
+        if not self.queues_are_empty():
             # Get relevant queue
             if is_priority:
                 target_queue = self.priority
@@ -179,6 +179,9 @@ class _SchedulingLists:
             return None
 
         new_task.id = task_id  # Pass the task id to the unscheduled task
+        new_task.type = task_type
+        new_task.rescheduled = False
+        new_task.seq = constants.NO_SEQ  # Given when it's first sent as a normal task
 
         return new_task
 
@@ -236,9 +239,13 @@ class Scheduler:
 
         self._name = name
         self.task_table = {}
-        self.prev_task = None
+        self._in_flight = None  # Normal task entry waiting for a reply (None if there's none)
         self.start_time = None
+        self.peer_credit = constants.UNKNOWN_CREDIT  # Queue space the other system last advertised
+        self.credit_time = 0  # Time marker of the last credit update or credit probe
         self.printer = printer.SchedulerPrinter(is_little_endian, no_internal_setup)
+        self.tx_seq = constants.NO_SEQ  # Sequence given to the last normal task that was sent
+        self._completed = deque(maxlen=constants.SEQ_WINDOW_SIZE)  # (id, seq, ret code, time) of the latest tasks performed with a sequence
 
         self._rx_pkt = pkt_handler.SchedulerPacket()
         self._schedule_qs = _SchedulingLists(task_count)
@@ -255,6 +262,26 @@ class Scheduler:
         if self._rx_pkt.process_incoming_byte(byte):
             self._perform_task()
 
+    def build_incoming_bytes(self, data):
+        """Form and detect the incoming packets from a chunk of bytes
+
+        This does the same as build_incoming_pkt, but the chunk is
+        split at the COBS delimiters instead of going byte-by-byte.
+        """
+
+        data = bytearray(data)
+        start = 0
+
+        while True:
+            end = data.find(b'\x00', start)
+            if end == -1:
+                self._rx_pkt.process_incoming_bytes(data[start:])
+                return
+
+            self._rx_pkt.process_incoming_bytes(data[start:end])
+            self._perform_task()
+            start = end + 1
+
     def copy(self, copy_callbacks=False):
         """Create a scheduler copy with the given scheduler"""
 
@@ -274,6 +301,11 @@ class Scheduler:
 
         return lambda scheduler_name, pkt: cls.perform_task(scheduler_name, task_id, pkt)
 
+    def has_pending_tasks(self):
+        """Check if the scheduler has tasks to send or waiting for a reply"""
+
+        return not self._schedule_qs.queues_are_empty()
+
     @classmethod
     def get_scheduler(cls, name):
 
@@ -315,17 +347,17 @@ class Scheduler:
     def schedule_fast_task(self, task_id, pkt):
         """Schedule a fast task to be performed by an MCU"""
 
-        self._schedule_general_task(task_id, constants.EXTERNAL_TASK, pkt, True, True)
+        return self._schedule_general_task(task_id, constants.EXTERNAL_TASK, pkt, True, True)
 
     def schedule_normal_task(self, task_id, pkt):
         """Schedule a normal task to be performed by an MCU"""
 
-        self._schedule_general_task(task_id, constants.EXTERNAL_TASK, pkt, False, False)
+        return self._schedule_general_task(task_id, constants.EXTERNAL_TASK, pkt, False, False)
 
     def schedule_priority_task(self, task_id, pkt):
         """Schedule a priority task to be performed by an MCU"""
 
-        self._schedule_general_task(task_id, constants.EXTERNAL_TASK, pkt, True, False)
+        return self._schedule_general_task(task_id, constants.EXTERNAL_TASK, pkt, True, False)
 
     def send_task(self):
         """Send a task to be performed by another device connected to this one.
@@ -342,11 +374,20 @@ class Scheduler:
 
             if queue_type:  # Send normal task (i.e. priority queue is empty)
 
-                # Check if the task has been sent already
-                if self.prev_task != entry.id:
-                    self.prev_task = entry.id
+                # Check if the task has been sent already (the entry is checked, since the id can be queued again)
+                if self._in_flight is not entry:
+
+                    # A retransmission keeps the sequence, so the other system can tell it apart from a new task
+                    if entry.seq == constants.NO_SEQ:
+                        self.tx_seq = self.tx_seq % constants.MAX_SEQ + 1
+                        entry.seq = self.tx_seq
+
+                    # Hold the task until the other system has space for it
+                    if not self._transmit_task(entry, True):
+                        return
+
+                    self._in_flight = entry
                     self.start_time = time()
-                    self.tx_callback(entry.pkt.buf)
 
                 # Check if elapsed task time passed the reply window
                 if entry.rescheduled:
@@ -356,6 +397,7 @@ class Scheduler:
 
                 # Handler if the allowed reply time passed
                 if reply_time_passed:
+                    self._in_flight = None  # The retransmission is sent again even if it's the only normal task
                     if entry.rescheduled:
                         self._schedule_qs.pop_normal_task()
                     else:
@@ -363,8 +405,8 @@ class Scheduler:
                         self._schedule_qs.normal.reschedule()
 
             else:  # Send priority task
-                self.tx_callback(entry.pkt.buf)
-                self._schedule_qs.pop_priority_task()
+                if self._transmit_task(entry, False):
+                    self._schedule_qs.pop_priority_task()
 
     def _perform_task(self):
         """Process the stored scheduler rx packet
@@ -375,17 +417,71 @@ class Scheduler:
 
         entry = self._rx_pkt.process_incoming_pkt(self.task_table)
 
-        if entry is not None:
-            if self._rx_pkt.buf[constants.TASK_TYPE_OFFSET] == constants.INTERNAL_TASK:
-                self._process_internal_task()
-            else:
+        # Every verified packet carries the queue space of the other system
+        if self._rx_pkt.credit is not None and self._rx_pkt.credit != constants.UNKNOWN_CREDIT:
+            self.peer_credit = self._rx_pkt.credit
+            self.credit_time = time()
+
+        # Internal tasks have no task table entry, so they're run once their packet is verified
+        if self._rx_pkt.credit is not None and self._rx_pkt.buf[constants.TASK_TYPE_OFFSET] == constants.INTERNAL_TASK:
+            self._process_internal_task()
+
+        elif entry is not None:
+            seq = self._rx_pkt.buf[constants.SEQ_OFFSET]
+            ret_code = self._find_completed_task(entry.id, seq)
+
+            # A retransmission of a task that was already performed is only acknowledged again
+            if ret_code is None:
                 ret_code = self.rx_callback(entry.id, entry.task, self._rx_pkt.buf[constants.PAYLOAD_OFFSET:])
-                alert_system_pkt = bytearray([entry.id, ret_code])
-                self._schedule_general_task(constants.ALERT_SYSTEM, constants.INTERNAL_TASK,
-                                            alert_system_pkt, True, True)
+                if seq != constants.NO_SEQ:
+                    self._completed.append((entry.id, seq, ret_code, time()))
+
+            alert_system_pkt = bytearray([entry.id, ret_code, seq])
+            self._schedule_general_task(constants.ALERT_SYSTEM, constants.INTERNAL_TASK,
+                                        alert_system_pkt, True, True)
 
         self._rx_pkt.buf = bytearray()  # Reset rx packet buffer
 
+    def _find_completed_task(self, task_id, seq):
+        """Get the return code of a task in the window of completed sequences
+
+        None is returned if the task is not a retransmission. The
+        sequences that are older than the time the other system takes
+        to retransmit a task are forgotten, so a system that restarted
+        its sequences doesn't have its first tasks taken for
+        retransmissions.
+        """
+
+        if seq == constants.NO_SEQ:
+            return None
+
+        for completed_id, completed_seq, ret_code, completed_time in self._completed:
+            if completed_id == task_id and completed_seq == seq and time() - completed_time < constants.SEQ_WINDOW_TIMER:
+                return ret_code
+
+        return None
+
+    def _peer_has_credit(self):
+        """Check if the other system can take in another normal task
+
+        The other system advertises how much space it has left in its
+        queues with every packet it sends (its replies included). When
+        it runs out, normal tasks are held in the queues until it
+        advertises more space.
+        Since the other system might not have anything to send after
+        freeing up space, a task is let through every once in a while
+        to probe it for a new credit.
+        """
+
+        if self.peer_credit == constants.UNKNOWN_CREDIT or self.peer_credit > 0:
+            return True
+
+        if time() - self.credit_time >= constants.CREDIT_PROBE_TIMER:
+            self.credit_time = time()
+            return True
+
+        return False
+
     def _process_internal_task(self):
         """This method basically acts as an internal task table"""
 
@@ -398,33 +494,78 @@ class Scheduler:
             self.printer.modify_task_printer_var(self._rx_pkt.buf[constants.PAYLOAD_OFFSET:])
 
     def _process_current_task(self):
-        """Decides what action for the task to take based on the other system's reply"""
+        """Decides what action for the task to take based on the other system's reply
+
+        A reply only counts for the copy of the task with the same
+        sequence.
+        """
+
+        payload = self._rx_pkt.buf[constants.PAYLOAD_OFFSET:]
 
-        if len(self._schedule_qs.normal) != 0:
+        if len(self._schedule_qs.normal) != 0 and len(payload) >= 3:
 
             entry = self._schedule_qs.normal[0]
-            if self._rx_pkt.buf[constants.PAYLOAD_OFFSET] == entry.id:
-                if self._rx_pkt.buf[constants.PAYLOAD_OFFSET + 1] and not entry.rescheduled:
+            if payload[0] == entry.id and payload[2] == entry.seq:
+                self._in_flight = None  # The retry is sent again even if it's the only normal task
+
+                if payload[1] and not entry.rescheduled:
                     entry.rescheduled = True
+                    entry.seq = constants.NO_SEQ  # The other system ran the task, so the retry is performed as a new task
                     self._schedule_qs.normal.reschedule()
                 else:
                     self._schedule_qs.pop_normal_task()
 
+    def _transmit_task(self, entry, is_normal):
+        """Send a queued task through the tx callback
+
+        A normal task consumes one credit from the other system, since
+        it takes a queue entry there for the reply. Priority tasks (the
+        task completion alerts included) are always sent, since they are
+        not answered and nothing would refill the credit they take.
+        """
+
+        if is_normal:
+            if not self._peer_has_credit():
+                return False
+
+            if self.peer_credit != constants.UNKNOWN_CREDIT and self.peer_credit > 0:
+                self.peer_credit -= 1
+
+        # The advertised credit can't collide with the unknown credit value
+        credit = min(len(self._schedule_qs.unscheduled), constants.UNKNOWN_CREDIT - 1)
+        self.tx_callback(entry.pkt.encode(credit, entry.seq))
+
+        return True
+
     def _schedule_general_task(self, task_id, task_type, pkt, is_priority=False, is_fast=False):
-        """Schedule a general task to be performed by another system"""
+        """Schedule a general task to be performed by another system
+
+        False is returned if the task is refused: a copy of it is
+        queued already, its payload doesn't fit or there's no room left
+        in the queues. When the queues are full, a queued priority task
+        is sent to make room. Queued normal tasks keep their order and
+        wait for their replies, so the task is refused if there are only
+        normal tasks.
+        """
 
-        if not self._schedule_qs.in_queues(task_id):
+        if self._schedule_qs.in_queues(task_id):
+            return False
+
+        # Send a priority task to free up space in queues (if they are full)
+        if self._schedule_qs.queues_are_full():
+
+            if self._schedule_qs.is_priority_queue_empty():
+                return False
+            self.send_task()
 
-            # Send a task to free up space in queues (if they are full)
             if self._schedule_qs.queues_are_full():
+                return False
 
-                # Prioritize a normal task to make space
-                if self._schedule_qs.queue_type:
-                    self._schedule_qs.prioritize_normal_task()
-                self.send_task()
+        if not self._schedule_qs.push_task(task_id, task_type, pkt, is_priority, is_fast):
+            return False
 
-            self._schedule_qs.push_task(task_id, task_type, pkt, is_priority, is_fast)
+        # Send task immediately if it's a fast task
+        if is_fast:
+            self.send_task()
 
-            # Send task immediately if it's a fast task
-            if is_fast:
-                self.send_task()
+        return True
@@ -0,0 +1,158 @@
+"""
+This module reads the device snapshot the native gateway publishes.
+
+The gateway keeps the attributes every MCU reports in a shared memory
+snapshot (src/Native/snapshot). Reading it doesn't go through the
+messengers or the device trackers, so any local process can take a
+consistent view of the devices without locks.
+"""
+
+import os
+import ctypes
+import struct
+from collections import namedtuple
+
+
+SNAPSHOT_LIB_ENV = "DEVICE_SNAPSHOT_LIB"  # Environment variable to override the library's location
+_DEFAULT_SNAPSHOT_LIB = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                     "..", "..", "Native", "build", "libdevice_snapshot.so")
+
+# These must match the ones in src/Native/snapshot/snapshot.h
+
+DEFAULT_SNAPSHOT_NAME = "/elevator_snapshot"
+SNAPSHOT_ATTR_CNT = 16
+SNAPSHOT_NO_ATTR = 0xFF
+
+_SNAPSHOT_MAX_NAME_SIZE = 256
+_SNAPSHOT_DEVICE_ALIGNMENT = 64
+
+
+class _SnapshotState(ctypes.Structure):
+    _fields_ = [
+        ("updated_us", ctypes.c_uint64),
+        ("values", ctypes.c_uint64 * SNAPSHOT_ATTR_CNT),
+        ("types", ctypes.c_uint8 * SNAPSHOT_ATTR_CNT),
+        ("sizes", ctypes.c_uint8 * SNAPSHOT_ATTR_CNT)
+    ]
+
+
+class _SnapshotDevice(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("link", ctypes.c_uint16),
+        ("device_id", ctypes.c_uint16),
+        ("tracker_id", ctypes.c_uint8),
+        ("reserved", ctypes.c_uint8 * 7),
+        ("state", _SnapshotState)
+    ]
+
+
+class _Snapshot(ctypes.Structure):
+    _fields_ = [
+        ("hdr", ctypes.c_void_p),
+        ("size", ctypes.c_size_t),
+        ("is_owner", ctypes.c_bool),
+        ("name", ctypes.c_char * _SNAPSHOT_MAX_NAME_SIZE)
+    ]
+
+
+# Size of a device record in the snapshot (the records are padded to whole cache lines)
+_SNAPSHOT_DEVICE_SIZE = -(-ctypes.sizeof(_SnapshotDevice) // _SNAPSHOT_DEVICE_ALIGNMENT) * _SNAPSHOT_DEVICE_ALIGNMENT
+
+SnapshotDevice = namedtuple("SnapshotDevice", ["link", "tracker_id", "device_id", "updated_us", "attrs"])
+
+
+def _load_snapshot_lib():
+    """Load the native snapshot library (None is returned if it's not available)"""
+
+    try:
+        lib = ctypes.CDLL(os.environ.get(SNAPSHOT_LIB_ENV, _DEFAULT_SNAPSHOT_LIB))
+    except OSError:
+        return None
+
+    lib.open_snapshot.restype = ctypes.c_bool
+    lib.open_snapshot.argtypes = [ctypes.POINTER(_Snapshot), ctypes.c_char_p]
+    lib.get_snapshot_device_count.restype = ctypes.c_uint32
+    lib.get_snapshot_device_count.argtypes = [ctypes.POINTER(_Snapshot)]
+    lib.read_snapshot_device.restype = ctypes.c_bool
+    lib.read_snapshot_device.argtypes = [ctypes.POINTER(_Snapshot), ctypes.c_uint32, ctypes.c_void_p]
+    lib.close_snapshot.restype = None
+    lib.close_snapshot.argtypes = [ctypes.POINTER(_Snapshot)]
+
+    return lib
+
+
+_lib = _load_snapshot_lib()
+
+
+def is_native():
+    """Check if the native snapshot library is available"""
+
+    return _lib is not None
+
+
+class DeviceSnapshot(object):
+    """Read-only view of the device snapshot of a gateway
+
+    The attribute values are unpacked with their attribute types (the
+    same format characters the device trackers use), so a device reads
+    the same as its tracker would after the same updates.
+    """
+
+    def __init__(self, name=DEFAULT_SNAPSHOT_NAME, endianness_format='<'):
+
+        if _lib is None:
+            raise IOError("The native snapshot library is not available")
+
+        self._snapshot = _Snapshot()
+        self._endianness_format = endianness_format
+
+        # The library copies whole records, so it's given a buffer aligned like one
+        self._device_buf = (ctypes.c_uint8 * (_SNAPSHOT_DEVICE_SIZE + _SNAPSHOT_DEVICE_ALIGNMENT))()
+        address = ctypes.addressof(self._device_buf)
+        self._device_address = address + (-address % _SNAPSHOT_DEVICE_ALIGNMENT)
+        self._device = _SnapshotDevice.from_address(self._device_address)
+
+        if not _lib.open_snapshot(ctypes.byref(self._snapshot), name.encode("ascii")):
+            raise IOError("Could not open the snapshot '{}'".format(name))
+
+    def close(self):
+        """Unmap the snapshot"""
+
+        _lib.close_snapshot(ctypes.byref(self._snapshot))
+
+    def get_device_count(self):
+        """Get the amount of devices in the snapshot"""
+
+        return _lib.get_snapshot_device_count(ctypes.byref(self._snapshot))
+
+    def read_device(self, index):
+        """Take a consistent copy of a device (None is returned if it can't be read)"""
+
+        if not _lib.read_snapshot_device(ctypes.byref(self._snapshot), index, self._device_address):
+            return None
+
+        state = self._device.state
+        attrs = {}
+
+        for attr_id in range(SNAPSHOT_ATTR_CNT):
+            if state.types[attr_id] != SNAPSHOT_NO_ATTR:
+                attrs[attr_id] = self._unpack_value(state.types[attr_id], state.values[attr_id], state.sizes[attr_id])
+
+        return SnapshotDevice(self._device.link, self._device.tracker_id, self._device.device_id, state.updated_us, attrs)
+
+    def read_devices(self):
+        """Take a copy of every device in the snapshot"""
+
+        devices = (self.read_device(index) for index in range(self.get_device_count()))
+        return [device for device in devices if device is not None]
+
+    def _unpack_value(self, attr_type, raw_value, size):
+        """Unpack a value with its attribute type (the raw bytes are given if the type is unknown)"""
+
+        value_pkt = struct.pack("=Q", raw_value)[:size]  # The gateway kept the bytes as the MCU sent them
+
+        try:
+            return struct.unpack(self._endianness_format + chr(attr_type), value_pkt)[0]
+        except struct.error:
+            return bytearray(value_pkt)